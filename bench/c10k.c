@@ -0,0 +1,285 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "histogram.h"
+#include "mio.h"
+
+// A C10K/C100K load generator: a single executor serves many connections (socketpairs or pipes),
+// while helper threads send timestamped messages over randomly chosen ones. Reports the throughput,
+// the distribution of latencies from sending a message to the executor's task reading it,
+// and the memory used per idle connection, as a single JSON object.
+// Usage: c10k_bench [connections] [messages] [helper threads] [messages/sec per helper, 0 - unpaced]
+//                   [socketpair|pipe]
+// The number of connections is clamped to what the descriptor limit allows (2 fds per connection).
+
+#define DEFAULT_CONNECTIONS 10000
+#define DEFAULT_MESSAGES 100000
+#define DEFAULT_HELPERS 2
+#define DEFAULT_RATE 20000 // unpaced helpers fill the socket buffers, so latencies become queueing delays
+#define FD_RESERVE 64 // descriptors left for everything else
+#define READ_BUFFER_MESSAGES 64
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Raises the soft limit of descriptors as far as possible and returns how many connections fit
+static size_t max_connections(void)
+{
+    struct rlimit limit;
+    ASSERT_SYS_OK(getrlimit(RLIMIT_NOFILE, &limit));
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit); // keep the old limit on failure
+    ASSERT_SYS_OK(getrlimit(RLIMIT_NOFILE, &limit));
+    return limit.rlim_cur > FD_RESERVE + 2 ? (limit.rlim_cur - FD_RESERVE) / 2 : 1;
+}
+
+static size_t rss_bytes(void)
+{
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    unsigned long size, resident = 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static size_t heap_bytes(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd; // including large mmap'd blocks
+}
+
+// ========================= executor side =========================
+
+// Shared by all connections: the executor is single-threaded and reads don't interleave
+static uint8_t read_buffer[READ_BUFFER_MESSAGES * sizeof(uint64_t)];
+static Histogram* latencies;
+static uint64_t received = 0;
+
+/** Reads timestamps from a connection until EOF, recording their latencies. */
+typedef struct ConnectionFuture {
+    Future base;
+    int fd;
+    bool registered; // whether the fd is registered in Mio
+    uint8_t partial_len; // number of bytes of an incomplete message
+    uint8_t partial[sizeof(uint64_t)];
+} ConnectionFuture;
+
+static FutureState connection_future_progress(Future* base, Mio* mio, Waker waker)
+{
+    ConnectionFuture* self = (ConnectionFuture*)base;
+    for (;;) {
+        if (!executor_budget_consume(waker.executor)) {
+            waker_wake(&waker);
+            return FUTURE_PENDING;
+        }
+        memcpy(read_buffer, self->partial, self->partial_len);
+        ssize_t bytes_read = read(self->fd, read_buffer + self->partial_len,
+            sizeof(read_buffer) - self->partial_len);
+        if (bytes_read > 0) {
+            size_t len = self->partial_len + bytes_read;
+            uint64_t now = monotonic_ns();
+            size_t pos = 0;
+            for (; pos + sizeof(uint64_t) <= len; pos += sizeof(uint64_t)) {
+                uint64_t sent_ns;
+                memcpy(&sent_ns, read_buffer + pos, sizeof(sent_ns));
+                histogram_record(latencies, now - sent_ns);
+                ++received;
+            }
+            self->partial_len = len - pos;
+            memcpy(self->partial, read_buffer + pos, self->partial_len);
+        } else if (bytes_read == 0) {
+            if (self->registered)
+                mio_unregister(mio, self->fd);
+            ASSERT_SYS_OK(close(self->fd));
+            return FUTURE_COMPLETED;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Registered once: the registration is level-triggered and stays valid
+            if (!self->registered) {
+                ASSERT_SYS_OK(mio_register(mio, self->fd, EPOLLIN, waker));
+                self->registered = true;
+            }
+            return FUTURE_PENDING;
+        } else {
+            syserr("Reading from a connection failed\n");
+        }
+    }
+}
+
+// ========================= helper threads =========================
+
+typedef struct Helper {
+    pthread_t thread;
+    int* fds; // sending ends of the helper's connections
+    size_t n_fds;
+    size_t messages;
+    unsigned rate; // messages per second (0 - as fast as possible)
+    unsigned seed;
+} Helper;
+
+static void* helper_main(void* arg)
+{
+    Helper* helper = arg;
+    uint64_t start = monotonic_ns();
+    for (size_t i = 0; i < helper->messages; ++i) {
+        if (helper->rate != 0) {
+            uint64_t due = start + i * 1000000000ULL / helper->rate;
+            uint64_t now = monotonic_ns();
+            if (due > now) {
+                struct timespec gap = { .tv_sec = (due - now) / 1000000000, .tv_nsec = (due - now) % 1000000000 };
+                nanosleep(&gap, NULL);
+            }
+        }
+        int fd = helper->fds[rand_r(&helper->seed) % helper->n_fds];
+        uint64_t now = monotonic_ns();
+        // Blocking: a connection with a full buffer holds the helper back
+        if (write(fd, &now, sizeof(now)) != sizeof(now))
+            syserr("Writing to a connection failed\n");
+    }
+    for (size_t i = 0; i < helper->n_fds; ++i)
+        ASSERT_SYS_OK(close(helper->fds[i]));
+    return NULL;
+}
+
+/**
+ * Spawned after all connections: when it is progressed, every connection has already
+ * been progressed once and is waiting for data, so the memory of idle connections is measured
+ * and then the helpers start sending.
+ */
+typedef struct StartFuture {
+    Future base;
+    Helper* helpers;
+    size_t n_helpers;
+    size_t heap_idle;
+    size_t rss_idle;
+    uint64_t start_ns;
+} StartFuture;
+
+static FutureState start_future_progress(Future* base, Mio* mio, Waker waker)
+{
+    StartFuture* self = (StartFuture*)base;
+    self->heap_idle = heap_bytes();
+    self->rss_idle = rss_bytes();
+    self->start_ns = monotonic_ns();
+    for (size_t i = 0; i < self->n_helpers; ++i)
+        ASSERT_ZERO(pthread_create(&self->helpers[i].thread, NULL, helper_main, &self->helpers[i]));
+    return FUTURE_COMPLETED;
+}
+
+// ========================= main =========================
+
+int main(int argc, char* argv[])
+{
+    size_t requested = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_CONNECTIONS;
+    size_t messages = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MESSAGES;
+    size_t n_helpers = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_HELPERS;
+    unsigned rate = argc > 4 ? strtoul(argv[4], NULL, 10) : DEFAULT_RATE;
+    bool use_pipes = argc > 5 && strcmp(argv[5], "pipe") == 0;
+    size_t limit = max_connections();
+    size_t n_connections = requested < limit ? requested : limit;
+    if (n_connections == 0 || n_helpers == 0)
+        fatal("Usage: %s [connections] [messages] [helper threads] [rate] [socketpair|pipe]\n", argv[0]);
+    if (n_helpers > n_connections)
+        n_helpers = n_connections;
+
+    latencies = histogram_create();
+    int* sending_fds = (int*)malloc(n_connections * sizeof(int));
+    Helper* helpers = (Helper*)calloc(n_helpers, sizeof(Helper));
+    size_t per_helper = (n_connections + n_helpers - 1) / n_helpers;
+    int* helper_fds = (int*)malloc(n_helpers * per_helper * sizeof(int));
+    if (!sending_fds || !helpers || !helper_fds)
+        fatal("Allocation failed\n");
+
+    Executor* executor = executor_create(0);
+    size_t heap_before = heap_bytes();
+    size_t rss_before = rss_bytes();
+    ConnectionFuture* connections = (ConnectionFuture*)malloc(n_connections * sizeof(ConnectionFuture));
+    if (!connections)
+        fatal("Allocation failed\n");
+    for (size_t i = 0; i < n_connections; ++i) {
+        int fds[2]; // fds[0] - receiving end (non-blocking), fds[1] - sending end
+        if (use_pipes) {
+            ASSERT_SYS_OK(pipe2(fds, O_CLOEXEC));
+            ASSERT_SYS_OK(fcntl(fds[0], F_SETFL, O_NONBLOCK));
+        } else {
+            ASSERT_SYS_OK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds));
+            ASSERT_SYS_OK(fcntl(fds[0], F_SETFL, O_NONBLOCK));
+        }
+        connections[i] = (ConnectionFuture) {
+            .base = future_create(connection_future_progress),
+            .fd = fds[0],
+            .registered = false,
+            .partial_len = 0,
+        };
+        sending_fds[i] = fds[1];
+        executor_spawn(executor, (Future*)&connections[i]);
+    }
+
+    // Helper h sends over connections h, h + n_helpers, ... and closes them when it's done
+    for (size_t h = 0; h < n_helpers; ++h) {
+        helpers[h].fds = helper_fds + h * per_helper;
+        for (size_t i = h; i < n_connections; i += n_helpers)
+            helpers[h].fds[helpers[h].n_fds++] = sending_fds[i];
+        helpers[h].messages = messages / n_helpers + (h < messages % n_helpers);
+        helpers[h].rate = rate;
+        helpers[h].seed = 42 + h;
+    }
+
+    StartFuture start = {
+        .base = future_create(start_future_progress),
+        .helpers = helpers,
+        .n_helpers = n_helpers,
+    };
+    executor_spawn(executor, (Future*)&start);
+    executor_run(executor);
+    uint64_t ns = monotonic_ns() - start.start_ns;
+    for (size_t h = 0; h < n_helpers; ++h)
+        ASSERT_ZERO(pthread_join(helpers[h].thread, NULL));
+
+    printf("{\"bench\": \"c10k\", \"transport\": \"%s\", \"requested_connections\": %zu, "
+           "\"connections\": %zu, \"helpers\": %zu, \"rate_per_helper\": %u, \"messages\": %llu, "
+           "\"msgs_per_sec\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+           "\"max_ns\": %llu, \"heap_bytes_per_conn\": %.1f, \"rss_bytes_per_conn\": %.1f}\n",
+        use_pipes ? "pipe" : "socketpair", requested, n_connections, n_helpers, rate,
+        (unsigned long long)received, received * 1e9 / ns,
+        (unsigned long long)histogram_percentile(latencies, 50),
+        (unsigned long long)histogram_percentile(latencies, 99),
+        (unsigned long long)histogram_percentile(latencies, 99.9),
+        (unsigned long long)histogram_max(latencies),
+        (double)(start.heap_idle - heap_before) / n_connections,
+        (double)(start.rss_idle - rss_before) / n_connections);
+
+    if (received != messages)
+        fatal("Received %llu of %zu messages\n", (unsigned long long)received, messages);
+    executor_destroy(executor);
+    free(connections);
+    free(helper_fds);
+    free(helpers);
+    free(sending_fds);
+    histogram_destroy(latencies);
+    return 0;
+}
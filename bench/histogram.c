@@ -0,0 +1,92 @@
+#include "histogram.h"
+
+#include <stdlib.h>
+
+#include "err.h"
+
+// Values below LINEAR_LIMIT have their own buckets;
+// every power-of-two range above it is split into SUB_BUCKETS buckets.
+#define SUB_BUCKET_BITS 6
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define LINEAR_LIMIT (2 * SUB_BUCKETS)
+#define N_BUCKETS (LINEAR_LIMIT + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS)
+
+struct Histogram {
+    uint64_t counts[N_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+    double sum;
+};
+
+static size_t bucket_index(uint64_t value) {
+    if (value < LINEAR_LIMIT)
+        return value;
+    int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS; // >= 1
+    return LINEAR_LIMIT + (size_t)(shift - 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+// The middle of the range of values represented by a bucket
+static uint64_t bucket_value(size_t index) {
+    if (index < LINEAR_LIMIT)
+        return index;
+    int shift = (index - LINEAR_LIMIT) / SUB_BUCKETS + 1;
+    uint64_t sub = (index - LINEAR_LIMIT) % SUB_BUCKETS + SUB_BUCKETS;
+    return (sub << shift) + ((uint64_t)1 << (shift - 1));
+}
+
+Histogram* histogram_create(void) {
+    Histogram *histogram = (Histogram*)calloc(1, sizeof(Histogram));
+    if (!histogram)
+        fatal("Allocation failed\n");
+    return histogram;
+}
+
+void histogram_destroy(Histogram* histogram) {
+    free(histogram);
+}
+
+void histogram_record(Histogram* histogram, uint64_t value) {
+    ++histogram->counts[bucket_index(value)];
+    ++histogram->total;
+    histogram->sum += value;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+void histogram_merge(Histogram* dst, Histogram const* src) {
+    for (size_t i = 0; i < N_BUCKETS; ++i)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+uint64_t histogram_count(Histogram const* histogram) {
+    return histogram->total;
+}
+
+uint64_t histogram_percentile(Histogram const* histogram, double percentile) {
+    if (histogram->total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->total + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < N_BUCKETS; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+uint64_t histogram_max(Histogram const* histogram) {
+    return histogram->max;
+}
+
+double histogram_mean(Histogram const* histogram) {
+    return histogram->total == 0 ? 0.0 : histogram->sum / histogram->total;
+}
@@ -0,0 +1,38 @@
+#ifndef BENCH_HISTOGRAM_H
+#define BENCH_HISTOGRAM_H
+
+#include <stdint.h>
+
+/**
+ * A log-linear (HDR-style) histogram of non-negative integer values, e.g. latencies in nanoseconds.
+ *
+ * Every power-of-two range of values is split into 64 equal buckets, so that each recorded value
+ * is represented with a relative error below 1.6%, in constant memory and with O(1) recording.
+ */
+typedef struct Histogram Histogram;
+
+/** Creates an empty histogram. */
+Histogram* histogram_create(void);
+
+/** Destroys a histogram. */
+void histogram_destroy(Histogram* histogram);
+
+/** Records a single value. */
+void histogram_record(Histogram* histogram, uint64_t value);
+
+/** Adds all values recorded in `src` to `dst`. */
+void histogram_merge(Histogram* dst, Histogram const* src);
+
+/** Returns the number of recorded values. */
+uint64_t histogram_count(Histogram const* histogram);
+
+/** Returns the value below which `percentile` percent (0 - 100) of recorded values fall. */
+uint64_t histogram_percentile(Histogram const* histogram, double percentile);
+
+/** Returns the largest recorded value. */
+uint64_t histogram_max(Histogram const* histogram);
+
+/** Returns the mean of recorded values. */
+double histogram_mean(Histogram const* histogram);
+
+#endif // BENCH_HISTOGRAM_H
@@ -0,0 +1,547 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coroutine.h"
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_combinators.h"
+#include "future_examples.h"
+#include "histogram.h"
+#include "join_handle.h"
+#include "mio.h"
+
+// Microbenchmarks of the executor's basic operations: spawning, waking, progressing combinators,
+// pipe round trips and polling (also on a simulated Mio, where no time is spent waiting).
+// Each measurement is printed as a JSON object on its own line.
+// Usage: micro_bench [name] - runs only the benchmarks whose name contains `name`.
+
+#define SPAWN_TASKS 1000000
+#define SPAWN_BATCH 10000
+#define WAKES 5000000
+#define COMBINATOR_ITERATIONS 100000
+#define SELECT_ITERATIONS 20000 // every SelectFuture leaks the wrapper of its losing subtask
+#define MAX_DEPTH 16
+#define PING_PONG_ROUNDS 100000
+#define POLLS 100000
+#define FD_RESERVE 64 // descriptors left for everything else when registering many of them
+#define SIM_TIMERS 1000000
+#define SIM_SEED 42
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Prints a measurement of `ops` operations that took `ns` nanoseconds; `params` is a JSON fragment. */
+static void report(const char* bench, const char* params, uint64_t ops, uint64_t ns)
+{
+    printf("{\"bench\": \"%s\"%s, \"ops\": %llu, \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f}\n",
+        bench, params, (unsigned long long)ops, (double)ns / ops, ops * 1e9 / ns);
+    fflush(stdout);
+}
+
+static FutureState ready_future_progress(Future* fut, Mio* mio, Waker waker)
+{
+    return FUTURE_COMPLETED;
+}
+
+static void* identity(void* arg)
+{
+    return arg;
+}
+
+// ========================= spawn =========================
+
+static void bench_spawn(void)
+{
+    Future* futures = (Future*)malloc(SPAWN_BATCH * sizeof(Future));
+    if (!futures)
+        fatal("Allocation failed\n");
+    Executor* executor = executor_create(0);
+
+    uint64_t start = monotonic_ns();
+    for (size_t spawned = 0; spawned < SPAWN_TASKS; spawned += SPAWN_BATCH) {
+        for (size_t i = 0; i < SPAWN_BATCH; ++i) {
+            futures[i] = future_create(ready_future_progress);
+            executor_spawn(executor, &futures[i]);
+        }
+        executor_run(executor);
+    }
+    uint64_t ns = monotonic_ns() - start;
+    char params[64];
+    snprintf(params, sizeof(params), ", \"batch\": %d", SPAWN_BATCH);
+    report("spawn", params, SPAWN_TASKS, ns);
+
+    executor_destroy(executor);
+    free(futures);
+}
+
+static void bench_spawn_owned(void)
+{
+    Executor* executor = executor_create(0);
+
+    uint64_t start = monotonic_ns();
+    for (size_t spawned = 0; spawned < SPAWN_TASKS; spawned += SPAWN_BATCH) {
+        for (size_t i = 0; i < SPAWN_BATCH; ++i) {
+            Future fut = future_create(ready_future_progress);
+            EXECUTOR_SPAWN_OWNED(executor, fut, NULL);
+        }
+        executor_run(executor);
+    }
+    uint64_t ns = monotonic_ns() - start;
+    char params[64];
+    snprintf(params, sizeof(params), ", \"batch\": %d", SPAWN_BATCH);
+    report("spawn_owned", params, SPAWN_TASKS, ns);
+
+    executor_destroy(executor);
+}
+
+// ========================= wake =========================
+
+typedef struct CountdownFuture {
+    Future base;
+    size_t remaining; // number of times to wake itself up
+} CountdownFuture;
+
+static FutureState countdown_future_progress(Future* base, Mio* mio, Waker waker)
+{
+    CountdownFuture* self = (CountdownFuture*)base;
+    if (self->remaining == 0)
+        return FUTURE_COMPLETED;
+    --self->remaining;
+    waker_wake(&waker);
+    return FUTURE_PENDING;
+}
+
+static void bench_wake(void)
+{
+    Executor* executor = executor_create(0);
+    CountdownFuture countdown = { .base = future_create(countdown_future_progress), .remaining = WAKES };
+    executor_spawn(executor, (Future*)&countdown);
+
+    uint64_t start = monotonic_ns();
+    executor_run(executor);
+    // Every wake is followed by a progress call of the woken task
+    report("wake", "", WAKES, monotonic_ns() - start);
+
+    executor_destroy(executor);
+}
+
+static void* yield_loop(CoroutineFuture* self, void* arg)
+{
+    for (size_t i = 0; i < WAKES; ++i)
+        coroutine_yield(self);
+    return NULL;
+}
+
+static void bench_coroutine_yield(void)
+{
+    Executor* executor = executor_create(0);
+    CoroutineFuture coroutine = coroutine_future_create(yield_loop, 0);
+    executor_spawn(executor, (Future*)&coroutine);
+
+    uint64_t start = monotonic_ns();
+    executor_run(executor);
+    // As "wake", plus two stack switches per progress call
+    report("coroutine_yield", "", WAKES, monotonic_ns() - start);
+
+    executor_destroy(executor);
+    coroutine_stack_pool_clear();
+}
+
+// ========================= combinators =========================
+
+// The futures of a combinator tree nested `depth` levels deep:
+// level i combines level i - 1 (or leaves[0] for i = 0) with leaves[i + 1].
+typedef struct CombinatorTree {
+    ApplyFuture leaves[MAX_DEPTH + 1];
+    union {
+        ThenFuture then;
+        JoinFuture join;
+        SelectFuture select;
+    } levels[MAX_DEPTH];
+} CombinatorTree;
+
+typedef enum Combinator { COMBINATOR_NONE, COMBINATOR_THEN, COMBINATOR_JOIN, COMBINATOR_SELECT } Combinator;
+
+// Builds the tree and returns its root
+static Future* build_tree(CombinatorTree* tree, Combinator combinator, int depth)
+{
+    for (int i = 0; i <= depth; ++i)
+        tree->leaves[i] = apply_future_create(identity);
+    Future* root = (Future*)&tree->leaves[0];
+    for (int i = 0; i < depth; ++i) {
+        Future* leaf = (Future*)&tree->leaves[i + 1];
+        switch (combinator) {
+        case COMBINATOR_THEN:
+            tree->levels[i].then = future_then(root, leaf);
+            break;
+        case COMBINATOR_JOIN:
+            tree->levels[i].join = future_join(root, leaf);
+            break;
+        case COMBINATOR_SELECT:
+            tree->levels[i].select = future_select(root, leaf);
+            break;
+        default:
+            fatal("Unknown combinator\n");
+        }
+        root = (Future*)&tree->levels[i];
+    }
+    return root;
+}
+
+// Returns the time to spawn and complete a single tree
+static double time_tree(Combinator combinator, int depth, size_t iterations)
+{
+    // The losing subtasks of nested SelectFutures are still queued when the tree completes
+    // and only get progressed during the next run, so the previous tree has to be kept intact.
+    CombinatorTree trees[2];
+    Executor* executor = executor_create(0);
+    uint64_t start = monotonic_ns();
+    for (size_t i = 0; i < iterations; ++i) {
+        executor_spawn(executor, build_tree(&trees[i % 2], combinator, depth));
+        executor_run(executor);
+    }
+    uint64_t ns = monotonic_ns() - start;
+    executor_destroy(executor);
+    return (double)ns / iterations;
+}
+
+static void bench_combinator(const char* name, Combinator combinator, size_t iterations)
+{
+    // A single leaf future, to subtract the cost of spawning and running the tree
+    double base_ns = time_tree(COMBINATOR_NONE, 0, iterations);
+    for (int depth = 1; depth <= MAX_DEPTH; depth *= 2) {
+        double ns = time_tree(combinator, depth, iterations);
+        printf("{\"bench\": \"%s\", \"depth\": %d, \"ops\": %zu, \"ns_per_op\": %.1f, "
+               "\"ns_per_level\": %.1f}\n",
+            name, depth, iterations, ns, (ns - base_ns) / depth);
+        fflush(stdout);
+    }
+}
+
+static void bench_then(void)
+{
+    bench_combinator("then", COMBINATOR_THEN, COMBINATOR_ITERATIONS);
+}
+
+static void bench_join(void)
+{
+    bench_combinator("join", COMBINATOR_JOIN, COMBINATOR_ITERATIONS);
+}
+
+static void bench_select(void)
+{
+    bench_combinator("select", COMBINATOR_SELECT, SELECT_ITERATIONS);
+}
+
+// ========================= wakes inside chains =========================
+
+#define CHAIN_WAKES 200000
+
+// Returns the time of a wake of a CountdownFuture that is the first stage of a chain
+// of `depth` futures, built from nested ThenFutures or as a PipelineFuture
+static double time_chain_wake(bool pipeline, int depth)
+{
+    Executor* executor = executor_create(0);
+    CountdownFuture countdown = { .base = future_create(countdown_future_progress), .remaining = CHAIN_WAKES };
+    ApplyFuture leaves[MAX_DEPTH];
+    ThenFuture thens[MAX_DEPTH];
+    Future* stages[MAX_DEPTH];
+    stages[0] = (Future*)&countdown;
+    for (int i = 1; i < depth; ++i) {
+        leaves[i] = apply_future_create(identity);
+        stages[i] = (Future*)&leaves[i];
+    }
+    PipelineFuture chain = future_pipeline(stages, depth);
+    Future* root = (Future*)&chain;
+    if (!pipeline) {
+        // then(...then(then(countdown, leaf 1), leaf 2)..., leaf depth - 1):
+        // every wake of the countdown re-enters all levels
+        root = (Future*)&countdown;
+        for (int i = 1; i < depth; ++i) {
+            thens[i] = future_then(root, stages[i]);
+            root = (Future*)&thens[i];
+        }
+    }
+    executor_spawn(executor, root);
+    uint64_t start = monotonic_ns();
+    executor_run(executor);
+    uint64_t ns = monotonic_ns() - start;
+    executor_destroy(executor);
+    return (double)ns / CHAIN_WAKES;
+}
+
+static void bench_chain_wake(void)
+{
+    for (int depth = 1; depth <= MAX_DEPTH; depth *= 2) {
+        for (int pipeline = 0; pipeline < 2; ++pipeline) {
+            printf("{\"bench\": \"%s\", \"depth\": %d, \"ops\": %d, \"ns_per_op\": %.1f}\n",
+                pipeline ? "pipeline_wake" : "then_wake", depth, CHAIN_WAKES,
+                time_chain_wake(pipeline, depth));
+            fflush(stdout);
+        }
+    }
+}
+
+// ========================= pipe ping-pong =========================
+
+/** Alternately writes and reads a byte, the client starting with a write, the server with a read. */
+typedef struct PingPongFuture {
+    Future base;
+    int read_fd;
+    int write_fd;
+    bool writing; // whether the current operation is `write` (or `read`)
+    size_t ops_left; // number of reads and writes yet to be completed
+    uint8_t byte;
+    PipeReadFuture read;
+    PipeWriteFuture write;
+    uint64_t sent_ns;
+    Histogram* round_trips; // recorded by the client only (NULL for the server)
+} PingPongFuture;
+
+static void ping_pong_start_op(PingPongFuture* self)
+{
+    if (self->writing) {
+        self->write = pipe_write_future_create(self->write_fd, 1, false);
+        self->write.base.arg = &self->byte;
+        self->sent_ns = monotonic_ns();
+    } else {
+        self->read = pipe_read_future_create(self->read_fd, &self->byte, 1);
+    }
+}
+
+static FutureState ping_pong_future_progress(Future* base, Mio* mio, Waker waker)
+{
+    PingPongFuture* self = (PingPongFuture*)base;
+    for (;;) {
+        Future* op = self->writing ? (Future*)&self->write : (Future*)&self->read;
+        FutureState state = op->progress(op, mio, waker);
+        if (state == FUTURE_PENDING)
+            return FUTURE_PENDING;
+        if (state == FUTURE_FAILURE)
+            fatal("Ping-pong %s failed\n", self->writing ? "write" : "read");
+        if (!self->writing && self->round_trips)
+            histogram_record(self->round_trips, monotonic_ns() - self->sent_ns);
+        if (--self->ops_left == 0)
+            return FUTURE_COMPLETED;
+        self->writing = !self->writing;
+        ping_pong_start_op(self);
+    }
+}
+
+static PingPongFuture ping_pong_future_create(int read_fd, int write_fd, bool client, size_t rounds)
+{
+    PingPongFuture ping_pong = {
+        .base = future_create(ping_pong_future_progress),
+        .read_fd = read_fd,
+        .write_fd = write_fd,
+        .writing = client,
+        .ops_left = 2 * rounds,
+        .byte = 42,
+        .round_trips = client ? histogram_create() : NULL,
+    };
+    ping_pong_start_op(&ping_pong);
+    return ping_pong;
+}
+
+static void bench_pipe_ping_pong(void)
+{
+    int there[2], back[2];
+    ASSERT_SYS_OK(pipe2(there, O_NONBLOCK));
+    ASSERT_SYS_OK(pipe2(back, O_NONBLOCK));
+    Executor* executor = executor_create(0);
+    PingPongFuture client = ping_pong_future_create(back[0], there[1], true, PING_PONG_ROUNDS);
+    PingPongFuture server = ping_pong_future_create(there[0], back[1], false, PING_PONG_ROUNDS);
+    executor_spawn(executor, (Future*)&client);
+    executor_spawn(executor, (Future*)&server);
+
+    uint64_t start = monotonic_ns();
+    executor_run(executor);
+    uint64_t ns = monotonic_ns() - start;
+    printf("{\"bench\": \"pipe_ping_pong\", \"ops\": %d, \"ns_per_op\": %.1f, \"ops_per_sec\": %.0f, "
+           "\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}\n",
+        PING_PONG_ROUNDS, (double)ns / PING_PONG_ROUNDS, PING_PONG_ROUNDS * 1e9 / ns,
+        (unsigned long long)histogram_percentile(client.round_trips, 50),
+        (unsigned long long)histogram_percentile(client.round_trips, 99),
+        (unsigned long long)histogram_max(client.round_trips));
+    fflush(stdout);
+
+    histogram_destroy(client.round_trips);
+    executor_destroy(executor);
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_SYS_OK(close(there[i]));
+        ASSERT_SYS_OK(close(back[i]));
+    }
+}
+
+// ========================= mio_poll =========================
+
+// Raises the soft limit of descriptors as far as possible and returns how many can be registered
+static size_t max_registered_fds(void)
+{
+    struct rlimit limit;
+    ASSERT_SYS_OK(getrlimit(RLIMIT_NOFILE, &limit));
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit); // keep the old limit on failure
+    ASSERT_SYS_OK(getrlimit(RLIMIT_NOFILE, &limit));
+    return limit.rlim_cur > FD_RESERVE ? limit.rlim_cur - FD_RESERVE : 1;
+}
+
+static FutureState idle_future_progress(Future* fut, Mio* mio, Waker waker)
+{
+    return FUTURE_PENDING;
+}
+
+static void bench_mio_poll_fds(size_t requested_fds, size_t max_fds)
+{
+    // Descriptor limits may not allow the requested number: report the actual one
+    size_t n_fds = requested_fds < max_fds ? requested_fds : max_fds;
+    int* fds = (int*)malloc(n_fds * sizeof(int));
+    if (!fds)
+        fatal("Allocation failed\n");
+    Executor* executor = executor_create(0);
+    Mio* mio = mio_create(executor);
+    if (!mio)
+        fatal("Mio construction failed\n");
+    Future idle = future_create(idle_future_progress);
+    Waker waker = { .executor = executor, .future = &idle };
+    char params[128];
+    snprintf(params, sizeof(params), ", \"requested_fds\": %zu, \"fds\": %zu", requested_fds, n_fds);
+
+    uint64_t start = monotonic_ns();
+    for (size_t i = 0; i < n_fds; ++i) {
+        fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fds[i] == -1)
+            syserr("eventfd failed\n");
+        ASSERT_SYS_OK(mio_register(mio, fds[i], EPOLLIN, waker));
+    }
+    report("mio_register", params, n_fds, monotonic_ns() - start);
+
+    start = monotonic_ns();
+    for (size_t i = 0; i < POLLS; ++i)
+        mio_poll_timeout(mio, 0);
+    report("mio_poll_idle", params, POLLS, monotonic_ns() - start);
+
+    // The descriptor stays readable (level-triggered), so every poll reports it
+    uint64_t one = 1;
+    ASSERT_SYS_OK(write(fds[n_fds / 2], &one, sizeof(one)));
+    start = monotonic_ns();
+    for (size_t i = 0; i < POLLS; ++i)
+        mio_poll_timeout(mio, 0);
+    report("mio_poll_one_ready", params, POLLS, monotonic_ns() - start);
+
+    for (size_t i = 0; i < n_fds; ++i) {
+        ASSERT_SYS_OK(mio_unregister(mio, fds[i]));
+        ASSERT_SYS_OK(close(fds[i]));
+    }
+    mio_destroy(mio);
+    executor_destroy(executor);
+    free(fds);
+}
+
+static void bench_mio_poll(void)
+{
+    size_t max_fds = max_registered_fds();
+    bench_mio_poll_fds(1, max_fds);
+    bench_mio_poll_fds(1000, max_fds);
+    bench_mio_poll_fds(100000, max_fds);
+}
+
+// ========================= simulated Mio =========================
+
+static void bench_sim_timers(void)
+{
+    // Timeouts of up to an hour: the virtual clock jumps from one deadline to the next
+    SleepFuture* sleeps = (SleepFuture*)malloc(SIM_TIMERS * sizeof(SleepFuture));
+    if (!sleeps)
+        fatal("Allocation failed\n");
+    Executor* executor = executor_create_simulated(0, SIM_SEED);
+    unsigned seed = SIM_SEED;
+    uint64_t virtual_start = executor_now_ns(executor);
+
+    uint64_t start = monotonic_ns();
+    for (size_t i = 0; i < SIM_TIMERS; ++i) {
+        sleeps[i] = sleep_future_create((uint64_t)rand_r(&seed) % 3600 * 1000000000);
+        executor_spawn(executor, (Future*)&sleeps[i]);
+    }
+    executor_run(executor);
+    uint64_t ns = monotonic_ns() - start;
+    char params[64];
+    snprintf(params, sizeof(params), ", \"virtual_s\": %.0f",
+        (executor_now_ns(executor) - virtual_start) / 1e9);
+    report("sim_timers", params, SIM_TIMERS, ns);
+
+    executor_destroy(executor);
+    free(sleeps);
+}
+
+static void bench_sim_pipe_ping_pong(void)
+{
+    Executor* executor = executor_create_simulated(0, SIM_SEED);
+    Mio* mio = executor_mio(executor);
+    int there[2], back[2];
+    ASSERT_SYS_OK(mio_pipe(mio, there));
+    ASSERT_SYS_OK(mio_pipe(mio, back));
+    PingPongFuture client = ping_pong_future_create(back[0], there[1], true, PING_PONG_ROUNDS);
+    PingPongFuture server = ping_pong_future_create(there[0], back[1], false, PING_PONG_ROUNDS);
+    executor_spawn(executor, (Future*)&client);
+    executor_spawn(executor, (Future*)&server);
+
+    uint64_t start = monotonic_ns();
+    executor_run(executor);
+    report("sim_pipe_ping_pong", "", PING_PONG_ROUNDS, monotonic_ns() - start);
+
+    histogram_destroy(client.round_trips);
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_SYS_OK(mio_close(mio, there[i]));
+        ASSERT_SYS_OK(mio_close(mio, back[i]));
+    }
+    executor_destroy(executor);
+}
+
+// ========================= main =========================
+
+typedef struct Benchmark {
+    const char* name;
+    void (*run)(void);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    { "spawn", bench_spawn },
+    { "spawn_owned", bench_spawn_owned },
+    { "wake", bench_wake },
+    { "coroutine_yield", bench_coroutine_yield },
+    { "then", bench_then },
+    { "join", bench_join },
+    { "select", bench_select },
+    { "chain_wake", bench_chain_wake },
+    { "pipe_ping_pong", bench_pipe_ping_pong },
+    { "mio_poll", bench_mio_poll },
+    { "sim_timers", bench_sim_timers },
+    { "sim_pipe_ping_pong", bench_sim_pipe_ping_pong },
+};
+
+int main(int argc, char* argv[])
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i)
+        if (strstr(benchmarks[i].name, filter))
+            benchmarks[i].run();
+    return 0;
+}
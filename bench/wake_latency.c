@@ -0,0 +1,123 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "histogram.h"
+#include "mio.h"
+
+// Measures the latency between a write to a pipe (in another thread) and the moment
+// a task blocked on reading from it gets progressed, with blocking and busy-polling Mio.
+
+#define DEFAULT_MESSAGES 20000
+#define DEFAULT_SPIN_US 50
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef struct LatencyReaderFuture {
+    Future base;
+    int fd;
+    size_t remaining; // number of timestamps yet to be read
+    Histogram* latencies;
+} LatencyReaderFuture;
+
+static FutureState latency_reader_progress(Future* base, Mio* mio, Waker waker)
+{
+    LatencyReaderFuture* self = (LatencyReaderFuture*)base;
+    while (self->remaining > 0) {
+        uint64_t sent_ns;
+        ssize_t bytes_read = read(self->fd, &sent_ns, sizeof(sent_ns));
+        if (bytes_read == sizeof(sent_ns)) {
+            histogram_record(self->latencies, monotonic_ns() - sent_ns);
+            --self->remaining;
+        } else if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            mio_register(mio, self->fd, EPOLLIN, waker);
+            return FUTURE_PENDING;
+        } else {
+            fatal("Unexpected read result %zd\n", bytes_read);
+        }
+    }
+    mio_unregister(mio, self->fd);
+    return FUTURE_COMPLETED;
+}
+
+typedef struct WriterArgs {
+    int fd;
+    size_t messages;
+} WriterArgs;
+
+static void* writer(void* arg)
+{
+    WriterArgs* args = arg;
+    unsigned seed = 42;
+    for (size_t i = 0; i < args->messages; ++i) {
+        // Space the messages out, so that the reader has to wait for (almost) every one of them.
+        struct timespec gap = { .tv_sec = 0, .tv_nsec = 20000 + rand_r(&seed) % 80000 };
+        nanosleep(&gap, NULL);
+        uint64_t now = monotonic_ns();
+        ASSERT_SYS_OK(write(args->fd, &now, sizeof(now)));
+    }
+    return NULL;
+}
+
+static void run(const char* mode, unsigned spin_us, size_t messages)
+{
+    int pipe_fds[2];
+    ASSERT_SYS_OK(pipe2(pipe_fds, O_NONBLOCK));
+
+    Executor* executor = executor_create(16);
+    executor_set_busy_poll(executor, spin_us);
+
+    LatencyReaderFuture reader = {
+        .base = future_create(latency_reader_progress),
+        .fd = pipe_fds[0],
+        .remaining = messages,
+        .latencies = histogram_create(),
+    };
+    executor_spawn(executor, (Future*)&reader);
+
+    WriterArgs args = { .fd = pipe_fds[1], .messages = messages };
+    pthread_t writer_thread;
+    ASSERT_ZERO(pthread_create(&writer_thread, NULL, writer, &args));
+    executor_run(executor);
+    ASSERT_ZERO(pthread_join(writer_thread, NULL));
+
+    printf("{\"bench\": \"wake_latency\", \"mode\": \"%s\", \"spin_us\": %u, \"samples\": %llu, "
+           "\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}\n",
+        mode, spin_us, (unsigned long long)histogram_count(reader.latencies),
+        (unsigned long long)histogram_percentile(reader.latencies, 50),
+        (unsigned long long)histogram_percentile(reader.latencies, 99),
+        (unsigned long long)histogram_max(reader.latencies));
+
+    histogram_destroy(reader.latencies);
+    executor_destroy(executor);
+    ASSERT_SYS_OK(close(pipe_fds[0]));
+    ASSERT_SYS_OK(close(pipe_fds[1]));
+}
+
+int main(int argc, char* argv[])
+{
+    size_t messages = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MESSAGES;
+    unsigned spin_us = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_SPIN_US;
+
+    run("blocking", 0, messages);
+    run("busy_poll", spin_us, messages);
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "future.h"
+#include "waker.h"
+
+/**
+ * Stackless (protothread-style) coroutines: macros that turn the body of a progress function
+ * written as straight-line code into a resumable state machine.
+ *
+ * The state is a single `int` lvalue (0 initially) that records where to resume; the futures
+ * being awaited are ordinary futures embedded in the coroutine's structure, so awaiting
+ * allocates nothing. Example:
+ *
+ *     typedef struct ReadAndWriteFuture {
+ *         Future base;
+ *         int state; // 0 at construction
+ *         PipeReadFuture read;
+ *         PipeWriteFuture write;
+ *     } ReadAndWriteFuture;
+ *
+ *     static FutureState read_and_write_progress(Future* base, Mio* mio, Waker waker)
+ *     {
+ *         ReadAndWriteFuture* self = (ReadAndWriteFuture*)base;
+ *         ASYNC_BEGIN(base, self->state);
+ *         AWAIT(&self->read);
+ *         self->write.base.arg = self->read.base.ok;
+ *         AWAIT(&self->write);
+ *         ASYNC_END(self->write.base.ok);
+ *     }
+ *
+ * BEWARE:
+ * - The progress function's parameters must be named `mio` and `waker`.
+ * - Local variables are not preserved across AWAIT and YIELD: keep the state in the structure.
+ * - AWAIT and YIELD cannot be used inside a `switch` statement of the body, and there can be
+ *   at most one of them per line (the line number identifies the resumption point).
+ */
+
+/** State of a coroutine that has returned (after ASYNC_END, ASYNC_RETURN or ASYNC_FAIL). */
+#define ASYNC_STATE_DONE (-1)
+
+/** Starts the body of a coroutine: `fut` is the coroutine's Future*, `state` its int lvalue. */
+#define ASYNC_BEGIN(fut, state)                                                                    \
+    Future* const async_self_ = (fut);                                                             \
+    int* const async_state_ = &(state);                                                            \
+    FutureState async_result_;                                                                     \
+    (void)async_result_;                                                                           \
+    switch (*async_state_) {                                                                       \
+    case 0:
+
+/**
+ * Progresses `awaited` (a pointer to a future) until it is no longer pending, storing the
+ * FutureState it has finished with in `result`; failures are left to the caller.
+ */
+#define AWAIT_RESULT(awaited, result)                                                              \
+    do {                                                                                           \
+        *async_state_ = __LINE__;                                                                  \
+        __attribute__((fallthrough));                                                              \
+    case __LINE__:                                                                                 \
+        async_result_ = ((Future*)(awaited))->progress((Future*)(awaited), mio, waker);            \
+        if (async_result_ == FUTURE_PENDING)                                                       \
+            return FUTURE_PENDING;                                                                 \
+        (result) = async_result_;                                                                  \
+    } while (0)
+
+/**
+ * Progresses `awaited` (a pointer to a future) until it completes.
+ * If it fails, so does the coroutine, with the errcode of `awaited`.
+ */
+#define AWAIT(awaited)                                                                             \
+    do {                                                                                           \
+        *async_state_ = __LINE__;                                                                  \
+        __attribute__((fallthrough));                                                              \
+    case __LINE__:                                                                                 \
+        async_result_ = ((Future*)(awaited))->progress((Future*)(awaited), mio, waker);            \
+        if (async_result_ == FUTURE_PENDING)                                                       \
+            return FUTURE_PENDING;                                                                 \
+        if (async_result_ == FUTURE_FAILURE)                                                       \
+            ASYNC_FAIL(((Future*)(awaited))->errcode);                                             \
+    } while (0)
+
+/** Lets other tasks run: the coroutine wakes itself up and resumes after YIELD. */
+#define YIELD()                                                                                    \
+    do {                                                                                           \
+        *async_state_ = __LINE__;                                                                  \
+        waker_wake(&waker);                                                                        \
+        return FUTURE_PENDING;                                                                     \
+    case __LINE__:;                                                                                \
+    } while (0)
+
+/** Completes the coroutine with the given result (`ok`). */
+#define ASYNC_RETURN(result)                                                                       \
+    do {                                                                                           \
+        *async_state_ = ASYNC_STATE_DONE;                                                          \
+        async_self_->ok = (void*)(result);                                                         \
+        return FUTURE_COMPLETED;                                                                   \
+    } while (0)
+
+/** Fails the coroutine with the given errcode. */
+#define ASYNC_FAIL(error)                                                                          \
+    do {                                                                                           \
+        *async_state_ = ASYNC_STATE_DONE;                                                          \
+        async_self_->errcode = (error);                                                            \
+        return FUTURE_FAILURE;                                                                     \
+    } while (0)
+
+/** Ends the body of a coroutine, which completes with the given result (`ok`). */
+#define ASYNC_END(result)                                                                          \
+    ASYNC_RETURN(result);                                                                          \
+    default:                                                                                       \
+        break;                                                                                     \
+    }                                                                                              \
+    return FUTURE_FAILURE; /* progressed after having returned */
+
+#endif // ASYNC_H
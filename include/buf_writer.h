@@ -0,0 +1,138 @@
+#ifndef BUF_WRITER_H
+#define BUF_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * A buffered writer coalescing the small writes of many tasks to a single descriptor.
+ *
+ * BufWriteFutures copy their bytes into the writer's buffer instead of calling write();
+ * a single flusher task (`buf_writer_flusher()`, spawned by the user) writes the buffer out
+ * with one write() per batch. The buffer is flushed when:
+ * - it holds at least `flush_threshold` bytes,
+ * - its oldest byte has waited `max_delay_ns` (an idle tick on a Mio timer, so a trickle of
+ *   writes is not delayed indefinitely),
+ * - a BufFlushFuture waits for the bytes written before it,
+ * - a writer waits for space (backpressure: writers that don't fit are parked, in order,
+ *   until the flusher makes room),
+ * - the writer is closed.
+ *
+ * The bytes of a write are never interleaved with other writes: writers are served in order,
+ * and a write that fits in the buffer is copied at once.
+ *
+ * A BufWriter is single-threaded: it must be used by tasks of a single executor.
+ * BEWARE: a pending write or flush future is linked into the writer, so it must not be
+ * abandoned before it finishes.
+ */
+
+/** The writer has been closed. */
+#define BUF_WRITER_ERR_CLOSED 1
+
+/** Default size of the buffer. */
+#define BUF_WRITER_DEFAULT_CAPACITY (64 * 1024)
+
+/** Link of a future waiting in a queue of a BufWriter. */
+typedef struct BufWaiter {
+    Waker waker;
+    struct BufWaiter* prev;
+    struct BufWaiter* next;
+    bool linked;
+} BufWaiter;
+
+typedef struct BufWaitQueue {
+    BufWaiter* head;
+    BufWaiter* tail;
+} BufWaitQueue;
+
+typedef struct BufWriter {
+    int fd; // non-blocking descriptor to write to
+    uint8_t* buffer;
+    size_t capacity;
+    size_t len; // number of buffered bytes (from the start of the buffer)
+    size_t flush_threshold;
+    uint64_t max_delay_ns; // 0 - no idle flushes
+    uint64_t first_buffered_ns; // when the oldest buffered byte was appended
+    uint64_t appended; // total number of bytes appended
+    uint64_t flushed; // total number of bytes written to fd
+    uint64_t flush_target; // flush waiters want `flushed` to reach this
+    bool closed;
+    int errcode; // of a failed write(), which fails every future of the writer
+    BufWaitQueue writers; // waiting for their turn or for space, in order
+    bool writer_blocked; // whether the first writer waits for space
+    BufWaitQueue flushes; // waiting for `flushed` to advance
+    // The flusher task
+    Future flusher;
+    Waker flusher_waker;
+    bool flusher_parked; // whether the flusher waits for `flusher_waker` to be woken
+    bool registered; // whether fd is registered in Mio
+    MioTimer timer; // idle tick
+    // Statistics
+    uint64_t writes; // number of completed BufWriteFutures
+    uint64_t syscalls; // number of write() calls of the flusher
+} BufWriter;
+
+/**
+ * Initializes a writer to `fd` (non-blocking) with a buffer of `capacity` bytes
+ * (0 - BUF_WRITER_DEFAULT_CAPACITY), flushed once it holds `flush_threshold` bytes
+ * (0 or more than the capacity - when full) or `max_delay_ns` after the oldest buffered byte
+ * has been appended (0 - never).
+ * Doesn't take ownership of `fd`.
+ */
+void buf_writer_init(BufWriter* writer, int fd, size_t capacity, size_t flush_threshold, uint64_t max_delay_ns);
+
+/** Frees the buffer of the writer; its flusher must have finished (or never been spawned). */
+void buf_writer_destroy(BufWriter* writer);
+
+/**
+ * Returns the flusher task of the writer, to be spawned once.
+ * It completes when the writer is closed and its buffer has been written, or fails with
+ * the errno of a failed write() (or PIPE_FUTURE_ERR_EOF if nothing can be written).
+ */
+Future* buf_writer_flusher(BufWriter* writer);
+
+/**
+ * Closes the writer: pending and later writes fail with BUF_WRITER_ERR_CLOSED, and
+ * the flusher completes once it has written what is already buffered.
+ */
+void buf_writer_close(BufWriter* writer);
+
+// ========================= BufWriteFuture =========================
+typedef struct BufWriteFuture {
+    Future base;
+    BufWriter* writer;
+    size_t n; // number of bytes to write, taken from `(const uint8_t*)base.arg`
+    size_t copied; // number of bytes copied into the buffer so far
+    BufWaiter waiter;
+} BufWriteFuture;
+
+/**
+ * Creates a future that appends `n` bytes (from `future->base.arg`, like PipeWriteFuture)
+ * to the writer's buffer. It completes, with `ok` set to the data, once they are buffered
+ * (see BufFlushFuture to wait until they are written), or waits while the buffer is full.
+ * Writes larger than the buffer are copied in parts, as the flusher makes room.
+ * Fails with BUF_WRITER_ERR_CLOSED or the errcode of a failed flush.
+ */
+BufWriteFuture buf_write_future_create(BufWriter* writer, size_t n);
+
+// ========================= BufFlushFuture =========================
+typedef struct BufFlushFuture {
+    Future base;
+    BufWriter* writer;
+    uint64_t target; // `appended` when first progressed
+    bool started;
+    BufWaiter waiter;
+} BufFlushFuture;
+
+/**
+ * Creates a future that completes once everything appended before it is first progressed
+ * has been written to the descriptor. Fails with the errcode of a failed flush.
+ */
+BufFlushFuture buf_flush_future_create(BufWriter* writer);
+
+#endif // BUF_WRITER_H
@@ -0,0 +1,131 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Channels fanning values out from one task to many: a watch channel (the latest value only)
+ * and a bounded broadcast channel (every message, to every subscriber).
+ *
+ * Receivers waiting for a value are linked into the channel's intrusive list of waiters,
+ * so a send wakes exactly the receivers that are waiting (each once) and costs nothing
+ * for the others; nobody polls. Values are `void*`, owned by the user.
+ *
+ * Channels are single-threaded: they must be used by tasks of a single executor.
+ * BEWARE: a receive future that is pending is linked into the channel, so it must not be
+ * abandoned before it finishes or the channel is closed.
+ */
+
+/** The channel has been closed (and, for a broadcast channel, every message has been received). */
+#define CHANNEL_ERR_CLOSED 1
+/** The broadcast subscriber has lagged behind: some messages have been overwritten (see `gap`). */
+#define CHANNEL_ERR_LAGGED 2
+
+/** Link of a receive future in the list of waiters of a channel. */
+typedef struct ChannelWaiter {
+    Waker waker;
+    struct ChannelWaiter* prev;
+    struct ChannelWaiter* next;
+    bool linked;
+} ChannelWaiter;
+
+// ========================= watch =========================
+
+typedef struct WatchChannel {
+    void* value; // the latest value
+    uint64_t version; // number of values sent
+    bool closed;
+    ChannelWaiter* waiters;
+} WatchChannel;
+
+/** Initializes a watch channel holding `initial`. */
+void watch_channel_init(WatchChannel* channel, void* initial);
+
+/** Replaces the value and wakes the receivers waiting for a change. */
+void watch_send(WatchChannel* channel, void* value);
+
+/** Closes the channel: the receivers that have seen the latest value fail with CHANNEL_ERR_CLOSED. */
+void watch_close(WatchChannel* channel);
+
+/** A receiver's view of a watch channel: which version it has seen. */
+typedef struct WatchReceiver {
+    WatchChannel* channel;
+    uint64_t seen_version;
+} WatchReceiver;
+
+/** Creates a receiver that has seen the current value. */
+WatchReceiver watch_subscribe(WatchChannel* channel);
+
+typedef struct WatchChangedFuture {
+    Future base;
+    WatchReceiver* receiver;
+    ChannelWaiter waiter;
+} WatchChangedFuture;
+
+/**
+ * Creates a future that completes, with `ok` set to the latest value, as soon as the channel
+ * holds a value the receiver hasn't seen. Values sent in the meantime are skipped: a slow
+ * receiver only sees the latest one.
+ * Fails with CHANNEL_ERR_CLOSED if the channel is closed and the receiver has seen the latest value.
+ */
+WatchChangedFuture watch_changed(WatchReceiver* receiver);
+
+// ========================= broadcast =========================
+
+typedef struct BroadcastChannel {
+    void** slots; // ring buffer of the last `capacity` messages
+    size_t capacity;
+    uint64_t sent; // number of messages sent; message i is in slots[i % capacity]
+    bool closed;
+    ChannelWaiter* waiters;
+} BroadcastChannel;
+
+/** Initializes a broadcast channel keeping the last `capacity` (> 0) messages. */
+void broadcast_channel_init(BroadcastChannel* channel, size_t capacity);
+
+/** Frees the resources of the channel. */
+void broadcast_channel_destroy(BroadcastChannel* channel);
+
+/**
+ * Sends a message to every subscriber and wakes the ones that are waiting.
+ * Never blocks: when the buffer is full, the oldest message is overwritten, and subscribers
+ * that haven't received it yet are told they have lagged.
+ */
+void broadcast_send(BroadcastChannel* channel, void* message);
+
+/** Closes the channel: subscribers fail with CHANNEL_ERR_CLOSED after receiving every message. */
+void broadcast_close(BroadcastChannel* channel);
+
+typedef struct BroadcastReceiver {
+    BroadcastChannel* channel;
+    uint64_t next; // number of the next message to receive
+    uint64_t lagged; // total number of messages missed by lagging (so far)
+} BroadcastReceiver;
+
+/** Creates a subscriber receiving the messages sent from now on. */
+BroadcastReceiver broadcast_subscribe(BroadcastChannel* channel);
+
+typedef struct BroadcastRecvFuture {
+    Future base;
+    BroadcastReceiver* receiver;
+    ChannelWaiter waiter;
+    uint64_t gap; // if failed with CHANNEL_ERR_LAGGED: number of messages missed
+} BroadcastRecvFuture;
+
+/**
+ * Creates a future that receives the subscriber's next message (as `ok`).
+ *
+ * If messages the subscriber hasn't received have been overwritten, it fails with
+ * CHANNEL_ERR_LAGGED instead, with `gap` set to their number; the subscriber then
+ * continues from the oldest message still buffered.
+ * Fails with CHANNEL_ERR_CLOSED if the channel is closed and every message has been received.
+ */
+BroadcastRecvFuture broadcast_recv(BroadcastReceiver* receiver);
+
+#endif // CHANNEL_H
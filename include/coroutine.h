@@ -0,0 +1,91 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Stackful coroutine tasks, for blocking-style code.
+ *
+ * A CoroutineFuture runs a function on its own stack. The function may await other futures
+ * (`coroutine_await()`) as if they were blocking calls: whenever the awaited future is pending,
+ * the coroutine switches back to the executor, and it resumes where it left off when it is
+ * progressed again. Switching is done by hand-written assembly (x86-64 and AArch64), which only
+ * saves the callee-saved registers and floating-point control state (rounding mode, exception
+ * masks), and doesn't touch the signal mask.
+ *
+ * Stacks are mmap'ed with a guard page below them (so an overflow crashes instead of corrupting
+ * memory) and are cached per thread when their coroutines complete, to be reused by the next ones;
+ * a thread's cache is unmapped when the thread exits.
+ * A coroutine that never completes (e.g. cancelled by `executor_shutdown()`, or still suspended
+ * at `executor_destroy()`) keeps its stack until `coroutine_future_release()` is called.
+ */
+typedef struct CoroutineFuture CoroutineFuture;
+
+/**
+ * The function run by a coroutine, with the coroutine's `arg`; its result becomes the `ok` of
+ * the coroutine. To make the coroutine fail, set `self->base.errcode` before returning.
+ */
+typedef void* (*CoroutineFn)(CoroutineFuture* self, void* arg);
+
+/** Default size of a coroutine's stack (without the guard page). */
+#define COROUTINE_DEFAULT_STACK_SIZE (64 * 1024)
+
+/** Maximum number of stacks cached per thread. */
+#define COROUTINE_STACK_POOL_CAPACITY 64
+
+struct CoroutineFuture {
+    Future base;
+    CoroutineFn func;
+    size_t stack_size; // usable size of the stack (a multiple of the page size)
+    void* stack; // lowest usable address of the stack (NULL until started and after completion)
+    void* sp; // saved stack pointer of the coroutine, while it is suspended
+    void* caller_sp; // saved stack pointer of the executor, while the coroutine runs
+    Mio* mio; // of the current progress call
+    Waker waker; // of the current progress call
+    bool finished; // whether `func` has returned
+    // AddressSanitizer's bookkeeping of the stack switches (unused without ASAN)
+    void* fake_stack;
+    void* caller_fake_stack;
+    const void* caller_stack;
+    size_t caller_stack_size;
+};
+
+/**
+ * Creates a coroutine that will run `func` on a stack of `stack_size` bytes
+ * (rounded up to whole pages; 0 - COROUTINE_DEFAULT_STACK_SIZE).
+ * The stack is only allocated when the coroutine is first progressed.
+ */
+CoroutineFuture coroutine_future_create(CoroutineFn func, size_t stack_size);
+
+/**
+ * Awaits a future from inside the coroutine: progresses `fut` until it is no longer pending,
+ * suspending the coroutine in the meantime.
+ *
+ * @return FUTURE_COMPLETED or FUTURE_FAILURE, as returned by `fut`.
+ */
+FutureState coroutine_await(CoroutineFuture* self, Future* fut);
+
+/**
+ * Releases the stack of a suspended coroutine that will never be progressed again (e.g. from
+ * the `on_cancel` callback of `executor_shutdown()`) to the calling thread's pool.
+ * The coroutine's frames are abandoned: nothing on its stack runs anymore, so resources held
+ * by `func` are not freed. Does nothing if the coroutine has completed or has never been
+ * progressed.
+ */
+void coroutine_future_release(CoroutineFuture* self);
+
+/** Lets other tasks run: suspends the coroutine, which is woken up right away. */
+void coroutine_yield(CoroutineFuture* self);
+
+/** Returns the number of stacks cached by the calling thread. */
+size_t coroutine_stack_pool_cached(void);
+
+/** Unmaps the stacks cached by the calling thread. */
+void coroutine_stack_pool_clear(void);
+
+#endif // COROUTINE_H
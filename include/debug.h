@@ -1,27 +1,10 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
-// Comment this to disable debug prints
-#define DEBUG_PRINTS
+#include "log.h"
 
-#ifdef DEBUG_PRINTS
-
-#include <stdarg.h>
-#include <stdio.h>
-
-static inline void debug(const char* fmt, ...)
-{
-    va_list fmt_args;
-    va_start(fmt_args, fmt);
-    vfprintf(stderr, fmt, fmt_args);
-    va_end(fmt_args);
-}
-
-#else // DEBUG_PRINTS
-
-#define perror(ARGS...)
-#define debug(ARGS...)
-
-#endif // DEBUG_PRINTS
+// Debug prints are debug-level log messages: they are compiled in only when
+// LOG_COMPILE_LEVEL is LOG_LEVEL_DEBUG or lower (see log.h).
+#define debug(...) LOG_DEBUG(__VA_ARGS__)
 
 #endif // DEBUG_H
@@ -1,8 +1,12 @@
 #ifndef EXECUTOR_H
 #define EXECUTOR_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
+#include "future.h"
 #include "mio.h"
 
 typedef struct Future Future;
@@ -16,9 +20,54 @@ typedef struct Future Future;
 
 typedef struct Executor Executor;
 
-/** Creates a new executor (with a specified queue size). */
+/** Number of buckets of the wake-to-run latency histogram. */
+#define EXECUTOR_LATENCY_BUCKETS 32
+
+/**
+ * Counters of the work done by an executor (see `executor_stats()`).
+ *
+ * They are kept by the executor's thread without any synchronization, so they are cheap enough
+ * to be always enabled.
+ */
+typedef struct ExecutorStats {
+    uint64_t spawned; // Number of spawned tasks.
+    uint64_t completed; // Number of tasks that have completed (successfully or not).
+    uint64_t cancelled; // Number of tasks cancelled by executor_shutdown() (not counted as completed).
+    uint64_t wakes; // Number of waker_wake() calls (including the ones that had no effect).
+    uint64_t progress_calls; // Number of progress() calls.
+    uint64_t progress_ns; // Total time spent in progress() calls.
+    uint64_t queue_high_water; // Largest number of tasks waiting in the queue.
+    /**
+     * Histogram of the time from queueing a task (measured at the start of the progress() call
+     * that woke it, if any) to progressing it: bucket i counts waits of [2^i, 2^(i+1))
+     * nanoseconds (bucket 0 also counts waits shorter than 1ns, the last one all longer waits).
+     */
+    uint64_t wake_to_run_ns[EXECUTOR_LATENCY_BUCKETS];
+    uint64_t stalls; // Number of progress() calls reported by the stall detector.
+    uint64_t max_stall_ns; // Longest progress() call seen by the stall detector (so far).
+    MioStats mio; // Counters of the executor's Mio.
+} ExecutorStats;
+
+/**
+ * Creates a new executor.
+ *
+ * The queue of the executor is unbounded; `max_queue_size` is only a soft limit of the number
+ * of live (spawned but not yet completed) tasks, enforced by `executor_try_spawn()`
+ * (0 - no limit).
+ */
 Executor* executor_create(size_t max_queue_size);
 
+/**
+ * Creates an executor on a simulated Mio (see `mio_create_simulated()`): its tasks use
+ * in-memory pipes (`mio_pipe()` of `executor_mio()`) and timers on a virtual clock, and they
+ * are run in an order that only depends on `seed`. The executor doesn't poll on a timer
+ * (see `executor_set_poll_interval()`), so that its schedules are reproducible.
+ */
+Executor* executor_create_simulated(size_t max_queue_size, uint64_t seed);
+
+/** Returns the Mio of the executor (e.g. to create pipes before spawning their tasks). */
+Mio* executor_mio(Executor* executor);
+
 /**
  * Submits a future to be managed by the executor.
  *
@@ -26,6 +75,14 @@ Executor* executor_create(size_t max_queue_size);
  */
 void executor_spawn(Executor* executor, Future* fut);
 
+/**
+ * Like `executor_spawn()`, but reports backpressure instead of accepting any number of tasks.
+ *
+ * @return 0 on success, -1 with errno set to EAGAIN if the executor already has
+ *         `max_queue_size` live tasks, or to ESHUTDOWN if it is being (or has been) shut down.
+ */
+int executor_try_spawn(Executor* executor, Future* fut);
+
 /**
  * Runs the executor, driving futures to completion.
  *
@@ -34,6 +91,182 @@ void executor_spawn(Executor* executor, Future* fut);
  */
 void executor_run(Executor* executor);
 
+/*
+ * Embedding the executor in another event loop: instead of blocking in `executor_run()`,
+ * the host drives the executor with `executor_tick()` or `executor_run_until_idle()`, waiting
+ * for the executor's I/O in its own loop on `executor_poll_fd()`. None of these may be called
+ * from inside a progress() call.
+ */
+
+/**
+ * Progresses ready tasks, including the ones woken by already pending I/O events,
+ * until no task is ready; never waits for I/O.
+ * Tasks that keep waking themselves up keep it running (see `executor_tick()` for a bounded step).
+ *
+ * @return number of progress() calls made.
+ */
+size_t executor_run_until_idle(Executor* executor);
+
+/**
+ * A single bounded step of the executor: if no task is ready, waits at most `timeout_ms`
+ * milliseconds for I/O events (0 - doesn't wait, -1 - waits indefinitely; it returns right away
+ * when no descriptor is registered), then progresses once each task that is ready at that point.
+ * Tasks woken during the step are left for the next one (see `executor_is_idle()`).
+ *
+ * @return number of progress() calls made, -1 if waiting for I/O failed (with errno set,
+ *         e.g. EINTR).
+ */
+int executor_tick(Executor* executor, int timeout_ms);
+
+/**
+ * Spawns `fut` and runs the executor until `fut` finishes (other tasks may still be pending
+ * afterwards).
+ *
+ * @return FUTURE_COMPLETED or FUTURE_FAILURE, as returned by `fut`.
+ */
+FutureState executor_block_on(Executor* executor, Future* fut);
+
+/** Called by `executor_shutdown()` for every task it cancels, with the `arg` given to it. */
+typedef void (*ExecutorCancelFn)(Future* fut, void* arg);
+
+/**
+ * Shuts the executor down gracefully, within `timeout_ms` milliseconds (ULONG_MAX - no deadline).
+ *
+ * From now on, `executor_try_spawn()` refuses new tasks (with ESHUTDOWN); `executor_spawn()`
+ * keeps working, as tasks being drained may need subtasks, so code accepting new work should
+ * use the former. The live tasks are first run as usual (draining), until they all finish or
+ * the deadline passes; then the remaining ones are cancelled: they are never progressed again,
+ * their `is_active` flag is unset and their errcode set to ECANCELED, and `on_cancel` (if not
+ * NULL) is called for each of them, e.g. to release their resources (for an owned task, it gets
+ * the owned future, which is freed right afterwards). Finally, all descriptors registered
+ * in the executor's Mio are unregistered and all its timers disarmed.
+ *
+ * Cancelled futures are only abandoned, not progressed: futures they were awaiting in place
+ * (e.g. combinators' subtasks) are cancelled with them and must not be used anymore.
+ *
+ * @return number of cancelled tasks.
+ */
+size_t executor_shutdown(Executor* executor, unsigned long timeout_ms, ExecutorCancelFn on_cancel, void* arg);
+
+/** Tells whether no task is ready to be progressed (they are all waiting or finished). */
+bool executor_is_idle(Executor const* executor);
+
+/** Returns the number of live (spawned but not yet completed) tasks. */
+size_t executor_live_tasks(Executor const* executor);
+
+/** Returns the current time (in nanoseconds) of the clock of the executor's timers (see `mio_now_ns()`). */
+uint64_t executor_now_ns(Executor const* executor);
+
+/**
+ * Returns the descriptor of the executor's Mio (see `mio_fd()`): it becomes readable when
+ * an I/O event may have woken a task, i.e. when `executor_tick()` should be called.
+ * Timers don't make it readable: the host should wait at most `executor_next_timeout_ms()`.
+ */
+int executor_poll_fd(Executor const* executor);
+
+/**
+ * Returns how long (in milliseconds) the executor may wait for I/O before one of its timers
+ * expires: 0 if one has already expired, -1 if none is armed (see `mio_next_timeout_ms()`).
+ */
+int executor_next_timeout_ms(Executor const* executor);
+
+/**
+ * Default number of progress() calls after which the executor checks for ready I/O events
+ * (without blocking), even if there still are tasks that can progress.
+ */
+#define EXECUTOR_DEFAULT_POLL_INTERVAL 61
+
+/** Default time (in microseconds) after which the executor checks for ready I/O events. */
+#define EXECUTOR_DEFAULT_POLL_INTERVAL_US 1000
+
+/** Default number of budget units (see `executor_budget_consume()`) a task gets per progress() call. */
+#define EXECUTOR_DEFAULT_TASK_BUDGET 128
+
+/**
+ * Sets how often the executor interleaves ready tasks with I/O polling.
+ *
+ * Newly-ready I/O events are collected (without blocking) after `progress_calls` calls to
+ * future.progress() or after `interval_us` microseconds, whichever comes first, so that tasks
+ * which keep waking themselves up cannot starve tasks waiting for I/O.
+ * Passing 0 disables the respective limit.
+ */
+void executor_set_poll_interval(Executor* executor, size_t progress_calls, unsigned long interval_us);
+
+/**
+ * Sets the cooperative budget of a task, i.e. how many budget units a single progress() call
+ * may consume (see `executor_budget_consume()`). 0 means an unlimited budget.
+ */
+void executor_set_task_budget(Executor* executor, unsigned budget);
+
+/**
+ * Consumes a unit of the cooperative budget of the task that is currently being progressed.
+ *
+ * Futures that can make progress for an unbounded amount of time (e.g. reading from a pipe that
+ * keeps being refilled) should call this once per unit of work. When false is returned,
+ * the budget is exhausted and the future is expected to yield: wake its waker and return
+ * FUTURE_PENDING.
+ */
+bool executor_budget_consume(Executor* executor);
+
+/**
+ * Maximum number of consecutive tasks progressed from the LIFO slot (see `executor_set_lifo_slot()`)
+ * before the tasks waiting in the queue get their turn.
+ */
+#define EXECUTOR_MAX_LIFO_STREAK 3
+
+/**
+ * Enables or disables (the default) the LIFO slot of the executor.
+ *
+ * When enabled, a task woken by another task (e.g. a JoinFuture woken by its subtask or
+ * the receiver of a message woken by its sender) is progressed right after the current task,
+ * instead of waiting at the end of the queue, while the data it shares with the waking task
+ * is still in the caches. To preserve fairness, at most `EXECUTOR_MAX_LIFO_STREAK` tasks in a row
+ * are taken from the slot. Tasks waking themselves up and tasks woken by I/O events always
+ * go to the end of the queue.
+ */
+void executor_set_lifo_slot(Executor* executor, bool enabled);
+
+/** Sets the busy-polling phase of the executor's Mio (see `mio_set_busy_poll()`). */
+void executor_set_busy_poll(Executor* executor, unsigned spin_us);
+
+/**
+ * Starts the stall detector of the executor, or stops it if `threshold_us` is 0 (the default).
+ *
+ * A single progress() call that blocks freezes every task of the executor. The stall detector
+ * is a watchdog thread that checks the executor a few times per threshold and reports every
+ * progress() call that has been running for longer than `threshold_us` microseconds, while it is
+ * still running: a warning with the task's address and its progress function is logged
+ * (see log.h) and the call is counted in `ExecutorStats.stalls`.
+ * The function is symbolized with dladdr(), so it is named only if it is in the dynamic symbol
+ * table (e.g. link with -rdynamic); otherwise its module and offset are given.
+ *
+ * Must not be called during `executor_run()`.
+ */
+void executor_set_stall_threshold(Executor* executor, unsigned long threshold_us);
+
+/** Copies the counters of the executor to `stats`. */
+void executor_stats(Executor const* executor, ExecutorStats* stats);
+
+/**
+ * Number of events the tracer keeps (the most recent ones); may be overridden at compile time
+ * with a power of 2.
+ */
+#ifndef EXECUTOR_TRACE_CAPACITY
+#define EXECUTOR_TRACE_CAPACITY (1 << 16)
+#endif
+
+/**
+ * Writes the events recorded by the executor's tracer (spawns, wakes, progress calls, polls and
+ * fd (un)registrations of the last `EXECUTOR_TRACE_CAPACITY` events) to `out`
+ * as Chrome/Perfetto trace JSON, with each task on its own track.
+ *
+ * The tracer is only compiled in when EXECUTOR_TRACE is defined (configure with
+ * -DEXECUTOR_TRACE=ON); otherwise tracing costs nothing and the written trace is empty.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int executor_trace_dump(Executor* executor, FILE* out);
+
 /** Destroys the executor and frees its resources. */
 void executor_destroy(Executor* executor);
 
@@ -0,0 +1,65 @@
+#ifndef FD_PASSING_H
+#define FD_PASSING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Passing file descriptors between processes over Unix-domain sockets (SCM_RIGHTS).
+ *
+ * A SendFdsFuture sends a batch of descriptors in a single message, and a RecvFdsFuture
+ * receives one message's batch. Both wait for the (non-blocking) socket in Mio, so e.g.
+ * an acceptor can hand connections over to worker processes from a task, without a blocking
+ * handoff thread. Every message also carries one byte of data (stream sockets can't carry
+ * ancillary data alone), which the futures send and consume themselves.
+ *
+ * Received descriptors are close-on-exec and non-blocking, ready to be registered in Mio.
+ * Sent descriptors stay open in the sender: close them once they have been sent.
+ */
+
+/** Maximum number of descriptors in a single message (the kernel's SCM_MAX_FD). */
+#define FD_PASSING_MAX_FDS 253
+
+/** The message carried more descriptors than the receiver had room for (the excess is closed). */
+#define FD_PASSING_ERR_TRUNCATED 1
+
+// ========================= SendFdsFuture =========================
+typedef struct SendFdsFuture {
+    Future base;
+    int socket; // non-blocking Unix-domain socket
+    const int* fds; // descriptors to send
+    size_t n_fds;
+    bool registered; // whether socket is registered in Mio
+} SendFdsFuture;
+
+/**
+ * Creates a future that sends `n_fds` (1 to FD_PASSING_MAX_FDS) descriptors in one message.
+ * Completes with `ok` set to `fds`, or fails with errno (e.g. EPIPE if the peer is gone;
+ * no SIGPIPE is raised).
+ */
+SendFdsFuture send_fds_future_create(int socket, const int* fds, size_t n_fds);
+
+// ========================= RecvFdsFuture =========================
+typedef struct RecvFdsFuture {
+    Future base;
+    int socket; // non-blocking Unix-domain socket
+    int* fds; // buffer for the received descriptors
+    size_t max_fds; // size of the buffer (at most FD_PASSING_MAX_FDS)
+    size_t n_fds; // number of descriptors received
+    bool registered; // whether socket is registered in Mio
+} RecvFdsFuture;
+
+/**
+ * Creates a future that receives the descriptors of one message into `fds` (of `max_fds`
+ * entries), setting `n_fds`. Completes with `ok` set to `fds`; fails with PIPE_FUTURE_ERR_EOF
+ * if the peer has closed the connection, with FD_PASSING_ERR_TRUNCATED if the message
+ * carried more than `max_fds` descriptors (`n_fds` of them have been received anyway),
+ * or with errno.
+ */
+RecvFdsFuture recv_fds_future_create(int socket, int* fds, size_t max_fds);
+
+#endif // FD_PASSING_H
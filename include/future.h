@@ -36,6 +36,16 @@ typedef enum FutureState {
  */
 typedef FutureState (*ProgressFn)(Future*, Mio*, Waker);
 
+/**
+ * Optional per-task counters, updated by the executor when the task's `Future.stats` is set.
+ */
+typedef struct TaskStats {
+    uint64_t progress_calls; // Number of progress() calls of the task.
+    uint64_t progress_ns; // Total time spent in these calls.
+    uint64_t max_progress_ns; // Duration of the longest call.
+    uint64_t wake_to_run_ns; // Total time the task spent in the queue after being woken.
+} TaskStats;
+
 /** The no-error code. */
 #define FUTURE_SUCCESS 0
 
@@ -66,6 +76,31 @@ struct Future {
      */
     bool is_active;
 
+    /**
+     * Executor-private bookkeeping of the intrusive run queue: whether the future is waiting
+     * in the queue to be progressed, and the next future in the queue.
+     *
+     * Embedding the link in the future lets the queue grow with the number of tasks without
+     * any allocation on wake. As a future can be queued at most once, waking a future that is
+     * already queued has no effect.
+     */
+    bool is_queued;
+    struct Future* next_queued;
+    uint64_t woken_ns; // Executor-private: when the future was last queued (for the statistics).
+
+    /**
+     * Executor-private links of the list of live (spawned but not yet finished) tasks,
+     * which lets `executor_shutdown()` find and cancel the stragglers.
+     */
+    struct Future* prev_live;
+    struct Future* next_live;
+
+    /**
+     * Optional per-task counters (NULL by default). May be set before the future is spawned;
+     * the executor then keeps them up to date until the future completes.
+     */
+    TaskStats* stats;
+
     void* arg; // An optional input argument of the future.
     void* ok; // An optional result; only meaningful if `progress` returned FUTURE_COMPLETED.
     int errcode; // Only meaningful if `progress` returned FUTURE_FAILURE or FUTURE_COMPLETED.
@@ -76,6 +111,12 @@ static inline Future future_create(ProgressFn progress_fn)
     return (Future) {
         .progress = progress_fn,
         .is_active = false,
+        .is_queued = false,
+        .next_queued = NULL,
+        .woken_ns = 0,
+        .prev_live = NULL,
+        .next_live = NULL,
+        .stats = NULL,
         .errcode = FUTURE_SUCCESS,
         .arg = NULL,
         .ok = NULL,
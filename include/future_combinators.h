@@ -2,6 +2,7 @@
 #define FUTURE_COMBINATORS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "future.h"
 
@@ -84,4 +85,146 @@ typedef struct SelectFuture {
 /** Creates a SelectFuture that executes two futures until one of them completes successfully. */
 SelectFuture future_select(Future* fut1, Future* fut2);
 
+/** Error code of a PipelineFuture whose stage with the given index has failed. */
+#define PIPELINE_FUTURE_ERR_STAGE_FAILED(stage) ((int)(stage) + 1)
+
+/**
+ * A combinator that chains any number of futures sequentially, like nested ThenFutures.
+ *
+ * Stage i + 1 is started when stage i completes, with stages[i + 1]->arg := stages[i]->ok;
+ * the first stage gets the pipeline's own arg, if one is set (e.g. by an enclosing ThenFuture).
+ * The PipelineFuture is COMPLETED (with the result of the last stage) when the last stage is
+ * COMPLETED. If a stage returns FAILURE, so does the PipelineFuture, with the errcode
+ * PIPELINE_FUTURE_ERR_STAGE_FAILED(index of the stage).
+ *
+ * Unlike a nest of ThenFutures, which re-enters every level on each wakeup before reaching
+ * the active future, the pipeline keeps the index of the current stage and calls it directly,
+ * so a wakeup costs the same regardless of the length of the chain.
+ */
+typedef struct PipelineFuture {
+    Future base; // Base future structure
+    Future** stages; // Futures to execute one after another (owned by the caller)
+    size_t n_stages;
+    size_t current; // Index of the stage being executed
+} PipelineFuture;
+
+/** Creates a PipelineFuture that executes `n_stages` futures sequentially. */
+PipelineFuture future_pipeline(Future** stages, size_t n_stages);
+
+/*
+ * Specialized pipelines, for stages whose types and progress functions are known at compile time:
+ *
+ *     FUTURE_PIPELINE_DEFINE3(ReadCapitalizeWrite, read_capitalize_write,
+ *         PipeReadFuture, pipe_read_future_progress,
+ *         ApplyFuture, apply_future_progress,
+ *         PipeWriteFuture, pipe_write_future_progress)
+ *
+ * defines the type `ReadCapitalizeWrite`, which embeds the three stages, and
+ * `ReadCapitalizeWrite read_capitalize_write_create(PipeReadFuture, ApplyFuture, PipeWriteFuture)`.
+ * It behaves like a PipelineFuture, but its progress function jumps straight to the current stage
+ * with a switch and calls the stages' progress functions directly, so they can be inlined
+ * (if their definitions are visible). The stage types must begin with their `Future base`.
+ */
+
+// A stage of a specialized pipeline that passes its result on to the next one
+#define FUTURE_PIPELINE_STAGE_(index, stage, stage_progress, next_stage)                           \
+    case index: {                                                                                  \
+        FutureState state = stage_progress((Future*)&self->stage, mio, waker);                     \
+        if (state == FUTURE_PENDING)                                                               \
+            return FUTURE_PENDING;                                                                 \
+        if (state == FUTURE_FAILURE) {                                                             \
+            self->base.errcode = PIPELINE_FUTURE_ERR_STAGE_FAILED(index);                          \
+            return FUTURE_FAILURE;                                                                 \
+        }                                                                                          \
+        ((Future*)&self->next_stage)->arg = ((Future*)&self->stage)->ok;                           \
+        self->current = index + 1;                                                                 \
+    }                                                                                              \
+    __attribute__((fallthrough));
+
+// The last stage of a specialized pipeline
+#define FUTURE_PIPELINE_LAST_STAGE_(index, stage, stage_progress)                                  \
+    case index: {                                                                                  \
+        FutureState state = stage_progress((Future*)&self->stage, mio, waker);                     \
+        if (state == FUTURE_PENDING)                                                               \
+            return FUTURE_PENDING;                                                                 \
+        if (state == FUTURE_FAILURE) {                                                             \
+            self->base.errcode = PIPELINE_FUTURE_ERR_STAGE_FAILED(index);                          \
+            return FUTURE_FAILURE;                                                                 \
+        }                                                                                          \
+        self->base.ok = ((Future*)&self->stage)->ok;                                               \
+        return FUTURE_COMPLETED;                                                                   \
+    }
+
+// The beginning of the progress function of a specialized pipeline
+#define FUTURE_PIPELINE_PROGRESS_BEGIN_(Type, prefix, first_stage)                                 \
+    static inline FutureState prefix##_progress(Future* base, Mio* mio, Waker waker)               \
+    {                                                                                              \
+        Type* self = (Type*)base;                                                                  \
+        if (self->current == 0 && self->base.arg)                                                  \
+            ((Future*)&self->first_stage)->arg = self->base.arg;                                   \
+        switch (self->current) {
+
+#define FUTURE_PIPELINE_PROGRESS_END_                                                              \
+        }                                                                                          \
+        return FUTURE_FAILURE; /* unreachable */                                                   \
+    }
+
+#define FUTURE_PIPELINE_DEFINE2(Type, prefix, T0, progress0, T1, progress1)                        \
+    typedef struct Type {                                                                          \
+        Future base;                                                                               \
+        size_t current;                                                                            \
+        T0 stage0;                                                                                 \
+        T1 stage1;                                                                                 \
+    } Type;                                                                                        \
+    FUTURE_PIPELINE_PROGRESS_BEGIN_(Type, prefix, stage0)                                          \
+    FUTURE_PIPELINE_STAGE_(0, stage0, progress0, stage1)                                           \
+    FUTURE_PIPELINE_LAST_STAGE_(1, stage1, progress1)                                              \
+    FUTURE_PIPELINE_PROGRESS_END_                                                                  \
+    static inline Type prefix##_create(T0 stage0, T1 stage1)                                       \
+    {                                                                                              \
+        return (Type) { .base = future_create(prefix##_progress), .current = 0,                    \
+            .stage0 = stage0, .stage1 = stage1 };                                                  \
+    }
+
+#define FUTURE_PIPELINE_DEFINE3(Type, prefix, T0, progress0, T1, progress1, T2, progress2)         \
+    typedef struct Type {                                                                          \
+        Future base;                                                                               \
+        size_t current;                                                                            \
+        T0 stage0;                                                                                 \
+        T1 stage1;                                                                                 \
+        T2 stage2;                                                                                 \
+    } Type;                                                                                        \
+    FUTURE_PIPELINE_PROGRESS_BEGIN_(Type, prefix, stage0)                                          \
+    FUTURE_PIPELINE_STAGE_(0, stage0, progress0, stage1)                                           \
+    FUTURE_PIPELINE_STAGE_(1, stage1, progress1, stage2)                                           \
+    FUTURE_PIPELINE_LAST_STAGE_(2, stage2, progress2)                                              \
+    FUTURE_PIPELINE_PROGRESS_END_                                                                  \
+    static inline Type prefix##_create(T0 stage0, T1 stage1, T2 stage2)                            \
+    {                                                                                              \
+        return (Type) { .base = future_create(prefix##_progress), .current = 0,                    \
+            .stage0 = stage0, .stage1 = stage1, .stage2 = stage2 };                                \
+    }
+
+#define FUTURE_PIPELINE_DEFINE4(                                                                   \
+    Type, prefix, T0, progress0, T1, progress1, T2, progress2, T3, progress3)                      \
+    typedef struct Type {                                                                          \
+        Future base;                                                                               \
+        size_t current;                                                                            \
+        T0 stage0;                                                                                 \
+        T1 stage1;                                                                                 \
+        T2 stage2;                                                                                 \
+        T3 stage3;                                                                                 \
+    } Type;                                                                                        \
+    FUTURE_PIPELINE_PROGRESS_BEGIN_(Type, prefix, stage0)                                          \
+    FUTURE_PIPELINE_STAGE_(0, stage0, progress0, stage1)                                           \
+    FUTURE_PIPELINE_STAGE_(1, stage1, progress1, stage2)                                           \
+    FUTURE_PIPELINE_STAGE_(2, stage2, progress2, stage3)                                           \
+    FUTURE_PIPELINE_LAST_STAGE_(3, stage3, progress3)                                              \
+    FUTURE_PIPELINE_PROGRESS_END_                                                                  \
+    static inline Type prefix##_create(T0 stage0, T1 stage1, T2 stage2, T3 stage3)                 \
+    {                                                                                              \
+        return (Type) { .base = future_create(prefix##_progress), .current = 0,                    \
+            .stage0 = stage0, .stage1 = stage1, .stage2 = stage2, .stage3 = stage3 };              \
+    }
+
 #endif // FUTURE_COMBINATORS_H
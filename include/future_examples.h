@@ -22,6 +22,9 @@ typedef struct ApplyFuture {
  */
 ApplyFuture apply_future_create(void* (*func)(void*));
 
+/** Progress function of ApplyFuture (e.g. for specialized pipelines, see future_combinators.h). */
+FutureState apply_future_progress(Future* fut, Mio* mio, Waker waker);
+
 // ========================= PipeReadFuture =========================
 typedef struct PipeReadFuture {
     Future base; // Base future structure
@@ -42,6 +45,9 @@ typedef struct PipeReadFuture {
  */
 PipeReadFuture pipe_read_future_create(int fd, uint8_t* buffer, size_t n);
 
+/** Progress function of PipeReadFuture. */
+FutureState pipe_read_future_progress(Future* base, Mio* mio, Waker waker);
+
 // ========================= PipeWriteFuture =========================
 typedef struct PipeWriteFuture {
     Future base; // Base future structure.
@@ -60,4 +66,24 @@ typedef struct PipeWriteFuture {
  */
 PipeWriteFuture pipe_write_future_create(int fd, size_t n, bool stop_on_zero_byte);
 
+/** Progress function of PipeWriteFuture. */
+FutureState pipe_write_future_progress(Future* base, Mio* mio, Waker waker);
+
+// ========================= SleepFuture =========================
+typedef struct SleepFuture {
+    Future base;
+    uint64_t duration_ns; // Time to sleep, counted from the first progress() call.
+    uint64_t deadline_ns; // On the clock of `mio_now_ns()` (0 until the first progress() call).
+    MioTimer timer;
+} SleepFuture;
+
+/**
+ * Creates a future that completes `duration_ns` nanoseconds after it is first progressed,
+ * woken up by a Mio timer (with millisecond resolution) instead of by polling.
+ */
+SleepFuture sleep_future_create(uint64_t duration_ns);
+
+/** Creates a future that completes once `mio_now_ns()` reaches `deadline_ns`. */
+SleepFuture sleep_until_future_create(uint64_t deadline_ns);
+
 #endif // FUTURE_EXAMPLES_H
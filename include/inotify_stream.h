@@ -0,0 +1,82 @@
+#ifndef INOTIFY_STREAM_H
+#define INOTIFY_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Filesystem changes delivered as a stream of batches of events.
+ *
+ * An InotifyStream owns a non-blocking inotify descriptor, which its futures register in Mio:
+ * a task awaits batches of events instead of a thread polling the files with stat().
+ * Each batch holds the events returned by a single read() (as many as fit in the buffer),
+ * parsed, with repeated IN_MODIFY events of the same file coalesced: a modification is dropped
+ * if the batch already reports one for that file and no other event of the file came in between.
+ */
+
+/** Size of the buffer events are read into; fits at least 16 events with maximum-length names. */
+#define INOTIFY_STREAM_BUFFER_SIZE (16 * (sizeof(struct inotify_event) + 256))
+
+/** Maximum number of events of a batch (every event takes at least its header in the buffer). */
+#define INOTIFY_STREAM_MAX_EVENTS (INOTIFY_STREAM_BUFFER_SIZE / sizeof(struct inotify_event))
+
+typedef struct InotifyEvent {
+    int wd; // watch descriptor (-1 for IN_Q_OVERFLOW)
+    uint32_t mask; // IN_* event bits
+    uint32_t cookie; // connects the IN_MOVED_FROM and IN_MOVED_TO events of a rename
+    const char* name; // name of the file in the watched directory ("" for the watched file itself)
+} InotifyEvent;
+
+/** A batch of events, valid until the next future of the stream is progressed. */
+typedef struct InotifyBatch {
+    InotifyEvent* events;
+    size_t n_events;
+} InotifyBatch;
+
+typedef struct InotifyStream {
+    int fd; // the inotify descriptor (non-blocking), -1 when closed
+    uint64_t coalesced; // number of IN_MODIFY events dropped by coalescing (so far)
+    InotifyBatch batch; // the last batch read
+    InotifyEvent events[INOTIFY_STREAM_MAX_EVENTS];
+    _Alignas(struct inotify_event) char buffer[INOTIFY_STREAM_BUFFER_SIZE];
+} InotifyStream;
+
+/** Opens a stream. Returns 0 on success, -1 on failure (with errno set). */
+int inotify_stream_open(InotifyStream* stream);
+
+/**
+ * Starts watching `path` for the events in `mask` (IN_MODIFY, IN_CREATE...; see inotify(7)).
+ *
+ * @return the watch descriptor reported in the events, -1 on failure (with errno set).
+ */
+int inotify_stream_watch(InotifyStream* stream, const char* path, uint32_t mask);
+
+/** Stops watching a watch descriptor. Returns 0 on success, -1 on failure. */
+int inotify_stream_unwatch(InotifyStream* stream, int wd);
+
+/** Closes the stream. */
+void inotify_stream_close(InotifyStream* stream);
+
+// ========================= InotifyNextFuture =========================
+typedef struct InotifyNextFuture {
+    Future base;
+    InotifyStream* stream;
+    bool registered; // whether the inotify descriptor is registered in Mio (by this future)
+} InotifyNextFuture;
+
+/**
+ * Creates a future that reads the next batch of events of the stream.
+ *
+ * It completes with `ok` pointing to the stream's `batch` (which has at least one event),
+ * or fails with errcode set to errno if reading fails.
+ * At most one future should be waiting on a stream at a time.
+ */
+InotifyNextFuture inotify_stream_next(InotifyStream* stream);
+
+#endif // INOTIFY_STREAM_H
@@ -0,0 +1,56 @@
+#ifndef JOIN_HANDLE_H
+#define JOIN_HANDLE_H
+
+#include <stddef.h>
+
+#include "executor.h"
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Executor-owned tasks and handles to their results.
+ *
+ * `executor_spawn_owned()` moves (copies) a future into storage managed by the executor, so the
+ * caller doesn't have to keep it pinned: per-connection or per-request tasks can be spawned
+ * from a local variable and forgotten. The storage comes from per-executor size-class slabs
+ * (falling back to malloc for large futures) and is reclaimed as soon as the task completes
+ * and its handle, if any, has taken the result.
+ *
+ * The optional JoinHandle is a future that completes (or fails) with the result of the task,
+ * so another task can await it. A handle that won't be awaited must be detached.
+ */
+
+/** Handle to the result of a task spawned with `executor_spawn_owned()`. */
+typedef struct JoinHandle {
+    Future base;
+    struct OwnedTask* task; // shared with the task; NULL once the result has been taken or detached
+} JoinHandle;
+
+/**
+ * Spawns a copy of the future `fut` of `size` bytes (e.g. `sizeof(ReadFuture)`), owned by
+ * the executor, and initializes `handle` to await its result (NULL - the task is detached).
+ *
+ * `fut` must not have been spawned, and must not point into itself (e.g. to its own buffers),
+ * as it is moved. Its copy is freed once it completes; the `ok` it returns must therefore not
+ * point into the future itself either.
+ */
+void executor_spawn_owned(Executor* executor, Future const* fut, size_t size, JoinHandle* handle);
+
+/** `executor_spawn_owned()` of a future variable (not a pointer), with its size. */
+#define EXECUTOR_SPAWN_OWNED(executor, fut, handle) \
+    executor_spawn_owned((executor), (Future const*)&(fut), sizeof(fut), (handle))
+
+/**
+ * Releases the handle without awaiting the result: the task keeps running and is reclaimed
+ * when it completes. Does nothing if the handle has already completed.
+ */
+void join_handle_detach(JoinHandle* handle);
+
+/**
+ * Returns the number of bytes of owned-task storage the executor keeps cached in its slabs
+ * (including the storage of live owned tasks).
+ */
+size_t executor_owned_slab_bytes(Executor const* executor);
+
+#endif // JOIN_HANDLE_H
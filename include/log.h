@@ -0,0 +1,89 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+
+/**
+ * Leveled logging with a compile-time and a runtime level.
+ *
+ * Log sites below LOG_COMPILE_LEVEL expand to nothing. The remaining ones first check the runtime
+ * level, so their arguments are only evaluated when the message is actually logged. Messages are
+ * not formatted on the spot: the format string pointer and the raw arguments (with strings copied)
+ * are appended to a per-thread binary buffer, which is formatted and written out by `log_flush()`.
+ * The executor flushes its thread's buffer whenever it is about to block waiting for I/O;
+ * buffers are also flushed when full, at thread exit, at process exit, and after every
+ * error-level message.
+ *
+ * The formats support the printf conversions except %n (which is ignored) and wide characters.
+ *
+ * As formatting is deferred, only the pointer to the format string is recorded: it is read when
+ * the buffer is flushed, possibly long after the log site returns (as late as thread or process
+ * exit), so it must outlive the flush, i.e. be a string literal in practice. %s arguments are
+ * copied into the record when the message is logged (truncated to 1024 bytes), so they may point
+ * to stack buffers; %p arguments are recorded as values and never dereferenced.
+ */
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+
+/** Lowest level whose log sites are compiled in (define it to e.g. LOG_LEVEL_DEBUG to debug). */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+/** Lowest level of messages that are logged at runtime (LOG_LEVEL_TRACE by default). */
+extern int log_level;
+
+/** Sets the runtime level. */
+void log_set_level(int level);
+
+/** Sets the stream the messages are written to (stderr by default). */
+void log_set_output(FILE* out);
+
+/** Formats and writes out the messages buffered by the calling thread. */
+void log_flush(void);
+
+/** Appends a message to the calling thread's buffer; use the LOG_* macros instead. */
+void log_record(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define LOG_AT(level, ...)                                                                         \
+    do {                                                                                           \
+        if ((level) >= log_level)                                                                  \
+            log_record((level), __VA_ARGS__);                                                      \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#endif // LOG_H
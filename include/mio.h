@@ -1,7 +1,10 @@
 #ifndef MIO_H
 #define MIO_H
 
+#include <stddef.h> // For size_t
+#include <stdbool.h>
 #include <stdint.h> // For uint32_t
+#include <sys/types.h> // For ssize_t
 
 typedef struct Executor Executor;
 
@@ -11,9 +14,55 @@ typedef struct Mio Mio;
 /** Represents a mechanism to wake up a task when an event occurs. */
 typedef struct Waker Waker;
 
+typedef struct Future Future;
+
+/** Counters of the work done by a MIO instance (see `mio_stats()`). */
+typedef struct MioStats {
+    uint64_t polls; // Number of epoll_wait calls.
+    uint64_t events; // Number of events returned by them.
+    uint64_t max_events_per_poll; // Largest number of events returned by a single call.
+    uint64_t blocked_ns; // Time spent in epoll_wait calls that could block (virtual if simulated).
+    uint64_t ctl_add; // Number of epoll_ctl calls by operation.
+    uint64_t ctl_mod;
+    uint64_t ctl_del;
+    uint64_t timers_fired; // Number of timers that have expired and woken their futures.
+} MioStats;
+
+/** `MioTimer.heap_index` of a timer that is not armed. */
+#define MIO_TIMER_DISARMED SIZE_MAX
+
+/**
+ * A timer that wakes a future at a deadline, embedded in the future (see `mio_timer_arm()`).
+ *
+ * Armed timers are kept in a min-heap by deadline, and blocking polls wait for I/O events
+ * at most until the nearest deadline (with millisecond resolution, rounded up).
+ */
+typedef struct MioTimer {
+    uint64_t deadline_ns; // on the clock of `mio_now_ns()`
+    Future* future; // future to be woken
+    size_t heap_index; // position in Mio's heap, MIO_TIMER_DISARMED if not armed
+} MioTimer;
+
 /** Creates a new MIO event loop instance (NULL on failure). */
 Mio* mio_create(Executor* executor);
 
+/**
+ * Creates a simulated MIO instance, for deterministic tests and benchmarks.
+ *
+ * Its descriptors are in-memory pipes (see `mio_pipe()`) and its clock is virtual: it starts
+ * at 1 s and only moves when a blocking poll finds no ready descriptor, straight to the nearest
+ * timer deadline (or to the end of the poll's timeout). So timeouts take no real time, and
+ * a blocking poll with nothing that could ever wake a task up is a deadlock (a fatal error).
+ * The futures woken by a poll are woken in a pseudo-random order drawn from `seed`, so the
+ * schedules of a program are reproducible for a seed and can be varied by changing it.
+ *
+ * Real descriptors cannot be used with a simulated instance.
+ */
+Mio* mio_create_simulated(Executor* executor, uint64_t seed);
+
+/** Returns whether the MIO instance is simulated (see `mio_create_simulated()`). */
+bool mio_is_simulated(Mio const* mio);
+
 /** Destroys a MIO instance and releases its resources. */
 void mio_destroy(Mio* mio);
 
@@ -33,7 +82,105 @@ int mio_register(Mio* mio, int fd, uint32_t events, Waker waker);
 /** Unregisters a file descriptor from MIO. Returns 0 on success, -1 on failure. */
 int mio_unregister(Mio* mio, int fd);
 
+/**
+ * Unregisters all file descriptors registered in MIO and disarms all timers (e.g. after
+ * the futures that have registered them have been cancelled).
+ *
+ * @return number of descriptors unregistered.
+ */
+int mio_unregister_all(Mio* mio);
+
+/** Returns the number of file descriptors registered in MIO. */
+int mio_registered_count(Mio const* mio);
+
+/**
+ * Returns the current time (in nanoseconds) of the MIO instance's monotonic clock
+ * (the virtual clock if simulated).
+ */
+uint64_t mio_now_ns(Mio const* mio);
+
+/** Capacity of a simulated pipe, in bytes (like the default of a Linux pipe). */
+#define MIO_PIPE_CAPACITY (64 * 1024)
+
+/**
+ * Creates a non-blocking pipe: `fds[0]` is the read end, `fds[1]` the write end.
+ * Simulated pipes must only be used through `mio_read()`, `mio_write()` and `mio_close()`;
+ * writing to one whose read end is closed fails with EPIPE (no SIGPIPE is raised).
+ *
+ * @return 0 on success, -1 on failure (with errno set).
+ */
+int mio_pipe(Mio* mio, int fds[2]);
+
+/** Closes a descriptor (a simulated one is also unregistered). Returns 0 on success, -1 on failure. */
+int mio_close(Mio* mio, int fd);
+
+/** `read()` from a descriptor of the MIO instance (simulated or not). */
+ssize_t mio_read(Mio* mio, int fd, void* buffer, size_t n);
+
+/** `write()` to a descriptor of the MIO instance (simulated or not). */
+ssize_t mio_write(Mio* mio, int fd, const void* buffer, size_t n);
+
+/** Creates a timer that is not armed. */
+MioTimer mio_timer_create(void);
+
+/**
+ * Arms a timer to wake the future of `waker` once `mio_now_ns()` reaches `deadline_ns`
+ * (or moves the deadline of an armed timer). The timer is disarmed when it fires.
+ * An armed timer must not be moved or freed (e.g. with its future): disarm it first.
+ */
+void mio_timer_arm(Mio* mio, MioTimer* timer, uint64_t deadline_ns, Waker waker);
+
+/** Disarms a timer (does nothing if it is not armed). */
+void mio_timer_disarm(Mio* mio, MioTimer* timer);
+
+/**
+ * Returns how long (in milliseconds, rounded up) a poll may wait until the nearest deadline
+ * of the armed timers: 0 if a timer has expired, -1 if none is armed.
+ */
+int mio_next_timeout_ms(Mio const* mio);
+
+/** Returns the number of armed timers. */
+size_t mio_armed_timers(Mio const* mio);
+
 /** Waits for any ready event and invokes their Wakers. */
 void mio_poll(Mio* mio);
 
+/**
+ * Like `mio_poll()`, but waits at most `timeout_ms` milliseconds for an event
+ * (0 - just checks for ready events without blocking, -1 - waits indefinitely),
+ * and not past the nearest deadline of the armed timers; then fires the expired timers.
+ *
+ * @return number of Wakers invoked (for events and timers), -1 on failure.
+ */
+int mio_poll_timeout(Mio* mio, int timeout_ms);
+
+/**
+ * Returns the epoll descriptor of the MIO instance, which becomes readable when any of
+ * the registered descriptors has a ready event, so that it can be polled by an outer event loop.
+ * It must only be waited on (e.g. registered with another epoll instance or poll()),
+ * never read from or modified. -1 if the instance is simulated.
+ */
+int mio_fd(Mio const* mio);
+
+/** Copies the counters of the MIO instance to `stats`. */
+void mio_stats(Mio const* mio, MioStats* stats);
+
+/**
+ * Enables the busy-polling phase of blocking polls (0 - disabled, the default).
+ *
+ * Before going to sleep in the kernel, a blocking poll checks for ready events without blocking
+ * for up to `spin_us` microseconds. This trades CPU time for wakeup latency, which only makes
+ * sense when the executor has a dedicated core. A poll with a timeout may overrun it by at most
+ * the length of the spinning phase.
+ */
+void mio_set_busy_poll(Mio* mio, unsigned spin_us);
+
+/**
+ * Asks the kernel to busy-poll the network devices of the registered sockets for up to `usecs`
+ * microseconds (processing at most `budget` packets per poll) before `epoll_wait` sleeps.
+ *
+ * @return 0 on success, -1 on failure (e.g. if the kernel does not support it).
+ */
+int mio_set_kernel_busy_poll(Mio* mio, unsigned usecs, unsigned budget);
+
 #endif // MIO_H
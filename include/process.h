@@ -0,0 +1,70 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Child processes as futures.
+ *
+ * `process_spawn()` starts a program with posix_spawn(), optionally connecting its standard
+ * streams to non-blocking pipes (use them with PipeWriteFuture and PipeReadFuture, see
+ * future_examples.h), and opens a pidfd of the child. The ProcessFuture completes when the child
+ * exits: the pidfd is registered in Mio, so no thread or SIGCHLD handler waits for the child,
+ * and the child is reaped with waitid(P_PIDFD).
+ */
+
+/** Flags of `process_spawn()`: which standard streams of the child to connect to pipes. */
+#define PROCESS_PIPE_STDIN 1
+#define PROCESS_PIPE_STDOUT 2
+#define PROCESS_PIPE_STDERR 4
+
+typedef struct ProcessFuture {
+    Future base;
+    pid_t pid;
+    int pidfd; // -1 once the child has been reaped
+    // Parent's ends of the pipes (non-blocking), -1 if not piped or closed
+    int stdin_fd; // write end of the child's standard input
+    int stdout_fd; // read end of the child's standard output
+    int stderr_fd; // read end of the child's standard error
+    bool registered; // whether the pidfd is registered in Mio
+    // Once the future has completed: how the child has terminated
+    bool exited; // true - exited normally with `exit_code`, false - killed by `term_signal`
+    int exit_code;
+    int term_signal;
+} ProcessFuture;
+
+/**
+ * Spawns a program (looked up in PATH like execvp()) with the given argv (NULL-terminated)
+ * and the environment of the calling process, and initializes `process` to await its exit.
+ *
+ * Streams that aren't piped are inherited; the child's signal mask is empty. All descriptors
+ * created here are close-on-exec, so children spawned later don't inherit them (and keep e.g.
+ * the pipes open).
+ *
+ * The future completes when the child terminates, with `ok` set to its exit code, or to 128
+ * plus the signal number if it has been killed (like shells report it). It fails only if waiting
+ * for the child fails, with errcode set to errno.
+ *
+ * @return 0 on success, -1 on failure (with errno set, e.g. ENOENT if the program is not found).
+ */
+int process_spawn(ProcessFuture* process, char* const argv[], int pipes);
+
+/** Sends a signal to the child (through its pidfd). Returns 0 on success, -1 on failure. */
+int process_kill(ProcessFuture* process, int sig);
+
+/** Closes the parent's end of the child's standard input (the child then reads EOF). */
+void process_close_stdin(ProcessFuture* process);
+
+/**
+ * Closes the descriptors of the process that are still open; a child that hasn't been
+ * awaited is not reaped (and remains a zombie until its parent exits).
+ */
+void process_close(ProcessFuture* process);
+
+#endif // PROCESS_H
@@ -0,0 +1,75 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Token-bucket rate limiting on the executor's clock.
+ *
+ * A RateLimiter refills `rate` tokens per second, up to `burst` tokens. Tasks acquire tokens
+ * with a RateAcquireFuture, which parks the task on a Mio timer until the tokens are available,
+ * so limiting never blocks the executor. PacedWriteFuture writes a buffer to a descriptor,
+ * a token per byte, in bursts of at most `burst` bytes.
+ *
+ * The bucket is kept as the theoretical arrival time of the next token (GCRA), so acquiring
+ * is a few integer operations and no timer or task refills it.
+ */
+typedef struct RateLimiter {
+    uint64_t rate; // tokens per second
+    uint64_t burst; // bucket capacity, in tokens
+    uint64_t tat_ns; // when the bucket will be full again (theoretical arrival time)
+} RateLimiter;
+
+/** Initializes a limiter of `rate` (> 0) tokens per second, with a full bucket of `burst` tokens. */
+void rate_limiter_init(RateLimiter* limiter, uint64_t rate, uint64_t burst);
+
+/**
+ * Takes `n` tokens if they are available at `now_ns` (on the clock of `mio_now_ns()`).
+ *
+ * Requests larger than the burst are allowed when the bucket is full, leaving it in debt.
+ *
+ * @return 0 if the tokens have been taken, otherwise how long (in nanoseconds) to wait
+ *         until they are available.
+ */
+uint64_t rate_limiter_try_acquire(RateLimiter* limiter, uint64_t n, uint64_t now_ns);
+
+// ========================= RateAcquireFuture =========================
+typedef struct RateAcquireFuture {
+    Future base;
+    RateLimiter* limiter;
+    uint64_t n; // number of tokens to acquire
+    MioTimer timer;
+} RateAcquireFuture;
+
+/** Creates a future that completes once it has taken `n` tokens from the limiter. */
+RateAcquireFuture rate_acquire_future_create(RateLimiter* limiter, uint64_t n);
+
+// ========================= PacedWriteFuture =========================
+typedef struct PacedWriteFuture {
+    Future base;
+    RateLimiter* limiter; // a token per byte
+    int fd; // non-blocking descriptor to write to
+    size_t n; // number of bytes to write, taken from `(const uint8_t*)base.arg`
+    size_t written_so_far;
+    size_t allowed; // bytes acquired from the limiter and not yet written
+    bool registered; // whether fd is registered in Mio
+    MioTimer timer;
+} PacedWriteFuture;
+
+/**
+ * Creates a future that writes `n` bytes (from `future->base.arg`, like PipeWriteFuture)
+ * to `fd` without exceeding the rate of the limiter: the buffer is split into bursts of
+ * at most `limiter->burst` bytes, each written once the limiter allows it.
+ *
+ * Completes with `ok` set to the buffer, or fails with PIPE_FUTURE_ERR_EOF if nothing can be
+ * written anymore, or with errno if writing fails.
+ */
+PacedWriteFuture paced_write_future_create(RateLimiter* limiter, int fd, size_t n);
+
+#endif // RATE_LIMITER_H
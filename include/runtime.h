@@ -0,0 +1,66 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+
+#include "executor.h"
+#include "future.h"
+
+/**
+ * A thread-per-core runtime made of shared-nothing shards.
+ *
+ * Each shard is a thread pinned to its own CPU that runs its own Executor (and Mio).
+ * Tasks never migrate between shards, so the run queues and epoll sets are never shared
+ * between cores. The only way for shards to communicate is submitting a future to another
+ * shard through its lock-free inbox, which wakes the target shard via an eventfd.
+ *
+ * BEWARE: a Waker must only be used on the shard that progresses its future.
+ */
+typedef struct Runtime Runtime;
+
+/** Returned by `runtime_current_shard()` when called outside of any shard. */
+#define RUNTIME_NO_SHARD ((size_t)-1)
+
+/**
+ * Creates a runtime and starts `n_shards` shards, pinned to consecutive CPUs the process may
+ * run on (wrapping around if there are fewer CPUs than shards). Each shard's executor is
+ * created with `max_queue_size` (see `executor_create()`).
+ * Returns NULL (with errno set) if `n_shards` is 0 or the CPUs available to the process cannot be
+ * determined.
+ */
+Runtime* runtime_create(size_t n_shards, size_t max_queue_size);
+
+/** Returns the number of shards of the runtime. */
+size_t runtime_shard_count(Runtime const* runtime);
+
+/** Returns the index of the shard the calling thread belongs to, or RUNTIME_NO_SHARD. */
+size_t runtime_current_shard(void);
+
+/**
+ * Submits a future to be spawned on the given shard; may be called from any thread.
+ *
+ * The future must be pinned (see `Future.is_active`) until it completes on the target shard.
+ * Submitting to the calling thread's own shard spawns the future directly.
+ *
+ * @return 0 on success, -1 (with errno set to EINVAL) if there is no such shard.
+ */
+int runtime_submit(Runtime* runtime, size_t shard, Future* fut);
+
+/**
+ * Stops the runtime: waits until every shard has completed all of its tasks, joins the shard
+ * threads and frees the resources. No futures may be submitted once this has been called.
+ */
+void runtime_destroy(Runtime* runtime);
+
+/**
+ * Creates a non-blocking listening TCP socket bound with SO_REUSEPORT.
+ *
+ * Every shard may call this with the same address to get its own listener;
+ * the kernel then spreads the incoming connections over the shards.
+ *
+ * @return the socket's descriptor, or -1 on failure.
+ */
+int runtime_listen_reuseport(struct sockaddr const* addr, socklen_t addrlen, int backlog);
+
+#endif // RUNTIME_H
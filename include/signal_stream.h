@@ -0,0 +1,56 @@
+#ifndef SIGNAL_STREAM_H
+#define SIGNAL_STREAM_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/signalfd.h>
+
+#include "future.h"
+#include "mio.h"
+#include "waker.h"
+
+/**
+ * Signals delivered as a stream of futures, instead of asynchronous handlers.
+ *
+ * A SignalStream blocks the chosen signals in the calling thread and receives them through
+ * a signalfd, which futures register in Mio: e.g. a task awaiting SIGTERM can start a graceful
+ * shutdown, with no async-signal-safe handler, self-pipe or extra thread involved.
+ *
+ * BEWARE: the signal mask is per thread. A process-directed signal (e.g. from kill) is delivered
+ * to any thread that doesn't block it, so open the stream before creating other threads (they
+ * inherit the mask) or block the signals in them, too.
+ */
+typedef struct SignalStream {
+    int fd; // the signalfd (non-blocking), -1 when closed
+    sigset_t mask; // signals received through the stream
+    sigset_t old_mask; // signal mask of the thread before the stream has been opened
+} SignalStream;
+
+/**
+ * Blocks `signals` in the calling thread and opens a stream receiving them.
+ *
+ * @return 0 on success, -1 on failure (with errno set).
+ */
+int signal_stream_open(SignalStream* stream, sigset_t const* signals);
+
+/** Closes the stream and restores the signal mask of the calling thread. */
+void signal_stream_close(SignalStream* stream);
+
+// ========================= SignalNextFuture =========================
+typedef struct SignalNextFuture {
+    Future base;
+    SignalStream* stream;
+    bool registered; // whether the signalfd is registered in Mio (by this future)
+    struct signalfd_siginfo info; // the received signal, once completed
+} SignalNextFuture;
+
+/**
+ * Creates a future that receives the next signal of the stream.
+ *
+ * It completes with `ok` pointing to its `info` (signal number, sender, sigqueue() value...),
+ * or fails with errcode set to errno if reading the signalfd fails.
+ * At most one future should be waiting on a stream at a time.
+ */
+SignalNextFuture signal_stream_next(SignalStream* stream);
+
+#endif // SIGNAL_STREAM_H
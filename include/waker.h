@@ -17,12 +17,16 @@ typedef struct Waker {
     Future* future; // Future to be requeued up by executor.
 } Waker;
 
-/** Invoked when the associated future becomes ready. */
+/**
+ * Invoked when the associated future becomes ready.
+ *
+ * Waking a future that is already waiting in the executor's queue has no effect.
+ */
 void waker_wake(struct Waker* waker);
 
 static inline void debug_print_waker(Waker const* waker)
 {
-    debug("Waker { fut = %p, executor = %p }", waker->future, waker->executor);
+    LOG_DEBUG("Waker { fut = %p, executor = %p }\n", (void*)waker->future, waker->executor);
 }
 
 #endif // WAKER_H
\ No newline at end of file
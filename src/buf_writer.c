@@ -0,0 +1,284 @@
+#include "buf_writer.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "executor.h"
+#include "future_examples.h"
+#include "log.h"
+
+// ========================= wait queues =========================
+
+static BufWaiter buf_waiter_create(void) {
+    return (BufWaiter) { .prev = NULL, .next = NULL, .linked = false };
+}
+
+// Append the waiter to the queue (unless it is already queued, keeping its place)
+static void wait_queue_push(BufWaitQueue *queue, BufWaiter *waiter, Waker waker) {
+    waiter->waker = waker;
+    if (waiter->linked)
+        return;
+    waiter->prev = queue->tail;
+    waiter->next = NULL;
+    if (queue->tail)
+        queue->tail->next = waiter;
+    else
+        queue->head = waiter;
+    queue->tail = waiter;
+    waiter->linked = true;
+}
+
+static void wait_queue_remove(BufWaitQueue *queue, BufWaiter *waiter) {
+    if (!waiter->linked)
+        return;
+    if (waiter->prev)
+        waiter->prev->next = waiter->next;
+    else
+        queue->head = waiter->next;
+    if (waiter->next)
+        waiter->next->prev = waiter->prev;
+    else
+        queue->tail = waiter->prev;
+    waiter->linked = false;
+}
+
+// Wake the first waiter, which stays queued (and so keeps its turn)
+static void wait_queue_wake_head(BufWaitQueue *queue) {
+    if (queue->head)
+        waker_wake(&queue->head->waker);
+}
+
+// Wake every waiter once; they queue themselves again if they still have to wait
+static void wait_queue_wake_all(BufWaitQueue *queue) {
+    BufWaiter *waiter = queue->head;
+    *queue = (BufWaitQueue) { .head = NULL, .tail = NULL };
+    while (waiter) {
+        BufWaiter *next = waiter->next;
+        waiter->linked = false;
+        waker_wake(&waiter->waker);
+        waiter = next;
+    }
+}
+
+// ========================= flusher =========================
+
+static void buf_writer_wake_flusher(BufWriter *writer) {
+    if (!writer->flusher_parked)
+        return;
+    writer->flusher_parked = false;
+    waker_wake(&writer->flusher_waker);
+}
+
+static void buf_writer_unregister(BufWriter *writer, Mio *mio) {
+    if (writer->registered)
+        mio_unregister(mio, writer->fd);
+    writer->registered = false;
+}
+
+// Whether the buffered bytes have to be written now
+static bool buf_writer_flush_due(BufWriter const *writer, Mio *mio) {
+    if (writer->len == 0)
+        return false;
+    if (writer->len >= writer->flush_threshold || writer->flush_target > writer->flushed
+        || writer->writer_blocked || writer->closed)
+        return true;
+    return writer->max_delay_ns != 0
+        && mio_now_ns(mio) >= writer->first_buffered_ns + writer->max_delay_ns;
+}
+
+static FutureState buf_writer_flusher_progress(Future *base, Mio *mio, Waker waker) {
+    BufWriter *writer = (BufWriter*)((char*)base - offsetof(BufWriter, flusher));
+    writer->flusher_parked = false;
+    while (buf_writer_flush_due(writer, mio)) {
+        if (!executor_budget_consume(waker.executor)) {
+            // Let other tasks run, staying registered.
+            waker_wake(&waker);
+            return FUTURE_PENDING;
+        }
+        ssize_t bytes_written = mio_write(mio, writer->fd, writer->buffer, writer->len);
+        ++writer->syscalls;
+        LOG_DEBUG("BufWriter %p: write %zd of %zu\n", (void*)writer, bytes_written, writer->len);
+        if (bytes_written > 0) {
+            writer->len -= bytes_written;
+            memmove(writer->buffer, writer->buffer + bytes_written, writer->len);
+            writer->flushed += bytes_written;
+            writer->writer_blocked = false; // until the first writer finds it still doesn't fit
+            if (writer->flushed >= writer->flush_target)
+                wait_queue_wake_all(&writer->flushes);
+            wait_queue_wake_head(&writer->writers);
+        } else if (bytes_written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Woken up by the descriptor only: new writes can't be written before it is writable
+            if (!writer->registered) {
+                ASSERT_SYS_OK(mio_register(mio, writer->fd, EPOLLOUT, waker));
+                writer->registered = true;
+            }
+            return FUTURE_PENDING;
+        } else {
+            writer->errcode = bytes_written == 0 ? PIPE_FUTURE_ERR_EOF : errno;
+            buf_writer_unregister(writer, mio);
+            mio_timer_disarm(mio, &writer->timer);
+            wait_queue_wake_all(&writer->writers);
+            wait_queue_wake_all(&writer->flushes);
+            base->errcode = writer->errcode;
+            return FUTURE_FAILURE;
+        }
+    }
+    // Nothing to write: a writable descriptor would wake us up in vain
+    buf_writer_unregister(writer, mio);
+    if (writer->closed && writer->len == 0) {
+        mio_timer_disarm(mio, &writer->timer);
+        return FUTURE_COMPLETED;
+    }
+    if (writer->len > 0 && writer->max_delay_ns != 0)
+        mio_timer_arm(mio, &writer->timer, writer->first_buffered_ns + writer->max_delay_ns, waker);
+    else
+        mio_timer_disarm(mio, &writer->timer);
+    writer->flusher_waker = waker;
+    writer->flusher_parked = true;
+    return FUTURE_PENDING;
+}
+
+void buf_writer_init(BufWriter* writer, int fd, size_t capacity, size_t flush_threshold, uint64_t max_delay_ns) {
+    if (capacity == 0)
+        capacity = BUF_WRITER_DEFAULT_CAPACITY;
+    if (flush_threshold == 0 || flush_threshold > capacity)
+        flush_threshold = capacity;
+    uint8_t *buffer = malloc(capacity);
+    if (!buffer)
+        fatal("Allocation failed\n");
+    *writer = (BufWriter) {
+        .fd = fd,
+        .buffer = buffer,
+        .capacity = capacity,
+        .len = 0,
+        .flush_threshold = flush_threshold,
+        .max_delay_ns = max_delay_ns,
+        .first_buffered_ns = 0,
+        .appended = 0,
+        .flushed = 0,
+        .flush_target = 0,
+        .closed = false,
+        .errcode = 0,
+        .writers = { .head = NULL, .tail = NULL },
+        .writer_blocked = false,
+        .flushes = { .head = NULL, .tail = NULL },
+        .flusher = future_create(buf_writer_flusher_progress),
+        .flusher_parked = false,
+        .registered = false,
+        .timer = mio_timer_create(),
+        .writes = 0,
+        .syscalls = 0,
+    };
+}
+
+void buf_writer_destroy(BufWriter* writer) {
+    free(writer->buffer);
+    writer->buffer = NULL;
+}
+
+Future* buf_writer_flusher(BufWriter* writer) {
+    return &writer->flusher;
+}
+
+void buf_writer_close(BufWriter* writer) {
+    writer->closed = true;
+    wait_queue_wake_all(&writer->writers);
+    buf_writer_wake_flusher(writer);
+}
+
+// ========================= BufWriteFuture =========================
+
+static FutureState buf_write_future_progress(Future *base, Mio *mio, Waker waker) {
+    BufWriteFuture *self = (BufWriteFuture*)base;
+    BufWriter *writer = self->writer;
+    if (writer->errcode != 0 || writer->closed) {
+        wait_queue_remove(&writer->writers, &self->waiter);
+        wait_queue_wake_head(&writer->writers);
+        base->errcode = writer->errcode != 0 ? writer->errcode : BUF_WRITER_ERR_CLOSED;
+        return FUTURE_FAILURE;
+    }
+    // Writers are served in order, so that their bytes aren't interleaved
+    bool first = !writer->writers.head || writer->writers.head == &self->waiter;
+    if (first) {
+        size_t left = self->n - self->copied;
+        size_t space = writer->capacity - writer->len;
+        // A write that fits in the buffer is copied at once, a larger one in parts
+        size_t chunk = left <= space ? left : self->n <= writer->capacity ? 0 : space;
+        if (chunk > 0) {
+            if (writer->len == 0) {
+                writer->first_buffered_ns = mio_now_ns(mio);
+                if (writer->max_delay_ns != 0)
+                    buf_writer_wake_flusher(writer); // to arm the idle tick
+            }
+            memcpy(writer->buffer + writer->len, (const uint8_t*)base->arg + self->copied, chunk);
+            writer->len += chunk;
+            writer->appended += chunk;
+            self->copied += chunk;
+            if (writer->len >= writer->flush_threshold)
+                buf_writer_wake_flusher(writer);
+        }
+        if (self->copied == self->n) {
+            wait_queue_remove(&writer->writers, &self->waiter);
+            wait_queue_wake_head(&writer->writers);
+            ++writer->writes;
+            base->ok = base->arg;
+            return FUTURE_COMPLETED;
+        }
+    }
+    wait_queue_push(&writer->writers, &self->waiter, waker);
+    if (first) {
+        // Backpressure: wait for the flusher to make room
+        writer->writer_blocked = true;
+        buf_writer_wake_flusher(writer);
+    }
+    return FUTURE_PENDING;
+}
+
+BufWriteFuture buf_write_future_create(BufWriter* writer, size_t n) {
+    return (BufWriteFuture) {
+        .base = future_create(buf_write_future_progress),
+        .writer = writer,
+        .n = n,
+        .copied = 0,
+        .waiter = buf_waiter_create(),
+    };
+}
+
+// ========================= BufFlushFuture =========================
+
+static FutureState buf_flush_future_progress(Future *base, Mio *mio, Waker waker) {
+    BufFlushFuture *self = (BufFlushFuture*)base;
+    BufWriter *writer = self->writer;
+    if (!self->started) {
+        self->target = writer->appended;
+        self->started = true;
+    }
+    if (writer->flushed >= self->target) {
+        wait_queue_remove(&writer->flushes, &self->waiter);
+        return FUTURE_COMPLETED;
+    }
+    if (writer->errcode != 0) {
+        wait_queue_remove(&writer->flushes, &self->waiter);
+        base->errcode = writer->errcode;
+        return FUTURE_FAILURE;
+    }
+    if (writer->flush_target < self->target)
+        writer->flush_target = self->target;
+    wait_queue_push(&writer->flushes, &self->waiter, waker);
+    buf_writer_wake_flusher(writer);
+    return FUTURE_PENDING;
+}
+
+BufFlushFuture buf_flush_future_create(BufWriter* writer) {
+    return (BufFlushFuture) {
+        .base = future_create(buf_flush_future_progress),
+        .writer = writer,
+        .target = 0,
+        .started = false,
+        .waiter = buf_waiter_create(),
+    };
+}
@@ -0,0 +1,167 @@
+#include "channel.h"
+
+#include <stdlib.h>
+
+#include "err.h"
+
+// ========================= waiters =========================
+
+static void waiter_link(ChannelWaiter **waiters, ChannelWaiter *waiter, Waker waker) {
+    waiter->waker = waker; // the future may be progressed by a different task than before
+    if (waiter->linked)
+        return;
+    waiter->prev = NULL;
+    waiter->next = *waiters;
+    if (*waiters)
+        (*waiters)->prev = waiter;
+    *waiters = waiter;
+    waiter->linked = true;
+}
+
+static void waiter_unlink(ChannelWaiter **waiters, ChannelWaiter *waiter) {
+    if (!waiter->linked)
+        return;
+    if (waiter->prev)
+        waiter->prev->next = waiter->next;
+    else
+        *waiters = waiter->next;
+    if (waiter->next)
+        waiter->next->prev = waiter->prev;
+    waiter->linked = false;
+}
+
+// Wake every waiter once; they link themselves again if they still have to wait
+static void waiters_wake_all(ChannelWaiter **waiters) {
+    ChannelWaiter *waiter = *waiters;
+    *waiters = NULL;
+    while (waiter) {
+        ChannelWaiter *next = waiter->next;
+        waiter->linked = false;
+        waker_wake(&waiter->waker);
+        waiter = next;
+    }
+}
+
+static ChannelWaiter waiter_create(void) {
+    return (ChannelWaiter) { .prev = NULL, .next = NULL, .linked = false };
+}
+
+// ========================= watch =========================
+
+void watch_channel_init(WatchChannel* channel, void* initial) {
+    *channel = (WatchChannel) { .value = initial, .version = 0, .closed = false, .waiters = NULL };
+}
+
+void watch_send(WatchChannel* channel, void* value) {
+    channel->value = value;
+    ++channel->version;
+    waiters_wake_all(&channel->waiters);
+}
+
+void watch_close(WatchChannel* channel) {
+    channel->closed = true;
+    waiters_wake_all(&channel->waiters);
+}
+
+WatchReceiver watch_subscribe(WatchChannel* channel) {
+    return (WatchReceiver) { .channel = channel, .seen_version = channel->version };
+}
+
+static FutureState watch_changed_future_progress(Future *base, Mio *mio, Waker waker) {
+    WatchChangedFuture *self = (WatchChangedFuture*)base;
+    WatchReceiver *receiver = self->receiver;
+    WatchChannel *channel = receiver->channel;
+    if (receiver->seen_version != channel->version) {
+        waiter_unlink(&channel->waiters, &self->waiter);
+        receiver->seen_version = channel->version;
+        base->ok = channel->value;
+        return FUTURE_COMPLETED;
+    }
+    if (channel->closed) {
+        waiter_unlink(&channel->waiters, &self->waiter);
+        base->errcode = CHANNEL_ERR_CLOSED;
+        return FUTURE_FAILURE;
+    }
+    waiter_link(&channel->waiters, &self->waiter, waker);
+    return FUTURE_PENDING;
+}
+
+WatchChangedFuture watch_changed(WatchReceiver* receiver) {
+    return (WatchChangedFuture) {
+        .base = future_create(watch_changed_future_progress),
+        .receiver = receiver,
+        .waiter = waiter_create(),
+    };
+}
+
+// ========================= broadcast =========================
+
+void broadcast_channel_init(BroadcastChannel* channel, size_t capacity) {
+    if (capacity == 0)
+        fatal("A broadcast channel needs a positive capacity\n");
+    void **slots = (void**)malloc(capacity * sizeof(void*));
+    if (!slots)
+        fatal("Allocation failed\n");
+    *channel = (BroadcastChannel) {
+        .slots = slots,
+        .capacity = capacity,
+        .sent = 0,
+        .closed = false,
+        .waiters = NULL,
+    };
+}
+
+void broadcast_channel_destroy(BroadcastChannel* channel) {
+    free(channel->slots);
+    channel->slots = NULL;
+}
+
+void broadcast_send(BroadcastChannel* channel, void* message) {
+    channel->slots[channel->sent % channel->capacity] = message;
+    ++channel->sent;
+    waiters_wake_all(&channel->waiters);
+}
+
+void broadcast_close(BroadcastChannel* channel) {
+    channel->closed = true;
+    waiters_wake_all(&channel->waiters);
+}
+
+BroadcastReceiver broadcast_subscribe(BroadcastChannel* channel) {
+    return (BroadcastReceiver) { .channel = channel, .next = channel->sent, .lagged = 0 };
+}
+
+static FutureState broadcast_recv_future_progress(Future *base, Mio *mio, Waker waker) {
+    BroadcastRecvFuture *self = (BroadcastRecvFuture*)base;
+    BroadcastReceiver *receiver = self->receiver;
+    BroadcastChannel *channel = receiver->channel;
+    if (receiver->next == channel->sent && !channel->closed) {
+        waiter_link(&channel->waiters, &self->waiter, waker);
+        return FUTURE_PENDING;
+    }
+    waiter_unlink(&channel->waiters, &self->waiter);
+    uint64_t oldest = channel->sent > channel->capacity ? channel->sent - channel->capacity : 0;
+    if (receiver->next < oldest) { // overwritten: skip to the oldest message still buffered
+        self->gap = oldest - receiver->next;
+        receiver->lagged += self->gap;
+        receiver->next = oldest;
+        base->errcode = CHANNEL_ERR_LAGGED;
+        return FUTURE_FAILURE;
+    }
+    if (receiver->next == channel->sent) { // and closed
+        base->errcode = CHANNEL_ERR_CLOSED;
+        return FUTURE_FAILURE;
+    }
+    base->ok = channel->slots[receiver->next % channel->capacity];
+    ++receiver->next;
+    return FUTURE_COMPLETED;
+}
+
+BroadcastRecvFuture broadcast_recv(BroadcastReceiver* receiver) {
+    return (BroadcastRecvFuture) {
+        .base = future_create(broadcast_recv_future_progress),
+        .receiver = receiver,
+        .waiter = waiter_create(),
+        .gap = 0,
+    };
+}
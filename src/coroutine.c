@@ -0,0 +1,323 @@
+// Required for `sys/mman.h` to contain `MAP_STACK`.
+#define _GNU_SOURCE
+
+#include "coroutine.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "err.h"
+
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/asan_interface.h>
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+// Saves the callee-saved registers and floating-point control state on the current stack,
+// stores the stack pointer in *save_sp, switches to new_sp and restores the ones saved there.
+void coroutine_switch_context(void **save_sp, void *new_sp) __attribute__((visibility("hidden")));
+
+// First code run on a new stack: calls coroutine_main() with the coroutine stored in the frame
+void coroutine_trampoline(void) __attribute__((visibility("hidden")));
+
+#if defined(__x86_64__)
+
+// Frame: MXCSR and x87 control word (both callee-saved in the SysV ABI), r15, r14, r13, r12,
+// rbx, rbp, return address (and padding, so that the trampoline is entered with a 16-byte
+// aligned stack pointer, as required before its call)
+#define FRAME_WORDS 8
+#define FRAME_SIZE (FRAME_WORDS * 8 + 16)
+#define FRAME_FPU_WORD 0
+#define FRAME_ARG_WORD 5 // rbx
+#define FRAME_RETURN_WORD 7
+
+__asm__(
+    ".text\n"
+    ".globl coroutine_switch_context\n"
+    ".hidden coroutine_switch_context\n"
+    ".type coroutine_switch_context, @function\n"
+    "coroutine_switch_context:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size coroutine_switch_context, .-coroutine_switch_context\n"
+    ".globl coroutine_trampoline\n"
+    ".hidden coroutine_trampoline\n"
+    ".type coroutine_trampoline, @function\n"
+    "coroutine_trampoline:\n"
+    "    movq %rbx, %rdi\n"
+    "    call coroutine_main\n"
+    "    ud2\n"
+    ".size coroutine_trampoline, .-coroutine_trampoline\n");
+
+// A new coroutine starts with the floating-point control state of the thread
+static void frame_init_fpu(void **frame) {
+    __asm__ volatile("stmxcsr (%0)\n\tfnstcw 4(%0)" : : "r"(&frame[FRAME_FPU_WORD]) : "memory");
+}
+
+#elif defined(__aarch64__)
+
+// Frame: x19 - x28, x29 (fp), x30 (lr), d8 - d15, FPCR
+#define FRAME_WORDS 21
+#define FRAME_SIZE 176
+#define FRAME_FPU_WORD 20
+#define FRAME_ARG_WORD 0 // x19
+#define FRAME_RETURN_WORD 11 // x30
+
+__asm__(
+    ".text\n"
+    ".globl coroutine_switch_context\n"
+    ".hidden coroutine_switch_context\n"
+    ".type coroutine_switch_context, %function\n"
+    "coroutine_switch_context:\n"
+    "    sub sp, sp, #176\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mrs x2, fpcr\n"
+    "    str x2, [sp, #160]\n"
+    "    mov x2, sp\n"
+    "    str x2, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldr x2, [sp, #160]\n"
+    "    msr fpcr, x2\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #176\n"
+    "    ret\n"
+    ".size coroutine_switch_context, .-coroutine_switch_context\n"
+    ".globl coroutine_trampoline\n"
+    ".hidden coroutine_trampoline\n"
+    ".type coroutine_trampoline, %function\n"
+    "coroutine_trampoline:\n"
+    "    mov x0, x19\n"
+    "    bl coroutine_main\n"
+    "    brk #0\n"
+    ".size coroutine_trampoline, .-coroutine_trampoline\n");
+
+// A new coroutine starts with the floating-point control state of the thread
+static void frame_init_fpu(void **frame) {
+    uint64_t fpcr;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    frame[FRAME_FPU_WORD] = (void*)fpcr;
+}
+
+#else
+#error "CoroutineFuture is only implemented for x86-64 and AArch64"
+#endif
+
+typedef struct StackPool {
+    void *stacks[COROUTINE_STACK_POOL_CAPACITY]; // lowest usable addresses
+    size_t sizes[COROUTINE_STACK_POOL_CAPACITY];
+    size_t n_cached;
+} StackPool;
+
+static _Thread_local StackPool stack_pool;
+static pthread_key_t pool_key; // to unmap the stacks cached by exiting threads
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+static size_t page_size(void) {
+    static size_t size = 0;
+    if (size == 0)
+        size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+// Take a cached stack of the given size, or map a new one, with a guard page below it
+static void *stack_acquire(size_t size) {
+    for (size_t i = stack_pool.n_cached; i-- > 0;) {
+        if (stack_pool.sizes[i] == size) {
+            void *stack = stack_pool.stacks[i];
+            --stack_pool.n_cached;
+            stack_pool.stacks[i] = stack_pool.stacks[stack_pool.n_cached];
+            stack_pool.sizes[i] = stack_pool.sizes[stack_pool.n_cached];
+            return stack;
+        }
+    }
+    size_t guard = page_size();
+    char *region = mmap(NULL, guard + size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED)
+        fatal("Mapping a coroutine stack failed\n");
+    ASSERT_SYS_OK(mprotect(region, guard, PROT_NONE));
+    return region + guard;
+}
+
+static void stack_unmap(void *stack, size_t size) {
+    size_t guard = page_size();
+    ASSERT_SYS_OK(munmap((char*)stack - guard, guard + size));
+}
+
+static void destroy_pool(void *arg) {
+    coroutine_stack_pool_clear();
+}
+
+static void create_pool_key(void) {
+    ASSERT_ZERO(pthread_key_create(&pool_key, destroy_pool));
+}
+
+static void stack_release(void *stack, size_t size) {
+    if (stack_pool.n_cached == COROUTINE_STACK_POOL_CAPACITY) {
+        stack_unmap(stack, size);
+        return;
+    }
+    if (stack_pool.n_cached == 0) { // the destructor only runs for a non-NULL value
+        pthread_once(&pool_key_once, create_pool_key);
+        ASSERT_ZERO(pthread_setspecific(pool_key, &stack_pool));
+    }
+    stack_pool.stacks[stack_pool.n_cached] = stack;
+    stack_pool.sizes[stack_pool.n_cached] = size;
+    ++stack_pool.n_cached;
+}
+
+size_t coroutine_stack_pool_cached(void) {
+    return stack_pool.n_cached;
+}
+
+void coroutine_stack_pool_clear(void) {
+    while (stack_pool.n_cached > 0) {
+        --stack_pool.n_cached;
+        stack_unmap(stack_pool.stacks[stack_pool.n_cached], stack_pool.sizes[stack_pool.n_cached]);
+    }
+}
+
+// Switch from the executor to the coroutine
+static void switch_in(CoroutineFuture *self) {
+#ifdef __SANITIZE_ADDRESS__
+    __sanitizer_start_switch_fiber(&self->caller_fake_stack, self->stack, self->stack_size);
+#endif
+    coroutine_switch_context(&self->caller_sp, self->sp);
+#ifdef __SANITIZE_ADDRESS__
+    __sanitizer_finish_switch_fiber(self->caller_fake_stack, NULL, NULL);
+#endif
+}
+
+// Called on the coroutine's stack whenever it has been switched to
+static void switched_in(CoroutineFuture *self) {
+#ifdef __SANITIZE_ADDRESS__
+    __sanitizer_finish_switch_fiber(self->fake_stack, &self->caller_stack, &self->caller_stack_size);
+#endif
+}
+
+// Switch from the coroutine back to the executor
+static void switch_out(CoroutineFuture *self) {
+#ifdef __SANITIZE_ADDRESS__
+    // The fake stack of a finished coroutine is destroyed
+    __sanitizer_start_switch_fiber(self->finished ? NULL : &self->fake_stack,
+        self->caller_stack, self->caller_stack_size);
+#endif
+    coroutine_switch_context(&self->sp, self->caller_sp);
+    switched_in(self);
+}
+
+__attribute__((used, __noreturn__, visibility("hidden"))) void coroutine_main(CoroutineFuture *self) {
+    switched_in(self);
+    self->base.ok = self->func(self, self->base.arg);
+    self->finished = true;
+    switch_out(self);
+    fatal("A finished coroutine has been resumed\n");
+}
+
+static FutureState coroutine_future_progress(Future *base, Mio *mio, Waker waker) {
+    CoroutineFuture *self = (CoroutineFuture*)base;
+    self->mio = mio;
+    self->waker = waker;
+    if (!self->stack) { // first call: prepare a frame that "returns" to the trampoline
+        self->stack = stack_acquire(self->stack_size);
+        void **frame = (void**)((char*)self->stack + self->stack_size - FRAME_SIZE);
+        for (size_t i = 0; i < FRAME_WORDS; ++i)
+            frame[i] = NULL;
+        frame_init_fpu(frame);
+        frame[FRAME_ARG_WORD] = self;
+        frame[FRAME_RETURN_WORD] = (void*)coroutine_trampoline;
+        self->sp = frame;
+    }
+    switch_in(self);
+    if (!self->finished)
+        return FUTURE_PENDING;
+    stack_release(self->stack, self->stack_size);
+    self->stack = NULL;
+    return self->base.errcode == FUTURE_SUCCESS ? FUTURE_COMPLETED : FUTURE_FAILURE;
+}
+
+void coroutine_future_release(CoroutineFuture* self) {
+    if (!self->stack || self->finished)
+        return; // never started, or the stack has already been released on completion
+#ifdef __SANITIZE_ADDRESS__
+    // The abandoned frames stay poisoned otherwise, which would trip the stack's next user
+    ASAN_UNPOISON_MEMORY_REGION(self->stack, self->stack_size);
+#endif
+    stack_release(self->stack, self->stack_size);
+    self->stack = NULL;
+    self->finished = true;
+}
+
+CoroutineFuture coroutine_future_create(CoroutineFn func, size_t stack_size) {
+    if (stack_size == 0)
+        stack_size = COROUTINE_DEFAULT_STACK_SIZE;
+    size_t page = page_size();
+    stack_size = (stack_size + page - 1) / page * page;
+    return (CoroutineFuture) {
+        .base = future_create(coroutine_future_progress),
+        .func = func,
+        .stack_size = stack_size,
+        .stack = NULL,
+        .sp = NULL,
+        .caller_sp = NULL,
+        .mio = NULL,
+        .finished = false,
+        .fake_stack = NULL,
+        .caller_fake_stack = NULL,
+        .caller_stack = NULL,
+        .caller_stack_size = 0,
+    };
+}
+
+FutureState coroutine_await(CoroutineFuture *self, Future *fut) {
+    for (;;) {
+        FutureState state = (*fut->progress)(fut, self->mio, self->waker);
+        if (state != FUTURE_PENDING)
+            return state;
+        switch_out(self); // until the coroutine is progressed (woken by fut) again
+    }
+}
+
+void coroutine_yield(CoroutineFuture *self) {
+    waker_wake(&self->waker);
+    switch_out(self);
+}
@@ -1,13 +1,21 @@
 #include "executor.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 
-#include "debug.h"
+#include "log.h"
 #include "future.h"
+#include "join_handle.h"
 #include "mio.h"
+#include "owned.h"
+#include "stall.h"
+#include "trace.h"
 #include "waker.h"
 #include "err.h"
 
@@ -17,29 +25,24 @@
 typedef struct Queue Queue;
 
 /**
- * Cyclic buffer task queue
+ * Intrusive FIFO task queue, linked through the `next_queued` fields of the queued futures
  * Semantics:
- * The queue is valid and empty iff size == 0;
- * If size == 0, head and tail point to the same unspecified free index;
- * If size > 0, head is the index of the first available position,
- * and tail is the index of the last element.
+ * The queue is valid and empty iff size == 0 (and then head == tail == NULL);
+ * If size > 0, head is the first future to be dequeued and tail is the last one.
+ * A future is in the queue iff its `is_queued` flag is set.
  */
 struct Queue {
-    Future **data; // internal array
-    size_t max_size;
-    size_t head;
-    size_t tail;
+    Future *head;
+    Future *tail;
     size_t size;
+    size_t high_water; // largest size so far
 };
 
-void queue_init(Queue *queue, size_t max_queue_size) {
+void queue_init(Queue *queue) {
     if (!queue)
         return;
-    queue->data = (Future**)malloc(max_queue_size * sizeof(Future*));
-    if (!queue->data)
-        fatal("Allocation failed\n");
-    queue->max_size = max_queue_size;
-    queue->head = queue->tail = queue->size = 0;
+    queue->head = queue->tail = NULL;
+    queue->size = queue->high_water = 0;
 }
 
 bool queue_empty(Queue *queue) {
@@ -49,88 +52,513 @@ bool queue_empty(Queue *queue) {
 void queue_enqueue_future(Queue *queue, Future *future) {
     if (!future)
         fatal("NULL Future pointer\n");
-    if (queue->size == queue->max_size)
-        fatal("Assignment guarantees violated: size of queue exceeds max_queue_size\n");
-    queue->data[queue->head] = future;
-    queue->head = (queue->head + 1) % queue->max_size;
-    ++queue->size;
+    if (future->is_queued) // already waiting to be progressed
+        return;
+    future->is_queued = true;
+    future->next_queued = NULL;
+    if (queue->tail)
+        queue->tail->next_queued = future;
+    else
+        queue->head = future;
+    queue->tail = future;
+    if (++queue->size > queue->high_water)
+        queue->high_water = queue->size;
 }
 
 Future *queue_dequeue_future(Queue *queue) {
     if (queue_empty(queue))
         return NULL;
-    Future *ret = queue->data[queue->tail];
-    queue->tail = (queue->tail + 1) % queue->max_size;
+    Future *ret = queue->head;
+    queue->head = ret->next_queued;
+    if (!queue->head)
+        queue->tail = NULL;
+    ret->next_queued = NULL;
+    ret->is_queued = false;
     --queue->size;
     return ret;
 }
 
-void queue_destroy(Queue *queue) {
-    free(queue->data);
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
 
 struct Executor {
     Queue queue;
     Mio *mio;
-    size_t needed_tasks;
+    size_t max_live_tasks; // soft limit of live tasks (0 - no limit)
+    size_t needed_tasks; // number of spawned tasks
+    size_t finished_tasks; // number of spawned tasks that have completed
+    size_t poll_interval; // max number of progress calls between two I/O polls (0 - no limit)
+    uint64_t poll_interval_ns; // max time between two I/O polls (0 - no limit)
+    size_t calls_since_poll; // progress calls since the last I/O poll
+    uint64_t last_poll_ns; // time of the last I/O poll
+    Future *live; // list of live tasks (linked through prev_live / next_live), newest first
+    bool shutting_down; // whether executor_shutdown() has been called
+    Future *current; // task that is currently being progressed (NULL if none)
+    bool lifo_enabled; // whether tasks woken by other tasks go to lifo_slot
+    Future *lifo_slot; // task to be progressed next, before the ones in the queue
+    unsigned lifo_streak; // number of consecutive tasks taken from lifo_slot
+    unsigned task_budget; // budget of a single progress call (0 - unlimited)
+    unsigned budget_left; // budget left for the task that is currently being progressed
+    uint64_t now_ns; // clock read at the end of the last progress call or poll
+    ExecutorStats stats; // all but the queue high-water mark, Mio and stall counters
+    StallDetector *stall_detector; // NULL if disabled
+    OwnedSlab owned_slab; // storage of the tasks spawned with executor_spawn_owned()
+    Tracer tracer;
 };
 
 
-Executor* executor_create(size_t max_queue_size) {
+// Create an executor on a real (or simulated, with the given seed) Mio
+static Executor *executor_create_with_mio(size_t max_queue_size, bool simulated, uint64_t seed) {
     Executor *executor = (Executor*)malloc(sizeof(Executor));
     if (!executor)
         fatal("Allocation failed\n");
-    queue_init(&executor->queue, max_queue_size);
-    executor->mio = mio_create(executor);
+    queue_init(&executor->queue);
+    tracer_init(&executor->tracer); // before Mio, which records its events there, too
+    executor->mio = simulated ? mio_create_simulated(executor, seed) : mio_create(executor);
     if (!executor->mio)
         fatal("Mio construction failed\n");
+    executor->max_live_tasks = max_queue_size;
     executor->needed_tasks = 0;
+    executor->finished_tasks = 0;
+    executor->poll_interval = EXECUTOR_DEFAULT_POLL_INTERVAL;
+    executor->poll_interval_ns = (uint64_t)EXECUTOR_DEFAULT_POLL_INTERVAL_US * 1000;
+    executor->calls_since_poll = 0;
+    executor->last_poll_ns = 0;
+    executor->live = NULL;
+    executor->shutting_down = false;
+    executor->current = NULL;
+    executor->lifo_enabled = false;
+    executor->lifo_slot = NULL;
+    executor->lifo_streak = 0;
+    executor->task_budget = EXECUTOR_DEFAULT_TASK_BUDGET;
+    executor->budget_left = 0;
+    executor->now_ns = monotonic_ns();
+    executor->stats = (ExecutorStats) { 0 };
+    executor->stall_detector = NULL;
+    owned_slab_init(&executor->owned_slab);
     return executor;
 }
 
+Executor* executor_create(size_t max_queue_size) {
+    return executor_create_with_mio(max_queue_size, false, 0);
+}
+
+Executor* executor_create_simulated(size_t max_queue_size, uint64_t seed) {
+    Executor *executor = executor_create_with_mio(max_queue_size, true, seed);
+    executor->poll_interval_ns = 0; // polls depending on real time would break determinism
+    return executor;
+}
+
+Mio* executor_mio(Executor* executor) {
+    return executor->mio;
+}
+
+void executor_set_poll_interval(Executor* executor, size_t progress_calls, unsigned long interval_us) {
+    executor->poll_interval = progress_calls;
+    executor->poll_interval_ns = (uint64_t)interval_us * 1000;
+}
+
+void executor_set_task_budget(Executor* executor, unsigned budget) {
+    executor->task_budget = budget;
+}
+
+void executor_set_lifo_slot(Executor* executor, bool enabled) {
+    executor->lifo_enabled = enabled;
+    if (!enabled && executor->lifo_slot) {
+        Future *fut = executor->lifo_slot;
+        executor->lifo_slot = NULL;
+        fut->is_queued = false;
+        queue_enqueue_future(&executor->queue, fut);
+    }
+}
+
+void executor_set_busy_poll(Executor* executor, unsigned spin_us) {
+    mio_set_busy_poll(executor->mio, spin_us);
+}
+
+void executor_set_stall_threshold(Executor* executor, unsigned long threshold_us) {
+    if (executor->stall_detector) {
+        // Keep the counts of the previous detector
+        executor->stats.stalls += atomic_load(&executor->stall_detector->stalls);
+        uint64_t max_stall_ns = atomic_load(&executor->stall_detector->max_stall_ns);
+        if (max_stall_ns > executor->stats.max_stall_ns)
+            executor->stats.max_stall_ns = max_stall_ns;
+        stall_detector_destroy(executor->stall_detector);
+        executor->stall_detector = NULL;
+    }
+    if (threshold_us != 0)
+        executor->stall_detector = stall_detector_create((uint64_t)threshold_us * 1000);
+}
+
+bool executor_budget_consume(Executor* executor) {
+    if (executor->task_budget == 0)
+        return true;
+    if (executor->budget_left == 0)
+        return false;
+    --executor->budget_left;
+    return true;
+}
+
+Tracer *executor_tracer(Executor *executor) {
+#ifdef EXECUTOR_TRACE
+    return &executor->tracer;
+#else
+    return NULL;
+#endif
+}
+
+int executor_trace_dump(Executor* executor, FILE* out) {
+    return tracer_dump_chrome(&executor->tracer, out);
+}
+
+void executor_stats(Executor const* executor, ExecutorStats* stats) {
+    *stats = executor->stats;
+    stats->queue_high_water = executor->queue.high_water;
+    mio_stats(executor->mio, &stats->mio);
+    if (executor->stall_detector) {
+        stats->stalls += atomic_load(&executor->stall_detector->stalls);
+        uint64_t max_stall_ns = atomic_load(&executor->stall_detector->max_stall_ns);
+        if (max_stall_ns > stats->max_stall_ns)
+            stats->max_stall_ns = max_stall_ns;
+    }
+}
+
+// Remember that the I/O events have just been collected
+static void executor_mark_polled(Executor *executor) {
+    executor->calls_since_poll = 0;
+    executor->now_ns = executor->last_poll_ns = monotonic_ns();
+}
+
+// Check whether the ready tasks have been running long enough to look for I/O events
+static bool executor_poll_due(Executor *executor) {
+    if (executor->poll_interval != 0 && executor->calls_since_poll >= executor->poll_interval)
+        return true;
+    return executor->poll_interval_ns != 0
+        && executor->now_ns - executor->last_poll_ns >= executor->poll_interval_ns;
+}
+
+// Remember when a task is being queued, unless it is already waiting in the queue
+static void executor_stamp_queued(Executor *executor, Future *fut) {
+    if (fut->is_queued)
+        return;
+    // During a progress call the clock is not read again: the wait is measured from its start
+    fut->woken_ns = executor->current ? executor->now_ns : monotonic_ns();
+}
+
+static unsigned latency_bucket(uint64_t ns) {
+    unsigned bucket = 63 - __builtin_clzll(ns | 1);
+    return bucket < EXECUTOR_LATENCY_BUCKETS ? bucket : EXECUTOR_LATENCY_BUCKETS - 1;
+}
+
 // Wake a task that had already been spawned
 void waker_wake(Waker* waker) {
-    Executor *tmp = (Executor*)(waker->executor);
-    queue_enqueue_future(&tmp->queue, waker->future);
+    Executor *executor = (Executor*)(waker->executor);
+    Future *fut = waker->future;
+    ++executor->stats.wakes;
+    TRACE(&executor->tracer, TRACE_WAKE, fut, (uintptr_t)executor->current);
+    executor_stamp_queued(executor, fut);
+    if (executor->lifo_enabled && executor->current && executor->current != fut && !fut->is_queued) {
+        // Woken by another task: progress it next; the previous occupant of the slot goes to the queue
+        Future *prev = executor->lifo_slot;
+        fut->is_queued = true;
+        executor->lifo_slot = fut;
+        if (prev) {
+            prev->is_queued = false;
+            queue_enqueue_future(&executor->queue, prev);
+        }
+        return;
+    }
+    queue_enqueue_future(&executor->queue, fut);
+}
+
+// Take the next task to be progressed (NULL if there are none)
+static Future *executor_next_task(Executor *executor) {
+    Future *fut = executor->lifo_slot;
+    if (fut) {
+        executor->lifo_slot = NULL;
+        fut->is_queued = false;
+        if (executor->lifo_streak < EXECUTOR_MAX_LIFO_STREAK) {
+            ++executor->lifo_streak;
+            return fut;
+        }
+        // Let the tasks waiting in the queue progress first
+        queue_enqueue_future(&executor->queue, fut);
+    }
+    executor->lifo_streak = 0;
+    return queue_dequeue_future(&executor->queue);
+}
+
+static void executor_link_live(Executor *executor, Future *fut) {
+    fut->prev_live = NULL;
+    fut->next_live = executor->live;
+    if (executor->live)
+        executor->live->prev_live = fut;
+    executor->live = fut;
+}
+
+static void executor_unlink_live(Executor *executor, Future *fut) {
+    if (fut->prev_live)
+        fut->prev_live->next_live = fut->next_live;
+    else
+        executor->live = fut->next_live;
+    if (fut->next_live)
+        fut->next_live->prev_live = fut->prev_live;
+    fut->prev_live = fut->next_live = NULL;
 }
 
 // Spawn a new independent task and update needeed task counter
 void executor_spawn(Executor* executor, Future* fut) {
     fut->is_active = true;
+    executor_link_live(executor, fut);
+    executor_stamp_queued(executor, fut);
+    ++executor->stats.spawned;
+    TRACE(&executor->tracer, TRACE_SPAWN, fut, 0);
     queue_enqueue_future(&executor->queue, fut);
     ++executor->needed_tasks;
 }
 
+void executor_spawn_owned(Executor* executor, Future const* fut, size_t size, JoinHandle* handle) {
+    executor_spawn(executor, owned_task_create(&executor->owned_slab, fut, size, handle));
+}
+
+size_t executor_owned_slab_bytes(Executor const* executor) {
+    return executor->owned_slab.bytes;
+}
+
+int executor_try_spawn(Executor* executor, Future* fut) {
+    if (executor->shutting_down) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    if (executor->max_live_tasks != 0
+            && executor->needed_tasks - executor->finished_tasks >= executor->max_live_tasks) {
+        errno = EAGAIN;
+        return -1;
+    }
+    executor_spawn(executor, fut);
+    return 0;
+}
+
+// Progress the next ready task, if there is one: returns it (NULL if none was ready),
+// storing the state it returned in *state
+static Future *executor_run_next(Executor *executor, FutureState *state) {
+    Future *fut = executor_next_task(executor);
+    if (!fut)
+        return NULL;
+    Waker waker;
+    waker.executor = (void*)executor;
+    waker.future = fut;
+    executor->budget_left = executor->task_budget;
+    executor->current = fut;
+    uint64_t start_ns = executor->now_ns;
+    uint64_t waited_ns = start_ns > fut->woken_ns ? start_ns - fut->woken_ns : 0;
+    TaskStats *task_stats = fut->stats;
+    TRACE(&executor->tracer, TRACE_PROGRESS_BEGIN, fut, (uintptr_t)fut->progress);
+    if (executor->stall_detector)
+        stall_detector_begin(executor->stall_detector, fut, start_ns);
+    FutureState fs = (*fut->progress)(fut, executor->mio, waker);
+    if (executor->stall_detector)
+        stall_detector_end(executor->stall_detector);
+    TRACE(&executor->tracer, TRACE_PROGRESS_END, fut, fs);
+    executor->now_ns = monotonic_ns();
+    executor->current = NULL;
+    uint64_t progress_ns = executor->now_ns - start_ns;
+    ++executor->stats.progress_calls;
+    executor->stats.progress_ns += progress_ns;
+    ++executor->stats.wake_to_run_ns[latency_bucket(waited_ns)];
+    if (task_stats) {
+        ++task_stats->progress_calls;
+        task_stats->progress_ns += progress_ns;
+        task_stats->wake_to_run_ns += waited_ns;
+        if (progress_ns > task_stats->max_progress_ns)
+            task_stats->max_progress_ns = progress_ns;
+    }
+    if (fs != FUTURE_PENDING) { // future finished computation
+        ++executor->finished_tasks;
+        ++executor->stats.completed;
+        fut->is_active = false;
+        executor_unlink_live(executor, fut);
+        if (owned_task_is(fut)) // nobody else refers to it but its JoinHandle
+            owned_task_release_completed(fut);
+    }
+    ++executor->calls_since_poll;
+    // Tasks that keep waking themselves up must not starve the ones waiting for I/O
+    if (executor_poll_due(executor)) {
+        mio_poll_timeout(executor->mio, 0);
+        executor_mark_polled(executor);
+    }
+    *state = fs;
+    return fut;
+}
+
+// Wait for I/O events when no task is ready
+static int executor_wait(Executor *executor, int timeout_ms) {
+    log_flush(); // while there is nothing better to do
+    int ret = mio_poll_timeout(executor->mio, timeout_ms);
+    executor_mark_polled(executor);
+    return ret;
+}
+
 void executor_run(Executor* executor) {
-    int finished = 0;
+    executor_mark_polled(executor);
     // Try to progress tasks until all spawned tasks have been finished
-    while (finished < executor->needed_tasks) {
-        if (!queue_empty(&executor->queue)) {
-            Future *fut = queue_dequeue_future(&executor->queue);
-            Waker waker;
-            waker.executor = (void*)executor;
-            waker.future = fut;
-            FutureState fs = (*fut->progress)(fut, executor->mio, waker);
-            if (fs != FUTURE_PENDING) { // future finished computation
-                ++finished;
-                fut->is_active = false;
-            }
-        } else { // No active tasks but some are still pending
-            mio_poll(executor->mio);
+    while (executor->finished_tasks < executor->needed_tasks) {
+        FutureState state;
+        if (!executor_run_next(executor, &state)) // No active tasks but some are still pending
+            executor_wait(executor, -1);
+    }
+}
+
+bool executor_is_idle(Executor const* executor) {
+    return !executor->lifo_slot && executor->queue.size == 0;
+}
+
+size_t executor_live_tasks(Executor const* executor) {
+    return executor->needed_tasks - executor->finished_tasks;
+}
+
+size_t executor_run_until_idle(Executor* executor) {
+    size_t calls = 0;
+    executor_mark_polled(executor);
+    for (;;) {
+        FutureState state;
+        while (executor_run_next(executor, &state))
+            ++calls;
+        // Nothing is ready: take the I/O events that are already pending, if any
+        int n_ready = mio_poll_timeout(executor->mio, 0);
+        executor_mark_polled(executor);
+        if (n_ready <= 0 || executor_is_idle(executor))
+            return calls;
+    }
+}
+
+int executor_tick(Executor* executor, int timeout_ms) {
+    if (executor_is_idle(executor)) {
+        if (executor_wait(executor, timeout_ms) == -1)
+            return -1;
+    } else {
+        mio_poll_timeout(executor->mio, 0);
+        executor_mark_polled(executor);
+    }
+    // A single round: tasks woken during it are left for the next tick, so they go to the end
+    // of the queue, behind the ready ones, instead of jumping ahead of them to the LIFO slot
+    size_t ready = executor->queue.size + (executor->lifo_slot ? 1 : 0);
+    bool lifo_enabled = executor->lifo_enabled;
+    executor->lifo_enabled = false;
+    int calls = 0;
+    FutureState state;
+    while ((size_t)calls < ready && executor_run_next(executor, &state))
+        ++calls;
+    executor->lifo_enabled = lifo_enabled;
+    return calls;
+}
+
+FutureState executor_block_on(Executor* executor, Future* fut) {
+    executor_spawn(executor, fut);
+    executor_mark_polled(executor);
+    for (;;) {
+        FutureState state;
+        Future *progressed = executor_run_next(executor, &state);
+        if (progressed == fut && state != FUTURE_PENDING)
+            return state;
+        if (!progressed)
+            executor_wait(executor, -1);
+    }
+}
+
+// Drop the tasks that are being cancelled from the run queue and the LIFO slot
+static void executor_dequeue_cancelled(Executor *executor) {
+    if (executor->lifo_slot && executor->lifo_slot->is_active) {
+        executor->lifo_slot->is_queued = false;
+        executor->lifo_slot = NULL;
+    }
+    Queue kept;
+    queue_init(&kept);
+    kept.high_water = executor->queue.high_water;
+    while (!queue_empty(&executor->queue)) {
+        Future *fut = queue_dequeue_future(&executor->queue);
+        if (!fut->is_active) // e.g. a subtask wrapper of a SelectFuture, freed by executor_destroy()
+            queue_enqueue_future(&kept, fut);
+    }
+    executor->queue = kept;
+}
+
+size_t executor_shutdown(Executor* executor, unsigned long timeout_ms, ExecutorCancelFn on_cancel, void* arg) {
+    executor->shutting_down = true;
+    executor_mark_polled(executor);
+    // On the clock of Mio (virtual if it is simulated), saturated so that a huge timeout
+    // (e.g. ULONG_MAX) means no deadline instead of wrapping around
+    uint64_t start_ns = mio_now_ns(executor->mio);
+    uint64_t deadline_ns = UINT64_MAX;
+    if (timeout_ms < (UINT64_MAX - start_ns) / 1000000)
+        deadline_ns = start_ns + (uint64_t)timeout_ms * 1000000;
+    // Drain: run as usual, but never wait for I/O past the deadline
+    uint64_t now_ns;
+    while (executor->finished_tasks < executor->needed_tasks
+        && (now_ns = mio_now_ns(executor->mio)) < deadline_ns) {
+        FutureState state;
+        if (executor_run_next(executor, &state))
+            continue;
+        if (mio_registered_count(executor->mio) == 0 && mio_armed_timers(executor->mio) == 0)
+            break; // nothing is ready and nothing can wake a task up anymore
+        uint64_t left_ns = deadline_ns - now_ns;
+        uint64_t left_ms = left_ns / 1000000 + (left_ns % 1000000 != 0);
+        executor_wait(executor, left_ms < INT_MAX ? (int)left_ms : INT_MAX);
+    }
+
+    // Cancel the stragglers
+    size_t cancelled = 0;
+    executor_dequeue_cancelled(executor);
+    while (executor->live) {
+        Future *fut = executor->live;
+        executor_unlink_live(executor, fut);
+        fut->is_active = false;
+        fut->errcode = ECANCELED;
+        ++executor->finished_tasks;
+        ++executor->stats.cancelled;
+        ++cancelled;
+        if (owned_task_is(fut)) {
+            if (on_cancel)
+                on_cancel(owned_task_cancel(fut), arg);
+            owned_task_release_completed(fut);
+        } else if (on_cancel) {
+            on_cancel(fut, arg);
         }
     }
+    // No task is left to handle the events of the descriptors registered by the cancelled ones
+    mio_unregister_all(executor->mio);
+    return cancelled;
+}
+
+uint64_t executor_now_ns(Executor const* executor) {
+    return mio_now_ns(executor->mio);
+}
+
+int executor_next_timeout_ms(Executor const* executor) {
+    return mio_next_timeout_ms(executor->mio);
+}
+
+int executor_poll_fd(Executor const* executor) {
+    return mio_fd(executor->mio);
 }
 
 void executor_destroy(Executor* executor) {
     // All Futures remaining are unneded subtasks of SelectFutures;
     // Only now can we free their wrappers
+    executor_set_lifo_slot(executor, false);
     while (!queue_empty(&executor->queue)) {
         Future *fut = queue_dequeue_future(&executor->queue);
         Waker waker;
         (*fut->progress)(fut, NULL, waker);
     }
-    queue_destroy(&executor->queue);
+    executor_set_stall_threshold(executor, 0);
+    owned_slab_destroy(&executor->owned_slab);
     mio_destroy(executor->mio);
+    tracer_destroy(&executor->tracer);
     free(executor);
 }
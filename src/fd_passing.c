@@ -0,0 +1,145 @@
+// Required for `sys/socket.h` to contain `MSG_CMSG_CLOEXEC`.
+#define _GNU_SOURCE
+
+#include "fd_passing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "future_examples.h"
+#include "log.h"
+
+// Control buffer of a message with the largest batch of descriptors
+typedef union FdsControl {
+    char buffer[CMSG_SPACE(FD_PASSING_MAX_FDS * sizeof(int))];
+    struct cmsghdr align;
+} FdsControl;
+
+// Wait for the socket to become ready (it stays registered until the future finishes)
+static FutureState fd_passing_wait(Mio *mio, int socket, uint32_t events, bool *registered, Waker waker) {
+    if (!*registered) {
+        ASSERT_SYS_OK(mio_register(mio, socket, events, waker));
+        *registered = true;
+    }
+    return FUTURE_PENDING;
+}
+
+static void fd_passing_unregister(Mio *mio, int socket, bool *registered) {
+    if (*registered)
+        mio_unregister(mio, socket);
+    *registered = false;
+}
+
+// ========================= SendFdsFuture =========================
+
+static FutureState send_fds_future_progress(Future *base, Mio *mio, Waker waker) {
+    SendFdsFuture *self = (SendFdsFuture*)base;
+    char byte = 0;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    FdsControl control;
+    memset(&control, 0, sizeof(control));
+    size_t fds_size = self->n_fds * sizeof(int);
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = CMSG_SPACE(fds_size),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_size);
+    memcpy(CMSG_DATA(cmsg), self->fds, fds_size);
+
+    ssize_t sent = sendmsg(self->socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return fd_passing_wait(mio, self->socket, EPOLLOUT, &self->registered, waker);
+    int err = errno;
+    fd_passing_unregister(mio, self->socket, &self->registered);
+    if (sent == -1) {
+        base->errcode = err;
+        return FUTURE_FAILURE;
+    }
+    LOG_DEBUG("SendFdsFuture %p: sent %zu fds\n", (void*)self, self->n_fds);
+    base->ok = (void*)self->fds;
+    return FUTURE_COMPLETED;
+}
+
+SendFdsFuture send_fds_future_create(int socket, const int* fds, size_t n_fds) {
+    if (n_fds == 0 || n_fds > FD_PASSING_MAX_FDS)
+        fatal("A message passes 1 to %d descriptors, not %zu\n", FD_PASSING_MAX_FDS, n_fds);
+    return (SendFdsFuture) {
+        .base = future_create(send_fds_future_progress),
+        .socket = socket,
+        .fds = fds,
+        .n_fds = n_fds,
+        .registered = false,
+    };
+}
+
+// ========================= RecvFdsFuture =========================
+
+static FutureState recv_fds_future_progress(Future *base, Mio *mio, Waker waker) {
+    RecvFdsFuture *self = (RecvFdsFuture*)base;
+    char byte;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    FdsControl control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        // Not CMSG_SPACE: its padding may fit one more descriptor than the buffer has room for
+        .msg_controllen = CMSG_LEN(self->max_fds * sizeof(int)),
+    };
+    // Close-on-exec atomically, so that a concurrent fork+exec can't leak them
+    ssize_t received = recvmsg(self->socket, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return fd_passing_wait(mio, self->socket, EPOLLIN, &self->registered, waker);
+    int err = errno;
+    fd_passing_unregister(mio, self->socket, &self->registered);
+    if (received <= 0) {
+        base->errcode = received == 0 ? PIPE_FUTURE_ERR_EOF : err;
+        return FUTURE_FAILURE;
+    }
+
+    self->n_fds = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (n > self->max_fds - self->n_fds) // can't happen: the kernel truncates the batch
+            n = self->max_fds - self->n_fds;
+        memcpy(self->fds + self->n_fds, CMSG_DATA(cmsg), n * sizeof(int));
+        self->n_fds += n;
+    }
+    for (size_t i = 0; i < self->n_fds; ++i) {
+        int flags = fcntl(self->fds[i], F_GETFL);
+        ASSERT_SYS_OK(flags);
+        ASSERT_SYS_OK(fcntl(self->fds[i], F_SETFL, flags | O_NONBLOCK));
+    }
+    LOG_DEBUG("RecvFdsFuture %p: received %zu fds\n", (void*)self, self->n_fds);
+    if (msg.msg_flags & MSG_CTRUNC) {
+        base->errcode = FD_PASSING_ERR_TRUNCATED;
+        return FUTURE_FAILURE;
+    }
+    base->ok = self->fds;
+    return FUTURE_COMPLETED;
+}
+
+RecvFdsFuture recv_fds_future_create(int socket, int* fds, size_t max_fds) {
+    if (max_fds == 0 || max_fds > FD_PASSING_MAX_FDS)
+        fatal("A message passes 1 to %d descriptors, not %zu\n", FD_PASSING_MAX_FDS, max_fds);
+    return (RecvFdsFuture) {
+        .base = future_create(recv_fds_future_progress),
+        .socket = socket,
+        .fds = fds,
+        .max_fds = max_fds,
+        .n_fds = 0,
+        .registered = false,
+    };
+}
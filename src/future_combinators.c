@@ -216,6 +216,7 @@ SelectSubFuture* future_select_sub(Future *subtask, SelectFuture *parent, int wh
         return NULL;
     ret->base = future_create(future_select_sub_progress);
     ret->subtask = subtask;
+    ret->parent = parent;
     ret->which = which;
     ret->unneeded = false;
     ret->parent_waker = parent_waker;
@@ -256,3 +257,33 @@ SelectFuture future_select(Future *fut1, Future *fut2) {
         .which_completed = SELECT_COMPLETED_NONE,
     };
 }
+
+static FutureState future_pipeline_progress(Future *base, Mio *mio, Waker waker) {
+    PipelineFuture *self = (PipelineFuture*)base;
+    if (self->current == 0 && self->n_stages > 0 && self->base.arg)
+        self->stages[0]->arg = self->base.arg;
+    // Only the current stage is progressed; the completed ones are never re-entered
+    while (self->current < self->n_stages) {
+        Future *stage = self->stages[self->current];
+        FutureState ret_val = (*stage->progress)(stage, mio, waker);
+        if (ret_val == FUTURE_PENDING)
+            return FUTURE_PENDING;
+        if (ret_val == FUTURE_FAILURE) {
+            self->base.errcode = PIPELINE_FUTURE_ERR_STAGE_FAILED(self->current);
+            return FUTURE_FAILURE;
+        }
+        self->base.ok = stage->ok;
+        if (++self->current < self->n_stages)
+            self->stages[self->current]->arg = stage->ok;
+    }
+    return FUTURE_COMPLETED;
+}
+
+PipelineFuture future_pipeline(Future **stages, size_t n_stages) {
+    return (PipelineFuture) {
+        .base = future_create(future_pipeline_progress),
+        .stages = stages,
+        .n_stages = n_stages,
+        .current = 0,
+    };
+}
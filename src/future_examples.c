@@ -6,15 +6,16 @@
 #include <sys/epoll.h>
 #include <unistd.h>
 
-#include "debug.h"
+#include "log.h"
+#include "executor.h"
 #include "mio.h"
 #include "waker.h"
 
 /** Progress function for ApplyFuture */
-static FutureState apply_future_progress(Future* fut, Mio* mio, Waker waker)
+FutureState apply_future_progress(Future* fut, Mio* mio, Waker waker)
 {
     ApplyFuture* self = (ApplyFuture*)fut;
-    debug("ApplyFuture %p progress. Arg=%p\n", self, self->base.arg);
+    LOG_DEBUG("ApplyFuture %p progress. Arg=%p\n", self, self->base.arg);
 
     self->base.ok = self->func(self->base.arg);
 
@@ -32,16 +33,23 @@ ApplyFuture apply_future_create(void* (*func)(void*))
 }
 
 /** Progress function for PipeReadFuture */
-static FutureState pipe_read_progress(Future* base, Mio* mio, Waker waker)
+FutureState pipe_read_future_progress(Future* base, Mio* mio, Waker waker)
 {
     PipeReadFuture* self = (PipeReadFuture*)base;
-    debug("PipeReadFuture %p progress. read_so_far=%zu, n=%zu\n", self, self->read_so_far, self->n);
+    LOG_DEBUG("PipeReadFuture %p progress. read_so_far=%zu, n=%zu\n", self, self->read_so_far, self->n);
 
     while (self->read_so_far < self->n) {
+        if (!executor_budget_consume(waker.executor)) {
+            // Let other tasks run. The FD stays registered: a readiness event in the meantime
+            // only wakes us again, which has no effect while we are queued, and keeping it
+            // saves an epoll_ctl() pair per yield.
+            waker_wake(&waker);
+            return FUTURE_PENDING;
+        }
         // There are some bytes yet to be read. Try reading from the pipe.
         ssize_t const bytes_read
-            = read(self->fd, self->buffer + self->read_so_far, self->n - self->read_so_far);
-        debug("PipeReadFuture %p: read %zd, errno %s\n", self, bytes_read,
+            = mio_read(mio, self->fd, self->buffer + self->read_so_far, self->n - self->read_so_far);
+        LOG_DEBUG("PipeReadFuture %p: read %zd, errno %s\n", self, bytes_read,
             strerror(bytes_read == -1 ? errno : 0));
 
         if (bytes_read == 0) {
@@ -67,7 +75,7 @@ static FutureState pipe_read_progress(Future* base, Mio* mio, Waker waker)
 PipeReadFuture pipe_read_future_create(int fd, uint8_t* buffer, size_t n)
 {
     return (PipeReadFuture) {
-        .base = future_create(pipe_read_progress),
+        .base = future_create(pipe_read_future_progress),
         .fd = fd,
         .buffer = buffer,
         .n = n,
@@ -76,11 +84,11 @@ PipeReadFuture pipe_read_future_create(int fd, uint8_t* buffer, size_t n)
 }
 
 /** Progress function for PipeWriteFuture */
-static FutureState pipe_write_progress(Future* base, Mio* mio, Waker waker)
+FutureState pipe_write_future_progress(Future* base, Mio* mio, Waker waker)
 {
     PipeWriteFuture* self = (PipeWriteFuture*)base;
     const char* buffer = self->base.arg;
-    debug("PipeWriteFuture %p progress. written_so_far=%zu, n=%zu\n", self, self->written_so_far,
+    LOG_DEBUG("PipeWriteFuture %p progress. written_so_far=%zu, n=%zu\n", self, self->written_so_far,
         self->n);
 
     // If the future was created with stop_on_zero_byte=true,
@@ -94,10 +102,15 @@ static FutureState pipe_write_progress(Future* base, Mio* mio, Waker waker)
     }
 
     while (self->written_so_far < self->n) {
+        if (!executor_budget_consume(waker.executor)) {
+            // Let other tasks run, staying registered.
+            waker_wake(&waker);
+            return FUTURE_PENDING;
+        }
         // There are some bytes yet to be written. Try writing to the pipe.
         ssize_t const bytes_written
-            = write(self->fd, buffer + self->written_so_far, self->n - self->written_so_far);
-        debug("PipeReadFuture %p: write %zd, errno %s\n", self, bytes_written,
+            = mio_write(mio, self->fd, buffer + self->written_so_far, self->n - self->written_so_far);
+        LOG_DEBUG("PipeReadFuture %p: write %zd, errno %s\n", self, bytes_written,
             strerror(bytes_written == -1 ? errno : 0));
 
         if (bytes_written == 0) {
@@ -109,7 +122,7 @@ static FutureState pipe_write_progress(Future* base, Mio* mio, Waker waker)
         } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
             // Could not write from pipe.
             // Register the FD with MIO to watch for writeability.
-            mio_register(mio, self->fd, EPOLLIN, waker);
+            mio_register(mio, self->fd, EPOLLOUT, waker);
             return FUTURE_PENDING;
         }
     }
@@ -123,10 +136,42 @@ static FutureState pipe_write_progress(Future* base, Mio* mio, Waker waker)
 PipeWriteFuture pipe_write_future_create(int fd, size_t n, bool stop_on_zero_byte)
 {
     return (PipeWriteFuture) {
-        .base = future_create(pipe_write_progress),
+        .base = future_create(pipe_write_future_progress),
         .fd = fd,
         .n = n,
         .written_so_far = 0,
         .stop_on_zero_byte = stop_on_zero_byte,
     };
 }
+
+/** Progress function for SleepFuture */
+static FutureState sleep_future_progress(Future* base, Mio* mio, Waker waker)
+{
+    SleepFuture* self = (SleepFuture*)base;
+    uint64_t now = mio_now_ns(mio);
+    if (self->deadline_ns == 0)
+        self->deadline_ns = now + self->duration_ns;
+    if (now >= self->deadline_ns) {
+        mio_timer_disarm(mio, &self->timer); // if woken up by something else
+        return FUTURE_COMPLETED;
+    }
+    mio_timer_arm(mio, &self->timer, self->deadline_ns, waker);
+    return FUTURE_PENDING;
+}
+
+SleepFuture sleep_future_create(uint64_t duration_ns)
+{
+    return (SleepFuture) {
+        .base = future_create(sleep_future_progress),
+        .duration_ns = duration_ns,
+        .deadline_ns = 0,
+        .timer = mio_timer_create(),
+    };
+}
+
+SleepFuture sleep_until_future_create(uint64_t deadline_ns)
+{
+    SleepFuture sleep = sleep_future_create(0);
+    sleep.deadline_ns = deadline_ns;
+    return sleep;
+}
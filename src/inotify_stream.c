@@ -0,0 +1,97 @@
+#include "inotify_stream.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "log.h"
+
+int inotify_stream_open(InotifyStream* stream) {
+    stream->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stream->coalesced = 0;
+    stream->batch = (InotifyBatch) { .events = stream->events, .n_events = 0 };
+    return stream->fd == -1 ? -1 : 0;
+}
+
+int inotify_stream_watch(InotifyStream* stream, const char* path, uint32_t mask) {
+    return inotify_add_watch(stream->fd, path, mask);
+}
+
+int inotify_stream_unwatch(InotifyStream* stream, int wd) {
+    return inotify_rm_watch(stream->fd, wd);
+}
+
+void inotify_stream_close(InotifyStream* stream) {
+    if (stream->fd == -1)
+        return;
+    ASSERT_SYS_OK(close(stream->fd));
+    stream->fd = -1;
+}
+
+// Tell whether a modification of the file of `event` has already been reported in the batch
+// (with no other event of that file since then)
+static bool inotify_modify_reported(InotifyStream *stream, InotifyEvent const *event) {
+    for (size_t i = stream->batch.n_events; i-- > 0;) {
+        InotifyEvent const *prev = &stream->events[i];
+        if (prev->wd != event->wd || strcmp(prev->name, event->name) != 0)
+            continue;
+        return prev->mask == IN_MODIFY;
+    }
+    return false;
+}
+
+// Parse the events of a read of `len` bytes into the batch
+static void inotify_parse(InotifyStream *stream, size_t len) {
+    stream->batch.n_events = 0;
+    for (size_t pos = 0; pos < len;) {
+        struct inotify_event const *raw = (struct inotify_event const*)(stream->buffer + pos);
+        pos += sizeof(struct inotify_event) + raw->len;
+        InotifyEvent event = {
+            .wd = raw->wd,
+            .mask = raw->mask,
+            .cookie = raw->cookie,
+            .name = raw->len > 0 ? raw->name : "",
+        };
+        if (event.mask == IN_MODIFY && inotify_modify_reported(stream, &event)) {
+            ++stream->coalesced;
+            continue;
+        }
+        stream->events[stream->batch.n_events++] = event;
+    }
+}
+
+static FutureState inotify_next_future_progress(Future *base, Mio *mio, Waker waker) {
+    InotifyNextFuture *self = (InotifyNextFuture*)base;
+    InotifyStream *stream = self->stream;
+    // A single read returns as many whole events as fit in the buffer
+    ssize_t bytes_read = read(stream->fd, stream->buffer, sizeof(stream->buffer));
+    if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (!self->registered) {
+            ASSERT_SYS_OK(mio_register(mio, stream->fd, EPOLLIN, waker));
+            self->registered = true;
+        }
+        return FUTURE_PENDING;
+    }
+    if (self->registered)
+        mio_unregister(mio, stream->fd);
+    self->registered = false;
+    if (bytes_read <= 0) {
+        base->errcode = bytes_read == -1 ? errno : EIO;
+        return FUTURE_FAILURE;
+    }
+    inotify_parse(stream, bytes_read);
+    LOG_DEBUG("InotifyNextFuture %p: read %zd bytes, %zu events\n", (void*)self, bytes_read,
+        stream->batch.n_events);
+    base->ok = &stream->batch;
+    return FUTURE_COMPLETED;
+}
+
+InotifyNextFuture inotify_stream_next(InotifyStream* stream) {
+    return (InotifyNextFuture) {
+        .base = future_create(inotify_next_future_progress),
+        .stream = stream,
+        .registered = false,
+    };
+}
@@ -0,0 +1,405 @@
+#include "log.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "err.h"
+
+// Size of the per-thread buffer of records
+#define LOG_BUFFER_SIZE (64 * 1024)
+
+// Longer string arguments are truncated
+#define LOG_MAX_STRING 1024
+
+// Longest conversion specification that is reproduced at flush time (e.g. "%-+#0*.*lld")
+#define LOG_MAX_SPEC 32
+
+// Returned by pack_args() when the arguments don't fit in the buffer
+#define LOG_NO_ROOM ((size_t)-1)
+
+int log_level = LOG_LEVEL_TRACE;
+
+static FILE *log_output = NULL; // NULL - stderr
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER; // so that flushes don't interleave
+
+/**
+ * A record in the buffer is a header followed by the arguments, in the order of conversions:
+ * integers (also '*' widths and precisions) as 8 bytes, doubles as double, long doubles as
+ * long double, strings as a uint16_t length and that many bytes (no terminating zero).
+ * Arguments are stored unaligned and accessed with memcpy.
+ */
+typedef struct LogRecordHeader {
+    uint64_t timestamp_ns;
+    const char *fmt;
+    uint32_t size; // of the whole record, including the header
+    int level;
+} LogRecordHeader;
+
+typedef struct LogBuffer {
+    size_t used;
+    unsigned char data[LOG_BUFFER_SIZE];
+} LogBuffer;
+
+static _Thread_local LogBuffer *thread_buffer = NULL;
+static pthread_key_t buffer_key; // to flush and free the buffers of exiting threads
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+
+typedef enum LengthModifier {
+    LENGTH_NONE, LENGTH_HH, LENGTH_H, LENGTH_L, LENGTH_LL, LENGTH_Z, LENGTH_J, LENGTH_T, LENGTH_BIG_L,
+} LengthModifier;
+
+// A parsed conversion specification
+typedef struct Spec {
+    const char *start; // the '%'
+    const char *end; // just after the conversion character
+    int n_stars; // number of '*' widths and precisions
+    int precision; // -1 if none, or if given by a '*'
+    bool precision_star; // whether the precision is given by a '*' (the last one)
+    LengthModifier length;
+    char conversion; // 0 if the format ends in the middle of the specification
+} Spec;
+
+static const char *level_names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Parse the specification starting at p (which points to a '%')
+static void parse_spec(const char *p, Spec *spec) {
+    spec->start = p++;
+    spec->n_stars = 0;
+    spec->precision = -1;
+    spec->precision_star = false;
+    spec->length = LENGTH_NONE;
+    while (*p && strchr("-+ #0'", *p))
+        ++p;
+    for (int part = 0; part < 2; ++part) { // width, then precision
+        if (part == 1) {
+            if (*p != '.')
+                break;
+            ++p;
+        }
+        if (*p == '*') {
+            ++spec->n_stars;
+            spec->precision_star = part == 1;
+            ++p;
+        } else if (part == 1) {
+            spec->precision = 0; // a lone '.' means 0
+        }
+        while (*p >= '0' && *p <= '9') {
+            if (part == 1 && spec->precision < LOG_MAX_STRING)
+                spec->precision = spec->precision * 10 + (*p - '0');
+            ++p;
+        }
+    }
+    switch (*p) {
+    case 'h':
+        spec->length = p[1] == 'h' ? LENGTH_HH : LENGTH_H;
+        p += spec->length == LENGTH_HH ? 2 : 1;
+        break;
+    case 'l':
+        spec->length = p[1] == 'l' ? LENGTH_LL : LENGTH_L;
+        p += spec->length == LENGTH_LL ? 2 : 1;
+        break;
+    case 'z': spec->length = LENGTH_Z; ++p; break;
+    case 'j': spec->length = LENGTH_J; ++p; break;
+    case 't': spec->length = LENGTH_T; ++p; break;
+    case 'L': spec->length = LENGTH_BIG_L; ++p; break;
+    default: break;
+    }
+    spec->conversion = *p;
+    spec->end = *p ? p + 1 : p;
+}
+
+static bool is_signed_conversion(char c) {
+    return c == 'd' || c == 'i';
+}
+
+static bool is_unsigned_conversion(char c) {
+    return c == 'u' || c == 'o' || c == 'x' || c == 'X';
+}
+
+static bool is_float_conversion(char c) {
+    return c && strchr("fFeEgGaA", c);
+}
+
+static void put(unsigned char **out, const void *src, size_t size) {
+    memcpy(*out, src, size);
+    *out += size;
+}
+
+static void get(const unsigned char **in, void *dst, size_t size) {
+    memcpy(dst, *in, size);
+    *in += size;
+}
+
+// Serialize the arguments into out (of the given capacity);
+// returns the number of bytes written, or LOG_NO_ROOM if they don't fit.
+static size_t pack_args(unsigned char *out, size_t capacity, const char *fmt, va_list args) {
+    unsigned char *p = out;
+    unsigned char *limit = out + capacity;
+    for (const char *c = fmt; *c; ++c) {
+        if (*c != '%')
+            continue;
+        if (c[1] == '%') {
+            ++c;
+            continue;
+        }
+        Spec spec;
+        parse_spec(c, &spec);
+        c = spec.end - 1;
+        if (p + spec.n_stars * sizeof(int64_t) + sizeof(long double) + 2 + LOG_MAX_STRING > limit)
+            return LOG_NO_ROOM;
+        int64_t star = 0;
+        for (int i = 0; i < spec.n_stars; ++i) {
+            star = va_arg(args, int);
+            put(&p, &star, sizeof(star));
+        }
+        if (spec.precision_star) // a negative one is taken as if it were omitted
+            spec.precision = star < 0 ? -1 : star < LOG_MAX_STRING ? (int)star : LOG_MAX_STRING;
+        if (is_signed_conversion(spec.conversion) || spec.conversion == 'c') {
+            int64_t value;
+            switch (spec.length) {
+            case LENGTH_L: value = va_arg(args, long); break;
+            case LENGTH_LL: value = va_arg(args, long long); break;
+            case LENGTH_Z: value = va_arg(args, size_t); break;
+            case LENGTH_J: value = va_arg(args, intmax_t); break;
+            case LENGTH_T: value = va_arg(args, ptrdiff_t); break;
+            default: value = va_arg(args, int); break;
+            }
+            put(&p, &value, sizeof(value));
+        } else if (is_unsigned_conversion(spec.conversion)) {
+            uint64_t value;
+            switch (spec.length) {
+            case LENGTH_L: value = va_arg(args, unsigned long); break;
+            case LENGTH_LL: value = va_arg(args, unsigned long long); break;
+            case LENGTH_Z: value = va_arg(args, size_t); break;
+            case LENGTH_J: value = va_arg(args, uintmax_t); break;
+            case LENGTH_T: value = va_arg(args, ptrdiff_t); break;
+            default: value = va_arg(args, unsigned); break;
+            }
+            put(&p, &value, sizeof(value));
+        } else if (is_float_conversion(spec.conversion)) {
+            if (spec.length == LENGTH_BIG_L) {
+                long double value = va_arg(args, long double);
+                put(&p, &value, sizeof(value));
+            } else {
+                double value = va_arg(args, double);
+                put(&p, &value, sizeof(value));
+            }
+        } else if (spec.conversion == 's') {
+            const char *str = va_arg(args, const char*);
+            if (!str)
+                str = "(null)";
+            // Like printf, don't read past the precision: the string needn't be terminated then
+            size_t max_len = LOG_MAX_STRING;
+            if (spec.precision >= 0 && (size_t)spec.precision < max_len)
+                max_len = spec.precision;
+            uint16_t len = strnlen(str, max_len);
+            put(&p, &len, sizeof(len));
+            put(&p, str, len);
+        } else if (spec.conversion == 'p' || spec.conversion == 'n') {
+            void *ptr = va_arg(args, void*);
+            put(&p, &ptr, sizeof(ptr));
+        } else if (!spec.conversion) {
+            break;
+        }
+    }
+    return p - out;
+}
+
+// Copy the specification to buf, replacing '*'s with the given values
+static void render_spec(Spec const *spec, const int64_t *stars, char *buf) {
+    size_t len = 0;
+    int star = 0;
+    for (const char *c = spec->start; c < spec->end && len < LOG_MAX_SPEC - 12; ++c) {
+        if (*c == '*')
+            len += snprintf(buf + len, LOG_MAX_SPEC - len, "%d", (int)stars[star++]);
+        else
+            buf[len++] = *c;
+    }
+    buf[len] = '\0';
+}
+
+static void format_prefix(FILE *out, uint64_t ns, int level) {
+    fprintf(out, "[%llu.%06llu %s] ", (unsigned long long)(ns / 1000000000),
+        (unsigned long long)(ns % 1000000000 / 1000), level_names[level]);
+}
+
+static void format_record(FILE *out, LogRecordHeader const *header, const unsigned char *args) {
+    format_prefix(out, header->timestamp_ns, header->level);
+    const char *literal = header->fmt;
+    for (const char *c = header->fmt; *c; ++c) {
+        if (*c != '%')
+            continue;
+        fwrite(literal, 1, c - literal, out);
+        if (c[1] == '%') {
+            fputc('%', out);
+            literal = ++c + 1;
+            continue;
+        }
+        Spec spec;
+        parse_spec(c, &spec);
+        c = spec.end - 1;
+        literal = spec.end;
+        if (!spec.conversion)
+            break;
+        int64_t stars[2] = { 0, 0 };
+        for (int i = 0; i < spec.n_stars; ++i)
+            get(&args, &stars[i], sizeof(stars[i]));
+        char buf[LOG_MAX_SPEC];
+        render_spec(&spec, stars, buf);
+        if (is_signed_conversion(spec.conversion) || spec.conversion == 'c') {
+            int64_t value;
+            get(&args, &value, sizeof(value));
+            switch (spec.length) {
+            case LENGTH_L: fprintf(out, buf, (long)value); break;
+            case LENGTH_LL: fprintf(out, buf, (long long)value); break;
+            case LENGTH_Z: fprintf(out, buf, (size_t)value); break;
+            case LENGTH_J: fprintf(out, buf, (intmax_t)value); break;
+            case LENGTH_T: fprintf(out, buf, (ptrdiff_t)value); break;
+            default: fprintf(out, buf, (int)value); break;
+            }
+        } else if (is_unsigned_conversion(spec.conversion)) {
+            uint64_t value;
+            get(&args, &value, sizeof(value));
+            switch (spec.length) {
+            case LENGTH_L: fprintf(out, buf, (unsigned long)value); break;
+            case LENGTH_LL: fprintf(out, buf, (unsigned long long)value); break;
+            case LENGTH_Z: fprintf(out, buf, (size_t)value); break;
+            case LENGTH_J: fprintf(out, buf, (uintmax_t)value); break;
+            case LENGTH_T: fprintf(out, buf, (ptrdiff_t)value); break;
+            default: fprintf(out, buf, (unsigned)value); break;
+            }
+        } else if (is_float_conversion(spec.conversion)) {
+            if (spec.length == LENGTH_BIG_L) {
+                long double value;
+                get(&args, &value, sizeof(value));
+                fprintf(out, buf, value);
+            } else {
+                double value;
+                get(&args, &value, sizeof(value));
+                fprintf(out, buf, value);
+            }
+        } else if (spec.conversion == 's') {
+            uint16_t len;
+            get(&args, &len, sizeof(len));
+            // Print the copy with the original flags, width and precision
+            char str[LOG_MAX_STRING + 1];
+            get(&args, str, len);
+            str[len] = '\0';
+            fprintf(out, buf, str);
+        } else if (spec.conversion == 'p') {
+            void *ptr;
+            get(&args, &ptr, sizeof(ptr));
+            fprintf(out, buf, ptr);
+        } else if (spec.conversion == 'n') {
+            void *ptr;
+            get(&args, &ptr, sizeof(ptr));
+        } else { // unknown conversion, print it as it is
+            fwrite(spec.start, 1, spec.end - spec.start, out);
+        }
+    }
+    fputs(literal, out);
+}
+
+static void flush_buffer(LogBuffer *buffer) {
+    if (buffer->used == 0)
+        return;
+    FILE *out = log_output ? log_output : stderr;
+    pthread_mutex_lock(&output_mutex);
+    for (size_t pos = 0; pos < buffer->used;) {
+        LogRecordHeader header;
+        memcpy(&header, buffer->data + pos, sizeof(header));
+        format_record(out, &header, buffer->data + pos + sizeof(header));
+        pos += header.size;
+    }
+    fflush(out);
+    pthread_mutex_unlock(&output_mutex);
+    buffer->used = 0;
+}
+
+static void destroy_buffer(void *arg) {
+    LogBuffer *buffer = (LogBuffer*)arg;
+    flush_buffer(buffer);
+    free(buffer);
+    thread_buffer = NULL;
+}
+
+static void flush_at_exit(void) {
+    log_flush();
+}
+
+static void create_buffer_key(void) {
+    ASSERT_ZERO(pthread_key_create(&buffer_key, destroy_buffer));
+    atexit(flush_at_exit);
+}
+
+static LogBuffer *get_buffer(void) {
+    if (thread_buffer)
+        return thread_buffer;
+    pthread_once(&buffer_key_once, create_buffer_key);
+    thread_buffer = (LogBuffer*)malloc(sizeof(LogBuffer));
+    if (!thread_buffer)
+        fatal("Allocation failed\n");
+    thread_buffer->used = 0;
+    ASSERT_ZERO(pthread_setspecific(buffer_key, thread_buffer));
+    return thread_buffer;
+}
+
+void log_set_level(int level) {
+    log_level = level;
+}
+
+void log_set_output(FILE* out) {
+    log_output = out;
+}
+
+void log_flush(void) {
+    if (thread_buffer)
+        flush_buffer(thread_buffer);
+}
+
+void log_record(int level, const char* fmt, ...) {
+    if (level < LOG_LEVEL_TRACE || level > LOG_LEVEL_ERROR)
+        return;
+    LogBuffer *buffer = get_buffer();
+    if (LOG_BUFFER_SIZE - buffer->used < LOG_BUFFER_SIZE / 2)
+        flush_buffer(buffer); // keep room for the largest possible record
+
+    LogRecordHeader header = {
+        .timestamp_ns = realtime_ns(),
+        .fmt = fmt,
+        .level = level,
+    };
+    va_list args;
+    va_start(args, fmt);
+    size_t args_size = pack_args(buffer->data + buffer->used + sizeof(header),
+        LOG_BUFFER_SIZE - buffer->used - sizeof(header), fmt, args);
+    va_end(args);
+    if (args_size == LOG_NO_ROOM) { // too many arguments to buffer, write it out directly
+        flush_buffer(buffer);
+        FILE *out = log_output ? log_output : stderr;
+        pthread_mutex_lock(&output_mutex);
+        format_prefix(out, header.timestamp_ns, level);
+        va_start(args, fmt);
+        vfprintf(out, fmt, args);
+        va_end(args);
+        pthread_mutex_unlock(&output_mutex);
+        return;
+    }
+    header.size = sizeof(header) + args_size;
+    memcpy(buffer->data + buffer->used, &header, sizeof(header));
+    buffer->used += header.size;
+    if (level == LOG_LEVEL_ERROR)
+        flush_buffer(buffer);
+}
@@ -1,97 +1,472 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
 #include "mio.h"
 
+#include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 
-#include "debug.h"
+#include "log.h"
 #include "executor.h"
+#include "mio_internal.h"
+#include "trace.h"
 #include "waker.h"
 #include "err.h"
 
 // Structure to handle OS communication and descriptor tracking
 
-// Maximum number of events to handle per epoll_wait call.
-#define MAX_EVENTS 64
+// Initial number of events to handle per epoll_wait call.
+#define MIN_EVENTS 64
+
+// Maximum number of events to handle per epoll_wait call;
+// the batch grows up to that size when the polls keep filling it up.
+#define MAX_EVENTS 4096
+
+// Number of consecutive polls filling less than a quarter of the batch, after which it shrinks
+#define SHRINK_AFTER_POLLS 256
+
+#ifndef EPIOCSPARAMS
+// Kernel per-epoll busy-poll parameters (Linux 6.9), missing from older headers
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
 
 // Maximum number of descriptors that can be registered in epoll instance
 #define MAX_DESCRIPTORS 1048577
 
-struct Mio {
-    struct epoll_event dummy; // dummy epoll_event for portability
-    // so that a non-NULL pointer can be passed to epoll_ctl with EPOLL_CTL_DEL option
-    Executor *executor;
-    int epfd; // descriptor of epoll instance
-    struct epoll_event events[MAX_EVENTS]; // helper array for epoll_wait
-    int n_descriptors; // number of registered fds
-};
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-// Create a new Mio instance
-Mio* mio_create(Executor* executor) {
+// Allocate a Mio instance without a backend
+static Mio *mio_alloc(Executor *executor) {
     Mio *ret = (Mio*)malloc(sizeof(Mio));
     if (!ret)
         fatal("Allocation failed\n");
     ret->executor = executor;
+    ret->epfd = -1;
+    ret->events = NULL;
+    ret->max_events = 0;
+    ret->underused_polls = 0;
+    ret->busy_poll_ns = 0;
+    ret->n_descriptors = 0;
+    ret->registered = NULL;
+    ret->registered_size = 0;
+    ret->timers = NULL;
+    ret->n_timers = 0;
+    ret->timers_capacity = 0;
+    ret->stats = (MioStats) { 0 };
+    ret->tracer = executor_tracer(executor);
+    ret->sim = NULL;
+    return ret;
+}
+
+// Create a new Mio instance
+Mio* mio_create(Executor* executor) {
+    Mio *ret = mio_alloc(executor);
     ret->epfd = epoll_create(MAX_DESCRIPTORS);
     ASSERT_SYS_OK(ret->epfd);
-    ret->n_descriptors = 0;
+    ret->events = (struct epoll_event*)malloc(MIN_EVENTS * sizeof(struct epoll_event));
+    if (!ret->events)
+        fatal("Allocation failed\n");
+    ret->max_events = MIN_EVENTS;
     return ret;
 }
 
+Mio* mio_create_simulated(Executor* executor, uint64_t seed) {
+    Mio *ret = mio_alloc(executor);
+    ret->sim = mio_sim_create(seed);
+    return ret;
+}
+
+bool mio_is_simulated(Mio const* mio) {
+    return mio->sim != NULL;
+}
+
 // Destroy a Mio instance
 void mio_destroy(Mio* mio) {
-    close(mio->epfd);
+    if (mio->epfd != -1)
+        close(mio->epfd);
+    if (mio->sim)
+        mio_sim_destroy(mio->sim);
+    free(mio->events);
+    free(mio->registered);
+    free(mio->timers);
     free(mio);
 }
 
+int mio_fd(Mio const* mio) {
+    return mio->epfd;
+}
+
+void mio_stats(Mio const* mio, MioStats* stats) {
+    *stats = mio->stats;
+}
+
+void mio_set_busy_poll(Mio* mio, unsigned spin_us) {
+    mio->busy_poll_ns = (uint64_t)spin_us * 1000;
+}
+
+int mio_set_kernel_busy_poll(Mio* mio, unsigned usecs, unsigned budget) {
+    struct epoll_params params = {
+        .busy_poll_usecs = usecs,
+        .busy_poll_budget = budget,
+        .prefer_busy_poll = 1,
+    };
+    return ioctl(mio->epfd, EPIOCSPARAMS, &params);
+}
+
+// Resize the events batch, so that it fits the number of events being reported
+static void mio_adapt_batch(Mio *mio, int n_ready) {
+    int new_size = mio->max_events;
+    if (n_ready == mio->max_events && mio->max_events < MAX_EVENTS) {
+        new_size = mio->max_events * 2;
+    } else if (n_ready < mio->max_events / 4 && mio->max_events > MIN_EVENTS) {
+        if (++mio->underused_polls == SHRINK_AFTER_POLLS)
+            new_size = mio->max_events / 2;
+    } else {
+        mio->underused_polls = 0;
+    }
+    if (new_size == mio->max_events)
+        return;
+    struct epoll_event *events
+        = (struct epoll_event*)realloc(mio->events, new_size * sizeof(struct epoll_event));
+    if (!events) // keep using the old batch
+        return;
+    mio->events = events;
+    mio->max_events = new_size;
+    mio->underused_polls = 0;
+}
+
+// Remember which future an fd is registered for, growing the table as needed
+static void mio_track(Mio *mio, int fd, Future *future) {
+    if (fd < 0)
+        return;
+    if (fd >= mio->registered_size) {
+        if (!future)
+            return;
+        int new_size = mio->registered_size ? mio->registered_size : MIN_EVENTS;
+        while (new_size <= fd)
+            new_size *= 2;
+        Future **registered = (Future**)realloc(mio->registered, new_size * sizeof(Future*));
+        if (!registered)
+            fatal("Allocation failed\n");
+        for (int i = mio->registered_size; i < new_size; ++i)
+            registered[i] = NULL;
+        mio->registered = registered;
+        mio->registered_size = new_size;
+    }
+    mio->registered[fd] = future;
+}
+
 // Register a new fd in epoll instance, or modify the events associated with one
 int mio_register(Mio* mio, int fd, uint32_t events, Waker waker)
 {
-    debug("Registering (in Mio = %p) fd = %d with\n", mio, fd);
-
-    ++mio->n_descriptors;
+    LOG_DEBUG("Registering (in Mio = %p) fd = %d with events %#x\n", mio, fd, events);
 
     struct epoll_event ee;
     ee.events = events;
     ee.data.ptr = (void*)waker.future;
+    TRACE(mio->tracer, TRACE_REGISTER, waker.future, (uint32_t)fd | (uint64_t)events << 32);
+    if (mio->sim) {
+        int added = mio_sim_register(mio->sim, fd, events, waker.future);
+        if (added == -1)
+            return -1;
+        if (added) {
+            ++mio->stats.ctl_add;
+            ++mio->n_descriptors;
+        } else {
+            ++mio->stats.ctl_mod;
+        }
+        mio_track(mio, fd, waker.future);
+        return 0;
+    }
+    ++mio->stats.ctl_add;
     int create_res = epoll_ctl(mio->epfd, EPOLL_CTL_ADD, fd, &ee);
-    if (create_res == -1 && errno == EEXIST) { // attempt to change events associated with descriptor
-        --mio->n_descriptors;
+    if (create_res == 0) {
+        ++mio->n_descriptors;
+    } else if (errno == EEXIST) { // attempt to change events associated with descriptor
+        ++mio->stats.ctl_mod;
         create_res = epoll_ctl(mio->epfd, EPOLL_CTL_MOD, fd, &ee);
     }
+    if (create_res == 0)
+        mio_track(mio, fd, waker.future);
     return create_res;
 }
 
 // Unregister fd from Mio instance
 int mio_unregister(Mio* mio, int fd)
 {
-    debug("Unregistering (from Mio = %p) fd = %d\n", mio, fd);
+    LOG_DEBUG("Unregistering (from Mio = %p) fd = %d\n", mio, fd);
 
-    int ret = epoll_ctl(mio->epfd, EPOLL_CTL_DEL, fd, &mio->dummy);
+    TRACE(mio->tracer, TRACE_UNREGISTER, mio, fd);
+    ++mio->stats.ctl_del;
+    int ret;
+    if (mio->sim) {
+        ret = mio_sim_unregister(mio->sim, fd);
+        if (ret == 0) { // like EPOLL_CTL_DEL of a descriptor that isn't registered
+            errno = ENOENT;
+            ret = -1;
+        } else if (ret == 1) {
+            ret = 0;
+        }
+    } else {
+        ret = epoll_ctl(mio->epfd, EPOLL_CTL_DEL, fd, &mio->dummy);
+    }
     if (ret == 0)
         --mio->n_descriptors;
+    mio_track(mio, fd, NULL);
     return ret;
 }
 
+int mio_unregister_all(Mio* mio)
+{
+    int unregistered = 0;
+    for (int fd = 0; fd < mio->registered_size; ++fd) {
+        if (!mio->registered[fd])
+            continue;
+        // The fd may have been closed (and dropped by epoll) without being unregistered
+        if (mio_unregister(mio, fd) == 0)
+            ++unregistered;
+    }
+    mio->n_descriptors = 0;
+    while (mio->n_timers > 0)
+        mio_timer_disarm(mio, mio->timers[0]);
+    return unregistered;
+}
+
+// Call epoll_wait, measuring the time blocked in it
+static int mio_epoll_wait(Mio *mio, int timeout_ms) {
+    ++mio->stats.polls;
+    if (timeout_ms == 0)
+        return epoll_wait(mio->epfd, mio->events, mio->max_events, 0);
+    uint64_t start = monotonic_ns();
+    int n_ready = epoll_wait(mio->epfd, mio->events, mio->max_events, timeout_ms);
+    mio->stats.blocked_ns += monotonic_ns() - start;
+    return n_ready;
+}
+
+int mio_registered_count(Mio const* mio)
+{
+    return mio->n_descriptors;
+}
+
+// ========================= descriptors =========================
+
+int mio_pipe(Mio* mio, int fds[2])
+{
+    if (mio->sim)
+        return mio_sim_pipe(mio->sim, fds);
+    return pipe2(fds, O_NONBLOCK | O_CLOEXEC);
+}
+
+int mio_close(Mio* mio, int fd)
+{
+    if (!mio->sim)
+        return close(fd);
+    // A closed pipe can't wake anybody: drop the registration, like epoll does
+    if (mio_sim_unregister(mio->sim, fd) == 1)
+        --mio->n_descriptors;
+    mio_track(mio, fd, NULL);
+    return mio_sim_close(mio->sim, fd);
+}
+
+ssize_t mio_read(Mio* mio, int fd, void* buffer, size_t n)
+{
+    return mio->sim ? mio_sim_read(mio->sim, fd, buffer, n) : read(fd, buffer, n);
+}
+
+ssize_t mio_write(Mio* mio, int fd, const void* buffer, size_t n)
+{
+    return mio->sim ? mio_sim_write(mio->sim, fd, buffer, n) : write(fd, buffer, n);
+}
+
+// ========================= timers =========================
+
+uint64_t mio_now_ns(Mio const* mio)
+{
+    return mio->sim ? mio_sim_now(mio->sim) : monotonic_ns();
+}
+
+MioTimer mio_timer_create(void)
+{
+    return (MioTimer) { .deadline_ns = 0, .future = NULL, .heap_index = MIO_TIMER_DISARMED };
+}
+
+static void mio_timers_place(Mio *mio, size_t index, MioTimer *timer) {
+    mio->timers[index] = timer;
+    timer->heap_index = index;
+}
+
+static void mio_timers_sift_up(Mio *mio, size_t index) {
+    MioTimer *timer = mio->timers[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (mio->timers[parent]->deadline_ns <= timer->deadline_ns)
+            break;
+        mio_timers_place(mio, index, mio->timers[parent]);
+        index = parent;
+    }
+    mio_timers_place(mio, index, timer);
+}
+
+static void mio_timers_sift_down(Mio *mio, size_t index) {
+    MioTimer *timer = mio->timers[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= mio->n_timers)
+            break;
+        if (child + 1 < mio->n_timers
+                && mio->timers[child + 1]->deadline_ns < mio->timers[child]->deadline_ns)
+            ++child;
+        if (timer->deadline_ns <= mio->timers[child]->deadline_ns)
+            break;
+        mio_timers_place(mio, index, mio->timers[child]);
+        index = child;
+    }
+    mio_timers_place(mio, index, timer);
+}
+
+void mio_timer_arm(Mio* mio, MioTimer* timer, uint64_t deadline_ns, Waker waker)
+{
+    timer->future = waker.future;
+    if (timer->heap_index != MIO_TIMER_DISARMED) { // move it to its new place
+        timer->deadline_ns = deadline_ns;
+        mio_timers_sift_up(mio, timer->heap_index);
+        mio_timers_sift_down(mio, timer->heap_index);
+        return;
+    }
+    if (mio->n_timers == mio->timers_capacity) {
+        size_t capacity = mio->timers_capacity ? 2 * mio->timers_capacity : MIN_EVENTS;
+        MioTimer **timers = (MioTimer**)realloc(mio->timers, capacity * sizeof(MioTimer*));
+        if (!timers)
+            fatal("Allocation failed\n");
+        mio->timers = timers;
+        mio->timers_capacity = capacity;
+    }
+    timer->deadline_ns = deadline_ns;
+    mio->timers[mio->n_timers] = timer;
+    mio_timers_sift_up(mio, mio->n_timers++);
+}
+
+void mio_timer_disarm(Mio* mio, MioTimer* timer)
+{
+    size_t index = timer->heap_index;
+    if (index == MIO_TIMER_DISARMED)
+        return;
+    timer->heap_index = MIO_TIMER_DISARMED;
+    MioTimer *last = mio->timers[--mio->n_timers];
+    if (last == timer)
+        return;
+    mio_timers_place(mio, index, last);
+    mio_timers_sift_up(mio, index);
+    mio_timers_sift_down(mio, last->heap_index);
+}
+
+size_t mio_armed_timers(Mio const* mio)
+{
+    return mio->n_timers;
+}
+
+// Shorten a poll's timeout, so that it returns by the nearest deadline
+static int mio_timers_timeout(Mio const *mio, int timeout_ms) {
+    if (mio->n_timers == 0 || timeout_ms == 0)
+        return timeout_ms;
+    uint64_t now = mio_now_ns(mio);
+    uint64_t deadline = mio->timers[0]->deadline_ns;
+    if (deadline <= now)
+        return 0;
+    uint64_t until_ms = (deadline - now + 999999) / 1000000; // rounded up: don't wake up too early
+    if (timeout_ms < 0 || until_ms < (uint64_t)timeout_ms)
+        return until_ms < INT_MAX ? (int)until_ms : INT_MAX;
+    return timeout_ms;
+}
+
+int mio_next_timeout_ms(Mio const* mio)
+{
+    return mio_timers_timeout(mio, -1);
+}
+
+// Wake the futures whose timers have expired
+static int mio_timers_fire(Mio *mio) {
+    if (mio->n_timers == 0)
+        return 0;
+    uint64_t now = mio_now_ns(mio);
+    Waker waker;
+    waker.executor = (void*)mio->executor;
+    int fired = 0;
+    while (mio->n_timers > 0 && mio->timers[0]->deadline_ns <= now) {
+        MioTimer *timer = mio->timers[0];
+        mio_timer_disarm(mio, timer);
+        waker.future = timer->future;
+        waker_wake(&waker);
+        ++fired;
+    }
+    mio->stats.timers_fired += fired;
+    return fired;
+}
+
 // Wait for available I/O operations on registered fds
 void mio_poll(Mio* mio)
 {
-    debug("Mio (%p) polling\n", mio);
+    mio_poll_timeout(mio, -1);
+}
 
-    if (mio->n_descriptors == 0)
-        return;
+// Wait at most timeout_ms for available I/O operations on registered fds
+int mio_poll_timeout(Mio* mio, int timeout_ms)
+{
+    LOG_DEBUG("Mio (%p) polling, timeout = %d\n", mio, timeout_ms);
+
+    if (mio->n_descriptors == 0 && mio->n_timers == 0)
+        return 0;
+    if (mio->sim)
+        return mio_sim_poll(mio, timeout_ms);
+    timeout_ms = mio_timers_timeout(mio, timeout_ms);
 
-    int n_ready = epoll_wait(mio->epfd, mio->events, MAX_EVENTS, -1);
+    TRACE(mio->tracer, TRACE_POLL_BEGIN, mio, timeout_ms);
+    int n_ready;
+    if (timeout_ms != 0 && mio->busy_poll_ns != 0) {
+        // Spin with non-blocking polls first, then fall back to a blocking one
+        uint64_t spin_ns = mio->busy_poll_ns;
+        if (timeout_ms > 0 && (uint64_t)timeout_ms * 1000000 < spin_ns)
+            spin_ns = (uint64_t)timeout_ms * 1000000;
+        uint64_t spin_end = monotonic_ns() + spin_ns;
+        do {
+            n_ready = epoll_wait(mio->epfd, mio->events, mio->max_events, 0);
+            ++mio->stats.polls;
+        } while (n_ready == 0 && monotonic_ns() < spin_end);
+        if (n_ready == 0)
+            n_ready = mio_epoll_wait(mio, timeout_ms);
+    } else {
+        n_ready = mio_epoll_wait(mio, timeout_ms);
+    }
+    TRACE(mio->tracer, TRACE_POLL_END, mio, n_ready);
+    if (n_ready == -1)
+        return -1;
+    mio->stats.events += n_ready;
+    if ((uint64_t)n_ready > mio->stats.max_events_per_poll)
+        mio->stats.max_events_per_poll = n_ready;
 
-    // for (int i = 0; i < n_ready; ++i) {
-    //     waker_wake(&mio->wakers[mio->events[i].data.fd]);
-    // }
     Waker waker;
     waker.executor = (void*)mio->executor;
     for (int i = 0; i < n_ready; ++i) {
         waker.future = (Future*)mio->events[i].data.ptr;
         waker_wake(&waker);
     }
+    mio_adapt_batch(mio, n_ready);
+    return n_ready + mio_timers_fire(mio);
 }
@@ -0,0 +1,66 @@
+#ifndef MIO_INTERNAL_H
+#define MIO_INTERNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/types.h>
+
+#include "executor.h"
+#include "future.h"
+#include "mio.h"
+#include "trace.h"
+
+// Internals of Mio shared by its two backends: epoll (mio.c) and the deterministic simulation
+// (mio_sim.c), which replaces the descriptors with in-memory pipes and the monotonic clock with
+// a virtual one. The public functions of mio.h dispatch to the simulation when `sim` is set.
+
+typedef struct MioSim MioSim;
+
+struct Mio {
+    struct epoll_event dummy; // dummy epoll_event for portability
+    // so that a non-NULL pointer can be passed to epoll_ctl with EPOLL_CTL_DEL option
+    Executor *executor;
+    int epfd; // descriptor of epoll instance (-1 if simulated)
+    struct epoll_event *events; // helper array for epoll_wait
+    int max_events; // current size of events
+    int underused_polls; // consecutive polls that filled less than a quarter of events
+    uint64_t busy_poll_ns; // how long to spin before blocking (0 - don't spin)
+    int n_descriptors; // number of registered fds
+    Future **registered; // registered[fd] - future woken by events of fd (NULL if unregistered)
+    int registered_size; // number of entries of `registered`
+    MioTimer **timers; // binary min-heap of the armed timers, by deadline
+    size_t n_timers;
+    size_t timers_capacity;
+    MioStats stats;
+    Tracer *tracer; // tracer of the executor
+    MioSim *sim; // NULL for the epoll backend
+};
+
+// Initial (and minimal) size of the buffer of a simulated pipe; it grows up to MIO_PIPE_CAPACITY
+#define MIO_SIM_PIPE_MIN_SIZE 256
+
+// Virtual time at which a simulation starts (not 0, which futures may use as "unset")
+#define MIO_SIM_EPOCH_NS 1000000000ULL
+
+MioSim *mio_sim_create(uint64_t seed);
+void mio_sim_destroy(MioSim *sim);
+uint64_t mio_sim_now(MioSim const *sim);
+
+// Counterparts of mio_register() and mio_unregister(): 1 if the fd has been added
+// (or removed), 0 if its registration has been modified (or it wasn't registered), -1 on error.
+int mio_sim_register(MioSim *sim, int fd, uint32_t events, Future *future);
+int mio_sim_unregister(MioSim *sim, int fd);
+
+// Wakes the futures of the ready descriptors and of the expired timers, in an order drawn
+// from the seed. If there are none and the timeout allows, first moves the clock to the
+// nearest deadline (or to the end of the timeout).
+int mio_sim_poll(Mio *mio, int timeout_ms);
+
+int mio_sim_pipe(MioSim *sim, int fds[2]);
+int mio_sim_close(MioSim *sim, int fd);
+ssize_t mio_sim_read(MioSim *sim, int fd, void *buffer, size_t n);
+ssize_t mio_sim_write(MioSim *sim, int fd, const void *buffer, size_t n);
+
+#endif // MIO_INTERNAL_H
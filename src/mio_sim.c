@@ -0,0 +1,343 @@
+#include "mio_internal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "err.h"
+#include "log.h"
+#include "waker.h"
+
+// In-memory pipe: a ring buffer growing up to MIO_PIPE_CAPACITY bytes
+typedef struct MioSimPipe {
+    uint8_t *data;
+    size_t size; // allocated size of data
+    size_t head; // position of the first unread byte
+    size_t len; // number of unread bytes
+    int ends[2]; // descriptors of the read and write end (-1 once closed)
+} MioSimPipe;
+
+typedef struct MioSimFd {
+    MioSimPipe *pipe; // NULL if the descriptor isn't open
+    bool write_end;
+    uint32_t events; // registered interest (0 if not registered)
+    Future *future; // future to be woken (NULL if not registered)
+    bool candidate; // whether it is listed in `candidates`
+} MioSimFd;
+
+struct MioSim {
+    uint64_t now_ns; // the virtual clock
+    uint64_t rng; // state of the generator ordering the wakes
+    MioSimFd *fds;
+    size_t n_fds; // number of descriptors ever created (open or not)
+    size_t fds_capacity;
+    int *free_fds; // closed descriptors, to be reused (last closed first)
+    size_t n_free_fds;
+    size_t free_fds_capacity;
+    // Registered descriptors that may be ready: those whose pipe has changed and those that
+    // were ready at the last poll (registrations are level-triggered, like in epoll)
+    int *candidates;
+    size_t n_candidates;
+    size_t candidates_capacity;
+    Future **woken; // futures to be woken by a poll
+    size_t woken_capacity;
+};
+
+// Grow an array of `*capacity` elements to hold at least `needed` ones
+static void *grow(void *array, size_t *capacity, size_t needed, size_t element_size) {
+    if (needed <= *capacity)
+        return array;
+    size_t new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < needed)
+        new_capacity *= 2;
+    array = realloc(array, new_capacity * element_size);
+    if (!array)
+        fatal("Allocation failed\n");
+    *capacity = new_capacity;
+    return array;
+}
+
+// splitmix64: any seed (even 0) gives a good sequence
+static uint64_t mio_sim_random(MioSim *sim) {
+    uint64_t z = (sim->rng += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+MioSim *mio_sim_create(uint64_t seed) {
+    MioSim *sim = (MioSim*)calloc(1, sizeof(MioSim));
+    if (!sim)
+        fatal("Allocation failed\n");
+    sim->now_ns = MIO_SIM_EPOCH_NS;
+    sim->rng = seed;
+    return sim;
+}
+
+void mio_sim_destroy(MioSim *sim) {
+    for (size_t fd = 0; fd < sim->n_fds; ++fd)
+        if (sim->fds[fd].pipe)
+            mio_sim_close(sim, (int)fd);
+    free(sim->fds);
+    free(sim->free_fds);
+    free(sim->candidates);
+    free(sim->woken);
+    free(sim);
+}
+
+uint64_t mio_sim_now(MioSim const *sim) {
+    return sim->now_ns;
+}
+
+// ========================= descriptors =========================
+
+static MioSimFd *mio_sim_fd(MioSim *sim, int fd) {
+    if (fd < 0 || (size_t)fd >= sim->n_fds || !sim->fds[fd].pipe) {
+        errno = EBADF;
+        return NULL;
+    }
+    return &sim->fds[fd];
+}
+
+// Whether a poll would report an event of the descriptor
+static bool mio_sim_ready(MioSimFd const *fd) {
+    if (!fd->pipe || !fd->future)
+        return false;
+    MioSimPipe const *pipe = fd->pipe;
+    if (fd->write_end) // EPOLLERR once the read end is closed
+        return ((fd->events & EPOLLOUT) && pipe->len < MIO_PIPE_CAPACITY) || pipe->ends[0] == -1;
+    // EPOLLHUP once the write end is closed
+    return ((fd->events & EPOLLIN) && pipe->len > 0) || pipe->ends[1] == -1;
+}
+
+// The state of the descriptor may have changed: have the next poll check it
+static void mio_sim_touch(MioSim *sim, int fd) {
+    if (fd == -1 || !sim->fds[fd].future || sim->fds[fd].candidate)
+        return;
+    sim->candidates = grow(sim->candidates, &sim->candidates_capacity, sim->n_candidates + 1, sizeof(int));
+    sim->candidates[sim->n_candidates++] = fd;
+    sim->fds[fd].candidate = true;
+}
+
+static int mio_sim_new_fd(MioSim *sim, MioSimPipe *pipe, bool write_end) {
+    int fd;
+    if (sim->n_free_fds > 0) {
+        fd = sim->free_fds[--sim->n_free_fds];
+    } else {
+        sim->fds = grow(sim->fds, &sim->fds_capacity, sim->n_fds + 1, sizeof(MioSimFd));
+        fd = (int)sim->n_fds++;
+        sim->fds[fd].candidate = false;
+    }
+    MioSimFd *entry = &sim->fds[fd];
+    entry->pipe = pipe;
+    entry->write_end = write_end;
+    entry->events = 0;
+    entry->future = NULL;
+    return fd;
+}
+
+int mio_sim_pipe(MioSim *sim, int fds[2]) {
+    MioSimPipe *pipe = (MioSimPipe*)malloc(sizeof(MioSimPipe));
+    if (!pipe)
+        fatal("Allocation failed\n");
+    *pipe = (MioSimPipe) { .data = NULL, .size = 0, .head = 0, .len = 0 };
+    pipe->ends[0] = fds[0] = mio_sim_new_fd(sim, pipe, false);
+    pipe->ends[1] = fds[1] = mio_sim_new_fd(sim, pipe, true);
+    return 0;
+}
+
+int mio_sim_close(MioSim *sim, int fd) {
+    MioSimFd *entry = mio_sim_fd(sim, fd);
+    if (!entry)
+        return -1;
+    MioSimPipe *pipe = entry->pipe;
+    pipe->ends[entry->write_end ? 1 : 0] = -1;
+    entry->pipe = NULL;
+    entry->events = 0;
+    entry->future = NULL;
+    sim->free_fds = grow(sim->free_fds, &sim->free_fds_capacity, sim->n_free_fds + 1, sizeof(int));
+    sim->free_fds[sim->n_free_fds++] = fd;
+    if (pipe->ends[0] == -1 && pipe->ends[1] == -1) {
+        free(pipe->data);
+        free(pipe);
+    } else { // the other end gets EPOLLHUP or EPOLLERR
+        mio_sim_touch(sim, pipe->ends[entry->write_end ? 0 : 1]);
+    }
+    return 0;
+}
+
+ssize_t mio_sim_read(MioSim *sim, int fd, void *buffer, size_t n) {
+    MioSimFd *entry = mio_sim_fd(sim, fd);
+    if (!entry || entry->write_end) {
+        errno = EBADF;
+        return -1;
+    }
+    MioSimPipe *pipe = entry->pipe;
+    if (n == 0)
+        return 0;
+    if (pipe->len == 0) {
+        if (pipe->ends[1] == -1)
+            return 0; // EOF
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t count = n < pipe->len ? n : pipe->len;
+    size_t first = pipe->size - pipe->head; // bytes up to the end of the ring
+    if (first > count)
+        first = count;
+    memcpy(buffer, pipe->data + pipe->head, first);
+    memcpy((uint8_t*)buffer + first, pipe->data, count - first);
+    pipe->head = (pipe->head + count) % pipe->size;
+    pipe->len -= count;
+    mio_sim_touch(sim, pipe->ends[1]);
+    return (ssize_t)count;
+}
+
+// Make room for `needed` unread bytes (at most MIO_PIPE_CAPACITY), unwrapping the ring
+static void mio_sim_pipe_reserve(MioSimPipe *pipe, size_t needed) {
+    if (needed <= pipe->size)
+        return;
+    size_t size = pipe->size ? pipe->size : MIO_SIM_PIPE_MIN_SIZE;
+    while (size < needed)
+        size *= 2;
+    uint8_t *data = (uint8_t*)malloc(size);
+    if (!data)
+        fatal("Allocation failed\n");
+    size_t first = pipe->size - pipe->head;
+    if (first > pipe->len)
+        first = pipe->len;
+    if (pipe->len > 0) {
+        memcpy(data, pipe->data + pipe->head, first);
+        memcpy(data + first, pipe->data, pipe->len - first);
+    }
+    free(pipe->data);
+    pipe->data = data;
+    pipe->size = size;
+    pipe->head = 0;
+}
+
+ssize_t mio_sim_write(MioSim *sim, int fd, const void *buffer, size_t n) {
+    MioSimFd *entry = mio_sim_fd(sim, fd);
+    if (!entry || !entry->write_end) {
+        errno = EBADF;
+        return -1;
+    }
+    MioSimPipe *pipe = entry->pipe;
+    if (pipe->ends[0] == -1) {
+        errno = EPIPE;
+        return -1;
+    }
+    if (n == 0)
+        return 0;
+    size_t space = MIO_PIPE_CAPACITY - pipe->len;
+    if (space == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t count = n < space ? n : space;
+    mio_sim_pipe_reserve(pipe, pipe->len + count);
+    size_t tail = (pipe->head + pipe->len) % pipe->size;
+    size_t first = pipe->size - tail; // room up to the end of the ring
+    if (first > count)
+        first = count;
+    memcpy(pipe->data + tail, buffer, first);
+    memcpy(pipe->data, (const uint8_t*)buffer + first, count - first);
+    pipe->len += count;
+    mio_sim_touch(sim, pipe->ends[0]);
+    return (ssize_t)count;
+}
+
+int mio_sim_register(MioSim *sim, int fd, uint32_t events, Future *future) {
+    MioSimFd *entry = mio_sim_fd(sim, fd);
+    if (!entry)
+        return -1;
+    int added = entry->future ? 0 : 1;
+    entry->events = events;
+    entry->future = future;
+    mio_sim_touch(sim, fd); // it may be ready already
+    return added;
+}
+
+int mio_sim_unregister(MioSim *sim, int fd) {
+    MioSimFd *entry = mio_sim_fd(sim, fd);
+    if (!entry)
+        return -1;
+    if (!entry->future)
+        return 0;
+    entry->events = 0;
+    entry->future = NULL; // it is dropped from the candidates by the next poll
+    return 1;
+}
+
+// ========================= polling =========================
+
+static void mio_sim_push_woken(MioSim *sim, size_t *n_woken, Future *future) {
+    sim->woken = grow(sim->woken, &sim->woken_capacity, *n_woken + 1, sizeof(Future*));
+    sim->woken[(*n_woken)++] = future;
+}
+
+// Collect the futures of the ready descriptors, keeping only those as candidates
+static size_t mio_sim_collect_ready(MioSim *sim) {
+    size_t n_woken = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < sim->n_candidates; ++i) {
+        int fd = sim->candidates[i];
+        MioSimFd *entry = &sim->fds[fd];
+        if (mio_sim_ready(entry)) {
+            sim->candidates[kept++] = fd;
+            mio_sim_push_woken(sim, &n_woken, entry->future);
+        } else {
+            entry->candidate = false;
+        }
+    }
+    sim->n_candidates = kept;
+    return n_woken;
+}
+
+int mio_sim_poll(Mio *mio, int timeout_ms) {
+    MioSim *sim = mio->sim;
+    TRACE(mio->tracer, TRACE_POLL_BEGIN, mio, timeout_ms);
+    ++mio->stats.polls;
+    size_t n_woken = mio_sim_collect_ready(sim);
+    size_t n_events = n_woken;
+    if (n_events == 0 && timeout_ms != 0) {
+        // Nothing happens until the nearest deadline: skip straight to it
+        uint64_t target = mio->n_timers > 0 ? mio->timers[0]->deadline_ns : UINT64_MAX;
+        if (timeout_ms > 0 && sim->now_ns + (uint64_t)timeout_ms * 1000000 < target)
+            target = sim->now_ns + (uint64_t)timeout_ms * 1000000;
+        if (target == UINT64_MAX)
+            fatal("Simulated deadlock: every task waits for an event that cannot happen\n");
+        if (target > sim->now_ns) {
+            mio->stats.blocked_ns += target - sim->now_ns;
+            sim->now_ns = target;
+        }
+    }
+    TRACE(mio->tracer, TRACE_POLL_END, mio, n_events);
+    mio->stats.events += n_events;
+    if (n_events > mio->stats.max_events_per_poll)
+        mio->stats.max_events_per_poll = n_events;
+
+    while (mio->n_timers > 0 && mio->timers[0]->deadline_ns <= sim->now_ns) {
+        MioTimer *timer = mio->timers[0];
+        mio_timer_disarm(mio, timer);
+        mio_sim_push_woken(sim, &n_woken, timer->future);
+        ++mio->stats.timers_fired;
+    }
+
+    // The order of the wakes is the order in which the executor runs the tasks
+    for (size_t i = n_woken; i > 1; --i) {
+        size_t j = mio_sim_random(sim) % i;
+        Future *future = sim->woken[i - 1];
+        sim->woken[i - 1] = sim->woken[j];
+        sim->woken[j] = future;
+    }
+    Waker waker;
+    waker.executor = (void*)mio->executor;
+    for (size_t i = 0; i < n_woken; ++i) {
+        waker.future = sim->woken[i];
+        waker_wake(&waker);
+    }
+    LOG_DEBUG("Simulated Mio (%p) woke %zu futures at %llu ns\n", (void*)mio, n_woken,
+        (unsigned long long)sim->now_ns);
+    return (int)n_woken;
+}
@@ -0,0 +1,179 @@
+#include "owned.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "err.h"
+#include "waker.h"
+
+typedef struct OwnedTask {
+    Future base; // the wrapper spawned in the executor; `ok` and `errcode` are the task's results
+    OwnedSlab *slab;
+    unsigned size_class; // index of the slab's size class, OWNED_N_CLASSES if malloc'ed
+    unsigned refs; // the executor's (until the task completes) and the handle's
+    bool finished;
+    FutureState result; // once finished
+    bool has_waiter;
+    Waker waiter; // of the task awaiting the handle, if has_waiter
+    _Alignas(max_align_t) unsigned char inner[]; // the owned future
+} OwnedTask;
+
+struct OwnedChunk {
+    OwnedChunk *next;
+    max_align_t cells[];
+};
+
+void owned_slab_init(OwnedSlab *slab) {
+    for (size_t i = 0; i < OWNED_N_CLASSES; ++i)
+        slab->free_cells[i] = NULL;
+    slab->chunks = NULL;
+    slab->bytes = 0;
+}
+
+void owned_slab_destroy(OwnedSlab *slab) {
+    while (slab->chunks) {
+        OwnedChunk *chunk = slab->chunks;
+        slab->chunks = chunk->next;
+        free(chunk);
+    }
+    owned_slab_init(slab);
+}
+
+// Index of the smallest size class that fits `size` bytes (OWNED_N_CLASSES if none does)
+static unsigned size_class_of(size_t size) {
+    unsigned shift = OWNED_MIN_CLASS_SHIFT;
+    while (shift <= OWNED_MAX_CLASS_SHIFT && ((size_t)1 << shift) < size)
+        ++shift;
+    return shift - OWNED_MIN_CLASS_SHIFT;
+}
+
+// Carve a new chunk into free cells of the given class
+static void owned_slab_grow(OwnedSlab *slab, unsigned size_class) {
+    OwnedChunk *chunk = (OwnedChunk*)malloc(OWNED_CHUNK_SIZE);
+    if (!chunk)
+        fatal("Allocation failed\n");
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    slab->bytes += OWNED_CHUNK_SIZE;
+    size_t cell_size = (size_t)1 << (size_class + OWNED_MIN_CLASS_SHIFT);
+    size_t n_cells = (OWNED_CHUNK_SIZE - offsetof(OwnedChunk, cells)) / cell_size;
+    char *cells = (char*)chunk->cells;
+    for (size_t i = n_cells; i-- > 0;) {
+        *(void**)(cells + i * cell_size) = slab->free_cells[size_class];
+        slab->free_cells[size_class] = cells + i * cell_size;
+    }
+}
+
+static OwnedTask *owned_slab_alloc(OwnedSlab *slab, size_t size) {
+    unsigned size_class = size_class_of(size);
+    OwnedTask *task;
+    if (size_class == OWNED_N_CLASSES) {
+        task = (OwnedTask*)malloc(size);
+        if (!task)
+            fatal("Allocation failed\n");
+    } else {
+        if (!slab->free_cells[size_class])
+            owned_slab_grow(slab, size_class);
+        task = (OwnedTask*)slab->free_cells[size_class];
+        slab->free_cells[size_class] = *(void**)task;
+    }
+    task->slab = slab;
+    task->size_class = size_class;
+    return task;
+}
+
+static void owned_task_unref(OwnedTask *task) {
+    if (--task->refs > 0)
+        return;
+    if (task->size_class == OWNED_N_CLASSES) {
+        free(task);
+        return;
+    }
+    *(void**)task = task->slab->free_cells[task->size_class];
+    task->slab->free_cells[task->size_class] = task;
+}
+
+static FutureState join_handle_progress(Future *base, Mio *mio, Waker waker) {
+    JoinHandle *self = (JoinHandle*)base;
+    OwnedTask *task = self->task;
+    if (!task)
+        fatal("JoinHandle progressed after its result has been taken or it has been detached\n");
+    if (!task->finished) { // woken up by the task when it completes
+        task->waiter = waker;
+        task->has_waiter = true;
+        return FUTURE_PENDING;
+    }
+    base->ok = task->base.ok;
+    base->errcode = task->base.errcode;
+    FutureState result = task->result;
+    self->task = NULL;
+    owned_task_unref(task);
+    return result;
+}
+
+Future *owned_task_create(OwnedSlab *slab, Future const *fut, size_t size, JoinHandle *handle) {
+    if (fut->is_active)
+        fatal("Only a future that hasn't been spawned can be owned by the executor\n");
+    OwnedTask *task = owned_slab_alloc(slab, offsetof(OwnedTask, inner) + size);
+    task->base = future_create(owned_task_progress);
+    task->refs = 1;
+    task->finished = false;
+    task->result = FUTURE_PENDING;
+    task->has_waiter = false;
+    memcpy(task->inner, fut, size);
+    ((Future*)task->inner)->is_active = true;
+    if (handle) {
+        ++task->refs;
+        *handle = (JoinHandle) {
+            .base = future_create(join_handle_progress),
+            .task = task,
+        };
+    }
+    return &task->base;
+}
+
+FutureState owned_task_progress(Future *base, Mio *mio, Waker waker) {
+    OwnedTask *self = (OwnedTask*)base;
+    Future *inner = (Future*)self->inner;
+    FutureState state = (*inner->progress)(inner, mio, waker);
+    if (state == FUTURE_PENDING)
+        return state;
+    inner->is_active = false;
+    base->ok = inner->ok;
+    base->errcode = inner->errcode;
+    self->finished = true;
+    self->result = state;
+    if (self->has_waiter) {
+        self->has_waiter = false;
+        waker_wake(&self->waiter);
+    }
+    return state;
+}
+
+Future *owned_task_cancel(Future *base) {
+    OwnedTask *self = (OwnedTask*)base;
+    Future *inner = (Future*)self->inner;
+    inner->is_active = false;
+    inner->errcode = ECANCELED;
+    base->errcode = ECANCELED;
+    self->finished = true;
+    self->result = FUTURE_FAILURE;
+    // The task awaiting the handle, if any, is live, too, so it is being cancelled as well
+    self->has_waiter = false;
+    return inner;
+}
+
+void owned_task_release_completed(Future *base) {
+    owned_task_unref((OwnedTask*)base);
+}
+
+void join_handle_detach(JoinHandle* handle) {
+    OwnedTask *task = handle->task;
+    if (!task)
+        return;
+    task->has_waiter = false;
+    handle->task = NULL;
+    owned_task_unref(task);
+}
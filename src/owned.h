@@ -0,0 +1,56 @@
+#ifndef OWNED_H
+#define OWNED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "future.h"
+#include "join_handle.h"
+
+// Internal storage of executor-owned tasks (see join_handle.h).
+//
+// An owned task is a wrapper future (OwnedTask) followed by the copy of the spawned future.
+// The wrapper is shared by the executor and the JoinHandle: each holds a reference, and the
+// storage goes back to its slab when both are gone. The executor recognizes the wrappers by
+// their progress function, so ordinary tasks pay nothing for this.
+
+// Smallest and largest size classes of the slabs; bigger tasks are malloc'ed
+#define OWNED_MIN_CLASS_SHIFT 6 // 64 bytes
+#define OWNED_MAX_CLASS_SHIFT 12 // 4 KiB
+#define OWNED_N_CLASSES (OWNED_MAX_CLASS_SHIFT - OWNED_MIN_CLASS_SHIFT + 1)
+
+// Size of the chunks the slabs carve their cells from
+#define OWNED_CHUNK_SIZE (64 * 1024)
+
+typedef struct OwnedChunk OwnedChunk;
+
+// Size-class slab allocator of owned tasks (one per executor, single-threaded)
+typedef struct OwnedSlab {
+    void *free_cells[OWNED_N_CLASSES]; // free lists, linked through the first word of the cells
+    OwnedChunk *chunks; // all chunks, to be freed with the slab
+    size_t bytes; // total size of the chunks
+} OwnedSlab;
+
+void owned_slab_init(OwnedSlab *slab);
+
+// Frees all chunks: no owned task nor JoinHandle may be used afterwards
+void owned_slab_destroy(OwnedSlab *slab);
+
+// Moves `fut` into a new owned task (referenced by the executor and, if `handle` is not NULL,
+// by `handle`) and returns the task's wrapper future, to be spawned
+Future *owned_task_create(OwnedSlab *slab, Future const *fut, size_t size, JoinHandle *handle);
+
+FutureState owned_task_progress(Future *base, Mio *mio, Waker waker);
+
+static inline bool owned_task_is(Future const *fut) {
+    return fut->progress == owned_task_progress;
+}
+
+// Marks an owned task cancelled by executor_shutdown() (its handle fails with ECANCELED);
+// returns the owned future, which is freed once the executor's reference is dropped
+Future *owned_task_cancel(Future *base);
+
+// Drops the executor's reference to a completed owned task
+void owned_task_release_completed(Future *base);
+
+#endif // OWNED_H
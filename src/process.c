@@ -0,0 +1,152 @@
+// Required for `unistd.h` include to contain `pipe2` and `syscall`.
+#define _GNU_SOURCE
+
+#include "process.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "log.h"
+
+extern char **environ;
+
+// Older glibc (before 2.36) has no wrappers of the pidfd system calls, and newer ones declare
+// them in <sys/pidfd.h>: call them directly, under names that can't clash with the wrappers
+static int sys_pidfd_open(pid_t pid, unsigned flags) {
+    return (int)syscall(SYS_pidfd_open, pid, flags);
+}
+
+static int sys_pidfd_send_signal(int pidfd, int sig, siginfo_t *info, unsigned flags) {
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, info, flags);
+}
+
+static void close_fd(int *fd) {
+    if (*fd == -1)
+        return;
+    close(*fd);
+    *fd = -1;
+}
+
+static FutureState process_future_progress(Future *base, Mio *mio, Waker waker) {
+    ProcessFuture *self = (ProcessFuture*)base;
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_PIDFD, self->pidfd, &info, WEXITED | WNOHANG) == -1) {
+        base->errcode = errno;
+        if (self->registered)
+            mio_unregister(mio, self->pidfd);
+        return FUTURE_FAILURE;
+    }
+    if (info.si_pid == 0) { // still running: the pidfd becomes readable when the child exits
+        if (!self->registered) {
+            ASSERT_SYS_OK(mio_register(mio, self->pidfd, EPOLLIN, waker));
+            self->registered = true;
+        }
+        return FUTURE_PENDING;
+    }
+    if (self->registered)
+        mio_unregister(mio, self->pidfd);
+    self->registered = false;
+    close_fd(&self->pidfd);
+    self->exited = info.si_code == CLD_EXITED;
+    if (self->exited)
+        self->exit_code = info.si_status;
+    else
+        self->term_signal = info.si_status;
+    LOG_DEBUG("Process %d terminated, si_code %d, si_status %d\n", (int)self->pid, info.si_code,
+        info.si_status);
+    base->ok = (void*)(intptr_t)(self->exited ? self->exit_code : 128 + self->term_signal);
+    return FUTURE_COMPLETED;
+}
+
+int process_spawn(ProcessFuture* process, char* const argv[], int pipes) {
+    *process = (ProcessFuture) {
+        .base = future_create(process_future_progress),
+        .pid = -1,
+        .pidfd = -1,
+        .stdin_fd = -1,
+        .stdout_fd = -1,
+        .stderr_fd = -1,
+        .registered = false,
+        .exited = false,
+        .exit_code = 0,
+        .term_signal = 0,
+    };
+    // child_fds[i] - the child's end of the pipe of stream i (-1 if inherited)
+    int child_fds[3] = { -1, -1, -1 };
+    int *parent_fds[3] = { &process->stdin_fd, &process->stdout_fd, &process->stderr_fd };
+    const int flags[3] = { PROCESS_PIPE_STDIN, PROCESS_PIPE_STDOUT, PROCESS_PIPE_STDERR };
+    posix_spawn_file_actions_t actions;
+    ASSERT_ZERO(posix_spawn_file_actions_init(&actions));
+    int err = 0;
+    for (int i = 0; i < 3 && err == 0; ++i) {
+        if (!(pipes & flags[i]))
+            continue;
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            err = errno;
+            break;
+        }
+        int child_end = i == 0 ? 0 : 1;
+        child_fds[i] = fds[child_end];
+        *parent_fds[i] = fds[1 - child_end];
+        ASSERT_SYS_OK(fcntl(*parent_fds[i], F_SETFL, O_NONBLOCK));
+        // dup2() clears close-on-exec of the child's copy
+        ASSERT_ZERO(posix_spawn_file_actions_adddup2(&actions, child_fds[i], i));
+    }
+    // Signals blocked by the parent (e.g. for a SignalStream) are unblocked in the child
+    posix_spawnattr_t attr;
+    ASSERT_ZERO(posix_spawnattr_init(&attr));
+    sigset_t empty;
+    ASSERT_SYS_OK(sigemptyset(&empty));
+    ASSERT_ZERO(posix_spawnattr_setsigmask(&attr, &empty));
+    ASSERT_ZERO(posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK));
+    if (err == 0)
+        err = posix_spawnp(&process->pid, argv[0], &actions, &attr, argv, environ);
+    ASSERT_ZERO(posix_spawnattr_destroy(&attr));
+    ASSERT_ZERO(posix_spawn_file_actions_destroy(&actions));
+    for (int i = 0; i < 3; ++i)
+        close_fd(&child_fds[i]);
+    if (err == 0) {
+        // The child can't be reaped (nor its pid reused) before we do, so this can't race;
+        // pidfds are always close-on-exec
+        process->pidfd = sys_pidfd_open(process->pid, 0);
+        if (process->pidfd == -1) {
+            err = errno;
+            kill(process->pid, SIGKILL);
+            waitpid(process->pid, NULL, 0);
+        }
+    }
+    if (err != 0) {
+        process_close(process);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+int process_kill(ProcessFuture* process, int sig) {
+    if (process->pidfd == -1) {
+        errno = ESRCH;
+        return -1;
+    }
+    return sys_pidfd_send_signal(process->pidfd, sig, NULL, 0);
+}
+
+void process_close_stdin(ProcessFuture* process) {
+    close_fd(&process->stdin_fd);
+}
+
+void process_close(ProcessFuture* process) {
+    close_fd(&process->stdin_fd);
+    close_fd(&process->stdout_fd);
+    close_fd(&process->stderr_fd);
+    close_fd(&process->pidfd);
+}
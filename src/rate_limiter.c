@@ -0,0 +1,120 @@
+#include "rate_limiter.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "executor.h"
+#include "future_examples.h"
+#include "log.h"
+
+// Time it takes to refill n tokens
+static uint64_t rate_limiter_interval_ns(RateLimiter const *limiter, uint64_t n) {
+    return (uint64_t)((unsigned __int128)n * 1000000000 / limiter->rate);
+}
+
+void rate_limiter_init(RateLimiter* limiter, uint64_t rate, uint64_t burst) {
+    if (rate == 0 || burst == 0)
+        fatal("A rate limiter needs a positive rate and burst\n");
+    *limiter = (RateLimiter) { .rate = rate, .burst = burst, .tat_ns = 0 };
+}
+
+uint64_t rate_limiter_try_acquire(RateLimiter* limiter, uint64_t n, uint64_t now_ns) {
+    uint64_t burst_ns = rate_limiter_interval_ns(limiter, limiter->burst);
+    uint64_t tat_ns = limiter->tat_ns > now_ns ? limiter->tat_ns : now_ns;
+    // A request larger than the burst only needs the bucket to be full
+    uint64_t cost_ns = n <= limiter->burst ? rate_limiter_interval_ns(limiter, n) : burst_ns;
+    uint64_t debt_ns = n <= limiter->burst ? 0 : rate_limiter_interval_ns(limiter, n - limiter->burst);
+    uint64_t new_tat_ns = tat_ns + cost_ns;
+    if (new_tat_ns > now_ns + burst_ns)
+        return new_tat_ns - (now_ns + burst_ns);
+    limiter->tat_ns = new_tat_ns + debt_ns;
+    return 0;
+}
+
+static FutureState rate_acquire_future_progress(Future *base, Mio *mio, Waker waker) {
+    RateAcquireFuture *self = (RateAcquireFuture*)base;
+    uint64_t now = mio_now_ns(mio);
+    uint64_t wait_ns = rate_limiter_try_acquire(self->limiter, self->n, now);
+    if (wait_ns == 0) {
+        mio_timer_disarm(mio, &self->timer);
+        return FUTURE_COMPLETED;
+    }
+    // Another task may take the tokens first: then we wait again
+    mio_timer_arm(mio, &self->timer, now + wait_ns, waker);
+    return FUTURE_PENDING;
+}
+
+RateAcquireFuture rate_acquire_future_create(RateLimiter* limiter, uint64_t n) {
+    return (RateAcquireFuture) {
+        .base = future_create(rate_acquire_future_progress),
+        .limiter = limiter,
+        .n = n,
+        .timer = mio_timer_create(),
+    };
+}
+
+static void paced_write_unregister(PacedWriteFuture *self, Mio *mio) {
+    if (self->registered)
+        mio_unregister(mio, self->fd);
+    self->registered = false;
+}
+
+static FutureState paced_write_future_progress(Future *base, Mio *mio, Waker waker) {
+    PacedWriteFuture *self = (PacedWriteFuture*)base;
+    const uint8_t *buffer = self->base.arg;
+    while (self->written_so_far < self->n) {
+        if (self->allowed == 0) { // acquire the next burst
+            size_t left = self->n - self->written_so_far;
+            size_t burst = left < self->limiter->burst ? left : (size_t)self->limiter->burst;
+            uint64_t now = mio_now_ns(mio);
+            uint64_t wait_ns = rate_limiter_try_acquire(self->limiter, burst, now);
+            if (wait_ns != 0) {
+                // Waiting for the timer only: a writable fd would wake us up in vain
+                paced_write_unregister(self, mio);
+                mio_timer_arm(mio, &self->timer, now + wait_ns, waker);
+                return FUTURE_PENDING;
+            }
+            mio_timer_disarm(mio, &self->timer);
+            self->allowed = burst;
+        }
+        if (!executor_budget_consume(waker.executor)) {
+            // Let other tasks run, staying registered.
+            waker_wake(&waker);
+            return FUTURE_PENDING;
+        }
+        ssize_t bytes_written = mio_write(mio, self->fd, buffer + self->written_so_far, self->allowed);
+        LOG_DEBUG("PacedWriteFuture %p: write %zd\n", (void*)self, bytes_written);
+        if (bytes_written > 0) {
+            self->written_so_far += bytes_written;
+            self->allowed -= bytes_written;
+        } else if (bytes_written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!self->registered) {
+                ASSERT_SYS_OK(mio_register(mio, self->fd, EPOLLOUT, waker));
+                self->registered = true;
+            }
+            return FUTURE_PENDING;
+        } else {
+            self->base.errcode = bytes_written == 0 ? PIPE_FUTURE_ERR_EOF : errno;
+            paced_write_unregister(self, mio);
+            return FUTURE_FAILURE;
+        }
+    }
+    paced_write_unregister(self, mio);
+    self->base.ok = (void*)buffer;
+    return FUTURE_COMPLETED;
+}
+
+PacedWriteFuture paced_write_future_create(RateLimiter* limiter, int fd, size_t n) {
+    return (PacedWriteFuture) {
+        .base = future_create(paced_write_future_progress),
+        .limiter = limiter,
+        .fd = fd,
+        .n = n,
+        .written_so_far = 0,
+        .allowed = 0,
+        .registered = false,
+        .timer = mio_timer_create(),
+    };
+}
@@ -0,0 +1,242 @@
+// Required for `pthread.h` and `sched.h` to contain the CPU affinity functions.
+#define _GNU_SOURCE
+
+#include "runtime.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "mio.h"
+
+typedef struct Shard Shard;
+
+struct Shard {
+    Runtime *runtime;
+    size_t index;
+    pthread_t thread;
+    Executor *executor; // only touched by the shard's thread
+    int event_fd; // signalled when the inbox becomes non-empty
+    // Lock-free stack of submitted futures, linked through their `next_queued` fields
+    // (they cannot be queued in any executor before they are spawned)
+    _Atomic(Future*) inbox;
+    Future inbox_future; // task that moves submitted futures to the executor
+};
+
+struct Runtime {
+    size_t n_shards;
+    size_t max_queue_size;
+    Shard *shards;
+    atomic_bool stopping; // set by runtime_destroy()
+    atomic_bool terminated; // all shards are idle and nothing is in flight
+    // Shards that aren't idle plus futures submitted to other shards and not yet spawned there,
+    // in a single word, so that the runtime has terminated exactly when it drops to 0
+    atomic_size_t busy;
+};
+
+static _Thread_local Shard *current_shard = NULL;
+
+static void shard_signal(Shard *shard) {
+    uint64_t one = 1;
+    ASSERT_SYS_OK(write(shard->event_fd, &one, sizeof(one)));
+}
+
+// Spawn the futures submitted to the shard, in the order of submission
+static void shard_drain_inbox(Shard *shard, Executor *executor) {
+    // The eventfd has been reset before taking the stack, so no signal can get lost
+    Future *stack = atomic_exchange_explicit(&shard->inbox, NULL, memory_order_acquire);
+    Future *fifo = NULL;
+    while (stack) {
+        Future *next = stack->next_queued;
+        stack->next_queued = fifo;
+        fifo = stack;
+        stack = next;
+    }
+    while (fifo) {
+        Future *next = fifo->next_queued;
+        fifo->next_queued = NULL;
+        executor_spawn(executor, fifo);
+        // The shard is busy now, so this can't make `busy` drop to 0
+        atomic_fetch_sub(&shard->runtime->busy, 1);
+        fifo = next;
+    }
+}
+
+static FutureState inbox_progress(Future *base, Mio *mio, Waker waker) {
+    Shard *shard = (Shard*)base->arg;
+    uint64_t count;
+    if (read(shard->event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        syserr("Reading the inbox eventfd failed\n");
+    shard_drain_inbox(shard, (Executor*)waker.executor);
+    if (atomic_load(&shard->runtime->stopping)) {
+        // Don't keep the executor running; late submissions are handled by shard_wait_idle
+        mio_unregister(mio, shard->event_fd);
+        return FUTURE_COMPLETED;
+    }
+    mio_register(mio, shard->event_fd, EPOLLIN, waker);
+    return FUTURE_PENDING;
+}
+
+// Wait until either something is submitted to the idle shard (false is returned),
+// or all shards are idle with nothing in flight, i.e. the runtime has terminated (true)
+static bool shard_wait_idle(Shard *shard) {
+    Runtime *runtime = shard->runtime;
+    // A submitting shard counts the future as in flight before it becomes idle itself,
+    // and a receiving shard counts itself as busy again before it stops counting the future,
+    // so `busy` drops to 0 only once, when the last shard becomes idle with nothing in flight.
+    if (atomic_fetch_sub(&runtime->busy, 1) == 1) {
+        atomic_store(&runtime->terminated, true);
+        for (size_t i = 0; i < runtime->n_shards; ++i)
+            if (&runtime->shards[i] != shard)
+                shard_signal(&runtime->shards[i]);
+        return true;
+    }
+    log_flush();
+    for (;;) {
+        struct pollfd pfd = { .fd = shard->event_fd, .events = POLLIN };
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+            syserr("Waiting for the inbox eventfd failed\n");
+        // Reset before checking the inbox, so that a submission made after the check isn't missed
+        uint64_t count;
+        if (read(shard->event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+            syserr("Reading the inbox eventfd failed\n");
+        if (atomic_load(&runtime->terminated))
+            return true;
+        if (atomic_load(&shard->inbox) != NULL) {
+            // The submitted futures are counted until they are spawned, so `busy` is positive
+            atomic_fetch_add(&runtime->busy, 1);
+            return false;
+        }
+    }
+}
+
+static void *shard_main(void *arg) {
+    Shard *shard = (Shard*)arg;
+    current_shard = shard;
+    // Created by the shard's thread, so that its memory is local to the shard's CPU
+    shard->executor = executor_create(shard->runtime->max_queue_size);
+    do {
+        shard->inbox_future = future_create(inbox_progress);
+        shard->inbox_future.arg = shard;
+        executor_spawn(shard->executor, &shard->inbox_future);
+        executor_run(shard->executor);
+    } while (!shard_wait_idle(shard));
+    executor_destroy(shard->executor);
+    current_shard = NULL;
+    return NULL;
+}
+
+Runtime* runtime_create(size_t n_shards, size_t max_queue_size) {
+    if (n_shards == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return NULL;
+    int cpus[CPU_SETSIZE];
+    int n_cpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed))
+            cpus[n_cpus++] = cpu;
+
+    Runtime *runtime = (Runtime*)malloc(sizeof(Runtime));
+    Shard *shards = (Shard*)calloc(n_shards, sizeof(Shard));
+    if (!runtime || !shards)
+        fatal("Allocation failed\n");
+    runtime->n_shards = n_shards;
+    runtime->max_queue_size = max_queue_size;
+    runtime->shards = shards;
+    atomic_init(&runtime->stopping, false);
+    atomic_init(&runtime->terminated, false);
+    atomic_init(&runtime->busy, n_shards);
+
+    for (size_t i = 0; i < n_shards; ++i) {
+        shards[i].runtime = runtime;
+        shards[i].index = i;
+        atomic_init(&shards[i].inbox, NULL);
+        shards[i].event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shards[i].event_fd == -1)
+            fatal("Creating the inbox eventfd failed\n");
+    }
+    for (size_t i = 0; i < n_shards; ++i) {
+        pthread_attr_t attr;
+        ASSERT_ZERO(pthread_attr_init(&attr));
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(cpus[i % n_cpus], &cpu);
+        ASSERT_ZERO(pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu));
+        ASSERT_ZERO(pthread_create(&shards[i].thread, &attr, shard_main, &shards[i]));
+        ASSERT_ZERO(pthread_attr_destroy(&attr));
+    }
+    return runtime;
+}
+
+size_t runtime_shard_count(Runtime const* runtime) {
+    return runtime->n_shards;
+}
+
+size_t runtime_current_shard(void) {
+    return current_shard ? current_shard->index : RUNTIME_NO_SHARD;
+}
+
+int runtime_submit(Runtime* runtime, size_t shard, Future* fut) {
+    if (shard >= runtime->n_shards) {
+        errno = EINVAL;
+        return -1;
+    }
+    Shard *target = &runtime->shards[shard];
+    if (target == current_shard) {
+        executor_spawn(target->executor, fut);
+        return 0;
+    }
+    atomic_fetch_add(&runtime->busy, 1);
+    Future *head = atomic_load_explicit(&target->inbox, memory_order_relaxed);
+    do {
+        fut->next_queued = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        &target->inbox, &head, fut, memory_order_release, memory_order_relaxed));
+    // Only the submission that makes the inbox non-empty has to wake the shard up
+    if (head == NULL)
+        shard_signal(target);
+    return 0;
+}
+
+void runtime_destroy(Runtime* runtime) {
+    atomic_store(&runtime->stopping, true);
+    for (size_t i = 0; i < runtime->n_shards; ++i)
+        shard_signal(&runtime->shards[i]);
+    for (size_t i = 0; i < runtime->n_shards; ++i)
+        ASSERT_ZERO(pthread_join(runtime->shards[i].thread, NULL));
+    for (size_t i = 0; i < runtime->n_shards; ++i)
+        close(runtime->shards[i].event_fd);
+    free(runtime->shards);
+    free(runtime);
+}
+
+int runtime_listen_reuseport(struct sockaddr const* addr, socklen_t addrlen, int backlog) {
+    int fd = socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1
+            || bind(fd, addr, addrlen) == -1 || listen(fd, backlog) == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
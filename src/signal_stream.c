@@ -0,0 +1,67 @@
+#include "signal_stream.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "err.h"
+#include "log.h"
+
+int signal_stream_open(SignalStream* stream, sigset_t const* signals) {
+    stream->mask = *signals;
+    int err = pthread_sigmask(SIG_BLOCK, signals, &stream->old_mask);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    stream->fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (stream->fd == -1) {
+        err = errno;
+        pthread_sigmask(SIG_SETMASK, &stream->old_mask, NULL);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void signal_stream_close(SignalStream* stream) {
+    if (stream->fd == -1)
+        return;
+    ASSERT_SYS_OK(close(stream->fd));
+    stream->fd = -1;
+    ASSERT_ZERO(pthread_sigmask(SIG_SETMASK, &stream->old_mask, NULL));
+}
+
+static FutureState signal_next_future_progress(Future *base, Mio *mio, Waker waker) {
+    SignalNextFuture *self = (SignalNextFuture*)base;
+    int fd = self->stream->fd;
+    // A buffer of a single record: the other pending signals stay queued for the next futures
+    ssize_t bytes_read = read(fd, &self->info, sizeof(self->info));
+    if (bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (!self->registered) {
+            ASSERT_SYS_OK(mio_register(mio, fd, EPOLLIN, waker));
+            self->registered = true;
+        }
+        return FUTURE_PENDING;
+    }
+    if (self->registered)
+        mio_unregister(mio, fd);
+    self->registered = false;
+    if (bytes_read != sizeof(self->info)) {
+        base->errcode = bytes_read == -1 ? errno : EIO;
+        return FUTURE_FAILURE;
+    }
+    LOG_DEBUG("SignalNextFuture %p: received signal %u from pid %u\n", (void*)self,
+        self->info.ssi_signo, self->info.ssi_pid);
+    base->ok = &self->info;
+    return FUTURE_COMPLETED;
+}
+
+SignalNextFuture signal_stream_next(SignalStream* stream) {
+    return (SignalNextFuture) {
+        .base = future_create(signal_next_future_progress),
+        .stream = stream,
+        .registered = false,
+    };
+}
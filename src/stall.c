@@ -0,0 +1,125 @@
+// Required for `dlfcn.h` to contain `dladdr`.
+#define _GNU_SOURCE
+
+#include "stall.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "err.h"
+#include "log.h"
+
+// The watchdog checks the executor this many times per threshold
+#define STALL_CHECKS_PER_THRESHOLD 4
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report_stall(Future *fut, ProgressFn progress, uint64_t running_ns) {
+    Dl_info info;
+    void *addr = *(void**)&progress; // function to object pointer, as dladdr() wants it
+    // `info` is only set if dladdr() succeeds
+    bool found = dladdr(addr, &info) != 0;
+    if (found && info.dli_sname) {
+        LOG_WARN("Stall: task %p has been in %s (%p) for %llu us\n", (void*)fut, info.dli_sname,
+            addr, (unsigned long long)(running_ns / 1000));
+    } else if (found && info.dli_fname) {
+        // Static functions aren't in the dynamic symbol table: give the offset for addr2line
+        LOG_WARN("Stall: task %p has been in %s+%#lx (%p) for %llu us\n", (void*)fut,
+            info.dli_fname, (unsigned long)((char*)addr - (char*)info.dli_fbase), addr,
+            (unsigned long long)(running_ns / 1000));
+    } else {
+        LOG_WARN("Stall: task %p has been in %p for %llu us\n", (void*)fut, addr,
+            (unsigned long long)(running_ns / 1000));
+    }
+    log_flush(); // the watchdog's buffer would otherwise wait until it is full
+}
+
+// Returns whether the detector is being stopped
+static bool sleep_until(StallDetector *detector, uint64_t deadline_ns) {
+    struct timespec deadline = {
+        .tv_sec = deadline_ns / 1000000000,
+        .tv_nsec = deadline_ns % 1000000000,
+    };
+    ASSERT_ZERO(pthread_mutex_lock(&detector->mutex));
+    while (!detector->stopping) {
+        int ret = pthread_cond_timedwait(&detector->stop, &detector->mutex, &deadline);
+        if (ret == ETIMEDOUT)
+            break;
+        if (ret != 0)
+            fatal("Waiting for the stall detector to stop failed\n");
+    }
+    bool stopping = detector->stopping;
+    ASSERT_ZERO(pthread_mutex_unlock(&detector->mutex));
+    return stopping;
+}
+
+static void *watchdog_main(void *arg) {
+    StallDetector *detector = (StallDetector*)arg;
+    uint64_t period_ns = detector->threshold_ns / STALL_CHECKS_PER_THRESHOLD;
+    uint64_t reported_seq = 0; // progress call reported last (0 - none, as it's always odd)
+    uint64_t next_check_ns = monotonic_ns() + period_ns;
+    while (!sleep_until(detector, next_check_ns)) {
+        next_check_ns += period_ns;
+        uint64_t seq = atomic_load_explicit(&detector->seq, memory_order_acquire);
+        if (seq % 2 == 0) // no progress call is running
+            continue;
+        Future *fut = atomic_load_explicit(&detector->future, memory_order_relaxed);
+        ProgressFn progress = atomic_load_explicit(&detector->progress, memory_order_relaxed);
+        uint64_t start_ns = atomic_load_explicit(&detector->start_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&detector->seq, memory_order_relaxed) != seq)
+            continue; // the call has just ended
+        uint64_t now_ns = monotonic_ns();
+        uint64_t running_ns = now_ns > start_ns ? now_ns - start_ns : 0;
+        if (running_ns < detector->threshold_ns)
+            continue;
+        if (running_ns > atomic_load_explicit(&detector->max_stall_ns, memory_order_relaxed))
+            atomic_store_explicit(&detector->max_stall_ns, running_ns, memory_order_relaxed);
+        if (seq == reported_seq) // still the same stall
+            continue;
+        reported_seq = seq;
+        atomic_fetch_add_explicit(&detector->stalls, 1, memory_order_relaxed);
+        report_stall(fut, progress, running_ns);
+    }
+    log_flush();
+    return NULL;
+}
+
+StallDetector *stall_detector_create(uint64_t threshold_ns) {
+    StallDetector *detector = (StallDetector*)malloc(sizeof(StallDetector));
+    if (!detector)
+        fatal("Allocation failed\n");
+    detector->threshold_ns = threshold_ns;
+    atomic_init(&detector->seq, 0);
+    atomic_init(&detector->future, NULL);
+    atomic_init(&detector->progress, NULL);
+    atomic_init(&detector->start_ns, 0);
+    atomic_init(&detector->stalls, 0);
+    atomic_init(&detector->max_stall_ns, 0);
+    detector->stopping = false;
+    ASSERT_ZERO(pthread_mutex_init(&detector->mutex, NULL));
+    pthread_condattr_t attr;
+    ASSERT_ZERO(pthread_condattr_init(&attr));
+    ASSERT_ZERO(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC));
+    ASSERT_ZERO(pthread_cond_init(&detector->stop, &attr));
+    ASSERT_ZERO(pthread_condattr_destroy(&attr));
+    ASSERT_ZERO(pthread_create(&detector->thread, NULL, watchdog_main, detector));
+    return detector;
+}
+
+void stall_detector_destroy(StallDetector *detector) {
+    ASSERT_ZERO(pthread_mutex_lock(&detector->mutex));
+    detector->stopping = true;
+    ASSERT_ZERO(pthread_cond_signal(&detector->stop));
+    ASSERT_ZERO(pthread_mutex_unlock(&detector->mutex));
+    ASSERT_ZERO(pthread_join(detector->thread, NULL));
+    ASSERT_ZERO(pthread_cond_destroy(&detector->stop));
+    ASSERT_ZERO(pthread_mutex_destroy(&detector->mutex));
+    free(detector);
+}
@@ -0,0 +1,51 @@
+#ifndef STALL_H
+#define STALL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "future.h"
+
+// Internal watchdog of an executor: a thread that periodically checks whether the progress call
+// that is currently running on the executor's thread has exceeded the threshold, and reports it.
+
+typedef struct StallDetector {
+    uint64_t threshold_ns;
+    // Published by the executor's thread: `seq` is odd during a progress call, and the other
+    // fields describe that call (they are only consistent if `seq` hasn't changed meanwhile).
+    atomic_uint_fast64_t seq;
+    _Atomic(Future*) future;
+    _Atomic(ProgressFn) progress;
+    atomic_uint_fast64_t start_ns;
+    // Results, read by the executor's thread
+    atomic_uint_fast64_t stalls; // number of progress calls detected to exceed the threshold
+    atomic_uint_fast64_t max_stall_ns; // longest progress call seen by the watchdog
+    pthread_t thread;
+    pthread_mutex_t mutex; // protects `stopping`
+    pthread_cond_t stop;
+    bool stopping;
+} StallDetector;
+
+// Creates a stall detector and starts its watchdog thread
+StallDetector *stall_detector_create(uint64_t threshold_ns);
+
+// Stops the watchdog thread and frees the detector
+void stall_detector_destroy(StallDetector *detector);
+
+static inline void stall_detector_begin(StallDetector *detector, Future *fut, uint64_t start_ns) {
+    // Keeps the stores below after the increment that ended the previous call: a watchdog that
+    // reads any of them then sees `seq` changed and drops the mixed record
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&detector->future, fut, memory_order_relaxed);
+    atomic_store_explicit(&detector->progress, fut->progress, memory_order_relaxed);
+    atomic_store_explicit(&detector->start_ns, start_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&detector->seq, 1, memory_order_release);
+}
+
+static inline void stall_detector_end(StallDetector *detector) {
+    atomic_fetch_add_explicit(&detector->seq, 1, memory_order_release);
+}
+
+#endif // STALL_H
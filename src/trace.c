@@ -0,0 +1,101 @@
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "err.h"
+#include "future.h"
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void tracer_init(Tracer *tracer) {
+#ifdef EXECUTOR_TRACE
+    tracer->events = (TraceEvent*)malloc(EXECUTOR_TRACE_CAPACITY * sizeof(TraceEvent));
+    if (!tracer->events)
+        fatal("Allocation failed\n");
+#else
+    tracer->events = NULL;
+#endif
+    tracer->n_recorded = 0;
+    tracer->start_timestamp = trace_timestamp();
+    tracer->start_ns = monotonic_ns();
+}
+
+void tracer_destroy(Tracer *tracer) {
+    free(tracer->events);
+}
+
+static const char *future_state_name(uint64_t state) {
+    switch (state) {
+    case FUTURE_PENDING:
+        return "pending";
+    case FUTURE_COMPLETED:
+        return "completed";
+    default:
+        return "failure";
+    }
+}
+
+// Tasks get a track each (identified by the future's address), Mio events go to track 0
+int tracer_dump_chrome(Tracer const *tracer, FILE *out) {
+    // Calibrate the timestamps against the clock over the whole lifetime of the tracer
+    double ns_per_tick = 1.0;
+    uint64_t elapsed_ticks = trace_timestamp() - tracer->start_timestamp;
+    if (elapsed_ticks != 0)
+        ns_per_tick = (double)(monotonic_ns() - tracer->start_ns) / elapsed_ticks;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+                 "\"args\": {\"name\": \"mio\"}}");
+    uint64_t first = tracer->n_recorded > EXECUTOR_TRACE_CAPACITY
+        ? tracer->n_recorded - EXECUTOR_TRACE_CAPACITY
+        : 0;
+    for (uint64_t i = first; i < tracer->n_recorded; ++i) {
+        TraceEvent const *event = &tracer->events[i & (EXECUTOR_TRACE_CAPACITY - 1)];
+        double ts = (double)(int64_t)(event->timestamp - tracer->start_timestamp) * ns_per_tick / 1000;
+        uintptr_t ptr = (uintptr_t)event->ptr;
+        fprintf(out, ",\n");
+        switch (event->type) {
+        case TRACE_SPAWN:
+            fprintf(out, "{\"name\": \"spawn\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": 1, "
+                         "\"tid\": %" PRIuPTR "}", ts, ptr);
+            break;
+        case TRACE_WAKE:
+            fprintf(out, "{\"name\": \"wake\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": 1, "
+                         "\"tid\": %" PRIuPTR ", \"args\": {\"by\": \"0x%" PRIx64 "\"}}", ts, ptr, event->arg);
+            break;
+        case TRACE_PROGRESS_BEGIN:
+            fprintf(out, "{\"name\": \"progress\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, "
+                         "\"tid\": %" PRIuPTR ", \"args\": {\"future\": \"0x%" PRIxPTR "\", "
+                         "\"fn\": \"0x%" PRIx64 "\"}}", ts, ptr, ptr, event->arg);
+            break;
+        case TRACE_PROGRESS_END:
+            fprintf(out, "{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": %" PRIuPTR ", "
+                         "\"args\": {\"state\": \"%s\"}}", ts, ptr, future_state_name(event->arg));
+            break;
+        case TRACE_POLL_BEGIN:
+            fprintf(out, "{\"name\": \"mio_poll\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, \"tid\": 0, "
+                         "\"args\": {\"timeout_ms\": %d}}", ts, (int)event->arg);
+            break;
+        case TRACE_POLL_END:
+            fprintf(out, "{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": 0, "
+                         "\"args\": {\"events\": %d}}", ts, (int)event->arg);
+            break;
+        case TRACE_REGISTER:
+            fprintf(out, "{\"name\": \"register\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": 1, "
+                         "\"tid\": 0, \"args\": {\"fd\": %d, \"events\": %u, \"future\": \"0x%" PRIxPTR "\"}}",
+                ts, (int)(uint32_t)event->arg, (unsigned)(event->arg >> 32), ptr);
+            break;
+        case TRACE_UNREGISTER:
+            fprintf(out, "{\"name\": \"unregister\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": 1, "
+                         "\"tid\": 0, \"args\": {\"fd\": %d}}", ts, (int)event->arg);
+            break;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return ferror(out) ? -1 : 0;
+}
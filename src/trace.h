@@ -0,0 +1,75 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "executor.h"
+
+// Internal event tracer of an executor, compiled in only when EXECUTOR_TRACE is defined
+// (configure with -DEXECUTOR_TRACE=ON). Events are stored in a ring buffer, so only
+// the last EXECUTOR_TRACE_CAPACITY (see executor.h) of them are kept.
+
+typedef enum TraceEventType {
+    TRACE_SPAWN, // ptr - spawned future
+    TRACE_WAKE, // ptr - woken future, arg - waking future (0 if woken from outside of a task)
+    TRACE_PROGRESS_BEGIN, // ptr - progressed future, arg - its progress function
+    TRACE_PROGRESS_END, // ptr - progressed future, arg - returned FutureState
+    TRACE_POLL_BEGIN, // ptr - Mio, arg - timeout in milliseconds
+    TRACE_POLL_END, // ptr - Mio, arg - number of events
+    TRACE_REGISTER, // ptr - future to be woken, arg - fd | (events << 32)
+    TRACE_UNREGISTER, // ptr - Mio, arg - fd
+} TraceEventType;
+
+typedef struct TraceEvent {
+    uint64_t timestamp; // TSC (or nanoseconds where it's not available)
+    void const *ptr;
+    uint64_t arg;
+    TraceEventType type;
+} TraceEvent;
+
+typedef struct Tracer {
+    TraceEvent *events; // ring buffer of EXECUTOR_TRACE_CAPACITY events
+    uint64_t n_recorded; // number of events recorded so far
+    uint64_t start_timestamp; // timestamp and clock at initialization,
+    uint64_t start_ns; // to convert timestamps to time when dumping
+} Tracer;
+
+static inline uint64_t trace_timestamp(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void tracer_record(Tracer *tracer, TraceEventType type, void const *ptr, uint64_t arg) {
+    TraceEvent *event = &tracer->events[tracer->n_recorded++ & (EXECUTOR_TRACE_CAPACITY - 1)];
+    event->timestamp = trace_timestamp();
+    event->ptr = ptr;
+    event->arg = arg;
+    event->type = type;
+}
+
+#ifdef EXECUTOR_TRACE
+#define TRACE(tracer, type, ptr, arg) tracer_record((tracer), (type), (ptr), (uint64_t)(arg))
+#else
+#define TRACE(tracer, type, ptr, arg) ((void)0)
+#endif
+
+void tracer_init(Tracer *tracer);
+void tracer_destroy(Tracer *tracer);
+
+// Write the recorded events as Chrome/Perfetto trace JSON; returns 0 on success, -1 on failure
+int tracer_dump_chrome(Tracer const *tracer, FILE *out);
+
+// Tracer of the executor (NULL if tracing is not compiled in)
+Tracer *executor_tracer(Executor *executor);
+
+#endif // TRACE_H
@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdint.h> // For uint8_t
+#include <stdio.h> // For printf
+#include <string.h> // For memcmp, strlen
+#include <unistd.h> // For STDOUT_FILENO
+
+#include "async.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "utils.h"
+
+#define MESSAGE "aaabbbcccd\n"
+#define YIELDS 5
+
+/** A function that capitalizes a c-string in place and returns it. */
+static void* capitalize(void* arg)
+{
+    char* buffer = arg;
+    for (size_t i = 0; buffer[i]; ++i)
+        if ('a' <= buffer[i] && buffer[i] <= 'z')
+            buffer[i] = buffer[i] - 'a' + 'A';
+    return buffer;
+}
+
+/** The chain of then_test (read, capitalize, print) written as a coroutine. */
+typedef struct ReadCapitalizePrintFuture {
+    Future base;
+    int state;
+    int yields;
+    PipeReadFuture read;
+    PipeWriteFuture write;
+    uint8_t buffer[sizeof(MESSAGE)];
+} ReadCapitalizePrintFuture;
+
+static FutureState read_capitalize_print_progress(Future* base, Mio* mio, Waker waker)
+{
+    ReadCapitalizePrintFuture* self = (ReadCapitalizePrintFuture*)base;
+    ASYNC_BEGIN(base, self->state);
+    self->read = pipe_read_future_create((int)(intptr_t)base->arg, self->buffer, sizeof(self->buffer));
+    AWAIT(&self->read);
+    capitalize(self->read.base.ok);
+    for (self->yields = 0; self->yields < YIELDS; ++self->yields)
+        YIELD();
+    self->write = pipe_write_future_create(STDOUT_FILENO, sizeof(self->buffer), true);
+    self->write.base.arg = self->buffer;
+    AWAIT(&self->write);
+    ASYNC_END(self->write.base.ok);
+}
+
+/** Tries to read more than there is in the pipe, and handles the failure itself. */
+typedef struct ReadTooMuchFuture {
+    Future base;
+    int state;
+    FutureState read_result;
+    PipeReadFuture read;
+    uint8_t buffer[100];
+} ReadTooMuchFuture;
+
+static FutureState read_too_much_progress(Future* base, Mio* mio, Waker waker)
+{
+    ReadTooMuchFuture* self = (ReadTooMuchFuture*)base;
+    ASYNC_BEGIN(base, self->state);
+    self->read = pipe_read_future_create((int)(intptr_t)base->arg, self->buffer, sizeof(self->buffer));
+    AWAIT_RESULT(&self->read, self->read_result);
+    if (self->read_result == FUTURE_FAILURE)
+        ASYNC_RETURN(self->read.read_so_far);
+    ASYNC_END(NULL);
+}
+
+/** Like ReadTooMuchFuture, but lets the failure propagate. */
+typedef struct FailingFuture {
+    Future base;
+    int state;
+    PipeReadFuture read;
+    uint8_t buffer[100];
+} FailingFuture;
+
+static FutureState failing_progress(Future* base, Mio* mio, Waker waker)
+{
+    FailingFuture* self = (FailingFuture*)base;
+    ASYNC_BEGIN(base, self->state);
+    self->read = pipe_read_future_create((int)(intptr_t)base->arg, self->buffer, sizeof(self->buffer));
+    AWAIT(&self->read);
+    ASYNC_END(self->buffer); // not reached
+}
+
+int main()
+{
+    Executor* executor = executor_create(42);
+
+    int fds[3];
+    for (int i = 0; i < 3; ++i)
+        fds[i] = create_example_read_pipe_end(MESSAGE, 3, 0, 1);
+
+    ReadCapitalizePrintFuture good = { .base = future_create(read_capitalize_print_progress) };
+    good.base.arg = (void*)(intptr_t)fds[0];
+    ReadTooMuchFuture handled = { .base = future_create(read_too_much_progress) };
+    handled.base.arg = (void*)(intptr_t)fds[1];
+    FailingFuture failing = { .base = future_create(failing_progress) };
+    failing.base.arg = (void*)(intptr_t)fds[2];
+
+    executor_spawn(executor, (Future*)&good);
+    executor_spawn(executor, (Future*)&handled);
+    executor_spawn(executor, (Future*)&failing);
+    executor_run(executor);
+
+    assert(good.base.errcode == FUTURE_SUCCESS);
+    assert(good.base.ok == good.buffer);
+    assert(memcmp(good.buffer, "AAABBBCCCD\n", sizeof(good.buffer)) == 0);
+    assert(good.yields == YIELDS);
+    assert(good.state == ASYNC_STATE_DONE);
+
+    assert(handled.base.errcode == FUTURE_SUCCESS);
+    assert((size_t)handled.base.ok == sizeof(MESSAGE)); // the whole message, with the zero byte
+
+    assert(failing.base.errcode == PIPE_FUTURE_ERR_EOF);
+    assert(failing.state == ASYNC_STATE_DONE);
+
+    executor_destroy(executor);
+    for (int i = 0; i < 3; ++i)
+        close(fds[i]);
+    printf("Coroutines completed\n");
+    return 0;
+}
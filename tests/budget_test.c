@@ -0,0 +1,159 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf
+#include <sys/socket.h> // For socketpair, send
+#include <unistd.h> // For pipe, write
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_combinators.h"
+#include "future_examples.h"
+
+#define MAX_SPINS 1000000
+#define SPINS_BEFORE_WRITE 10
+#define TASK_BUDGET 4
+#define MESSAGES 64
+
+static int write_fd;
+static int spins = 0;
+static int spins_when_read = -1;
+
+/** A future that keeps waking itself up and writes a message to the pipe on the way. */
+static FutureState spinning_future_progress(Future* fut, Mio* mio, Waker waker)
+{
+    ++spins;
+    if (spins == SPINS_BEFORE_WRITE)
+        ASSERT_SYS_OK(write(write_fd, "ping", 4));
+
+    if (spins_when_read == -1 && spins < MAX_SPINS) {
+        waker_wake(&waker);
+        return FUTURE_PENDING;
+    }
+    return FUTURE_COMPLETED;
+}
+
+static void* record_spins(void* arg)
+{
+    spins_when_read = spins;
+    return arg;
+}
+
+/** Records how much the reader has read each time it runs, until the reader completes. */
+typedef struct ObserverFuture {
+    Future base;
+    PipeReadFuture* reader;
+    size_t observed[MESSAGES + 1];
+    int n_observed;
+} ObserverFuture;
+
+static FutureState observer_progress(Future* fut, Mio* mio, Waker waker)
+{
+    ObserverFuture* self = (ObserverFuture*)fut;
+    assert(self->n_observed <= MESSAGES);
+    self->observed[self->n_observed++] = self->reader->read_so_far;
+    if (self->reader->read_so_far == self->reader->n)
+        return FUTURE_COMPLETED;
+    waker_wake(&waker);
+    return FUTURE_PENDING;
+}
+
+// Reads MESSAGES one-byte datagrams that are all there already with the given task budget,
+// next to an observer that is always ready
+static void run_reader_with_observer(unsigned budget, ObserverFuture* observer)
+{
+    int fds[2];
+    ASSERT_SYS_OK(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds));
+    for (int i = 0; i < MESSAGES; ++i) {
+        char byte = (char)i;
+        ASSERT_SYS_OK(send(fds[1], &byte, 1, 0));
+    }
+
+    Executor* executor = executor_create(42);
+    executor_set_task_budget(executor, budget);
+    uint8_t buffer[MESSAGES];
+    // Each read() returns a single datagram, so the reader needs MESSAGES of them
+    PipeReadFuture reader = pipe_read_future_create(fds[0], buffer, sizeof(buffer));
+    *observer = (ObserverFuture) {
+        .base = future_create(observer_progress),
+        .reader = &reader,
+        .n_observed = 0,
+    };
+    executor_spawn(executor, (Future*)&reader);
+    executor_spawn(executor, (Future*)observer);
+    executor_run(executor);
+
+    assert(reader.base.errcode == FUTURE_SUCCESS);
+    for (int i = 0; i < MESSAGES; ++i)
+        assert(buffer[i] == (uint8_t)i);
+    // Yielding doesn't touch the reader's registration: only its completion unregisters it
+    ExecutorStats stats;
+    executor_stats(executor, &stats);
+    assert(stats.mio.ctl_add == 0 && stats.mio.ctl_del == 1);
+    executor_destroy(executor);
+    ASSERT_SYS_OK(close(fds[0]));
+    ASSERT_SYS_OK(close(fds[1]));
+}
+
+static void test_task_budget(void)
+{
+    // A test that checks that a reader whose descriptor always has data is preempted
+    // once it has used up its budget, letting the other ready task run in between.
+
+    ObserverFuture observer;
+    run_reader_with_observer(TASK_BUDGET, &observer);
+    printf("With a budget of %d, the observer ran %d times\n", TASK_BUDGET, observer.n_observed);
+    // The reader runs first, then they take turns: the reader reads TASK_BUDGET datagrams a time
+    assert(observer.n_observed == MESSAGES / TASK_BUDGET);
+    for (int i = 0; i < observer.n_observed; ++i)
+        assert(observer.observed[i] == (size_t)(i + 1) * TASK_BUDGET);
+
+    // With an unlimited budget, the reader reads everything in its first progress() call
+    run_reader_with_observer(0, &observer);
+    assert(observer.n_observed == 1 && observer.observed[0] == MESSAGES);
+}
+
+static void test_poll_interval(void)
+{
+    // A test that checks that a task waiting for I/O is not starved by a task that keeps yielding.
+    // Without interleaving I/O polling with ready tasks, the read would only complete
+    // after the spinning task has finished.
+
+    int pipe_fds[2];
+    ASSERT_SYS_OK(pipe2(pipe_fds, O_NONBLOCK));
+    write_fd = pipe_fds[1];
+
+    Executor* executor = executor_create(42);
+    executor_set_poll_interval(executor, 100, 0);
+
+    uint8_t buffer[4];
+    PipeReadFuture read = pipe_read_future_create(pipe_fds[0], buffer, sizeof(buffer));
+    ApplyFuture record = apply_future_create(record_spins);
+    ThenFuture read_and_record = future_then((Future*)&read, (Future*)&record);
+    Future spinning = future_create(spinning_future_progress);
+
+    executor_spawn(executor, (Future*)&read_and_record);
+    executor_spawn(executor, &spinning);
+
+    executor_run(executor);
+
+    printf("Read completed after %d spins\n", spins_when_read);
+    assert(read_and_record.base.errcode == FUTURE_SUCCESS);
+    assert(spins_when_read >= SPINS_BEFORE_WRITE);
+    assert(spins_when_read <= SPINS_BEFORE_WRITE + 2 * 100);
+
+    executor_destroy(executor);
+    ASSERT_SYS_OK(close(pipe_fds[0]));
+    ASSERT_SYS_OK(close(pipe_fds[1]));
+}
+
+int main()
+{
+    test_poll_interval();
+    test_task_budget();
+    return 0;
+}
@@ -0,0 +1,223 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h> // For EPIPE
+#include <fcntl.h> // For O_NONBLOCK
+#include <signal.h> // For signal
+#include <stdint.h> // For uint64_t
+#include <stdio.h> // For printf
+#include <string.h> // For memcmp
+#include <unistd.h> // For pipe2, close
+
+#include "async.h"
+#include "buf_writer.h"
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+
+#define MS 1000000ULL
+#define N_MESSAGES 1000
+#define MESSAGE_SIZE 32
+#define N_SMALL 20
+#define SMALL_SIZE 50
+#define LARGE_SIZE 500
+
+/** Flushes the writer, then closes it. */
+typedef struct CloserFuture {
+    Future base;
+    int state;
+    BufFlushFuture flush;
+} CloserFuture;
+
+static FutureState closer_progress(Future* base, Mio* mio, Waker waker)
+{
+    CloserFuture* self = (CloserFuture*)base;
+    ASYNC_BEGIN(base, self->state);
+    AWAIT(&self->flush);
+    buf_writer_close(self->flush.writer);
+    ASYNC_END(NULL);
+}
+
+static CloserFuture closer_create(BufWriter* writer)
+{
+    return (CloserFuture) {
+        .base = future_create(closer_progress),
+        .state = 0,
+        .flush = buf_flush_future_create(writer),
+    };
+}
+
+static void test_coalescing(Executor* executor)
+{
+    int fds[2];
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK));
+    static uint8_t data[N_MESSAGES * MESSAGE_SIZE], received[N_MESSAGES * MESSAGE_SIZE];
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = (uint8_t)(i / MESSAGE_SIZE);
+
+    BufWriter writer;
+    buf_writer_init(&writer, fds[1], 4096, 0, 0);
+    static BufWriteFuture writes[N_MESSAGES];
+    executor_spawn(executor, buf_writer_flusher(&writer));
+    for (size_t i = 0; i < N_MESSAGES; ++i) {
+        writes[i] = buf_write_future_create(&writer, MESSAGE_SIZE);
+        writes[i].base.arg = data + i * MESSAGE_SIZE;
+        executor_spawn(executor, (Future*)&writes[i]);
+    }
+    executor_run_until_idle(executor); // everything fits in the pipe
+    CloserFuture closer = closer_create(&writer);
+    executor_spawn(executor, (Future*)&closer);
+    PipeReadFuture read = pipe_read_future_create(fds[0], received, sizeof(received));
+    executor_spawn(executor, (Future*)&read);
+    executor_run(executor);
+
+    printf("%llu writes took %llu write() calls\n", (unsigned long long)writer.writes,
+        (unsigned long long)writer.syscalls);
+    assert(read.base.errcode == FUTURE_SUCCESS && closer.base.errcode == FUTURE_SUCCESS);
+    assert(writer.flusher.errcode == FUTURE_SUCCESS);
+    assert(writer.writes == N_MESSAGES);
+    assert(writer.syscalls * 10 <= N_MESSAGES);
+    assert(memcmp(data, received, sizeof(data)) == 0);
+    buf_writer_destroy(&writer);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_backpressure(Executor* executor)
+{
+    // Writes larger than the free space wait for the flusher; one is larger than the buffer.
+    int fds[2];
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK));
+    enum { TOTAL = N_SMALL * SMALL_SIZE + LARGE_SIZE };
+    static uint8_t data[TOTAL], received[TOTAL];
+    for (size_t i = 0; i < TOTAL; ++i)
+        data[i] = (uint8_t)(i * 7);
+
+    BufWriter writer;
+    buf_writer_init(&writer, fds[1], 128, 0, 0);
+    BufWriteFuture writes[N_SMALL + 1];
+    executor_spawn(executor, buf_writer_flusher(&writer));
+    size_t offset = 0;
+    for (size_t i = 0; i <= N_SMALL; ++i) {
+        size_t size = i == N_SMALL / 2 ? LARGE_SIZE : SMALL_SIZE;
+        writes[i] = buf_write_future_create(&writer, size);
+        writes[i].base.arg = data + offset;
+        offset += size;
+        executor_spawn(executor, (Future*)&writes[i]);
+    }
+    executor_run_until_idle(executor); // everything fits in the pipe
+    CloserFuture closer = closer_create(&writer);
+    executor_spawn(executor, (Future*)&closer);
+    PipeReadFuture read = pipe_read_future_create(fds[0], received, TOTAL);
+    executor_spawn(executor, (Future*)&read);
+    executor_run(executor);
+
+    assert(read.base.errcode == FUTURE_SUCCESS && writer.flusher.errcode == FUTURE_SUCCESS);
+    assert(memcmp(data, received, TOTAL) == 0); // in order, not interleaved
+    // Writes after closing fail
+    BufWriteFuture late = buf_write_future_create(&writer, 1);
+    late.base.arg = data;
+    executor_spawn(executor, (Future*)&late);
+    executor_run(executor);
+    assert(late.base.errcode == BUF_WRITER_ERR_CLOSED);
+    buf_writer_destroy(&writer);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_idle_flush(Executor* executor)
+{
+    // Below the threshold, the bytes are written by the idle tick.
+    int fds[2];
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK));
+    uint8_t data[10] = "idle tick", received[10];
+    BufWriter writer;
+    buf_writer_init(&writer, fds[1], 0, 0, 20 * MS);
+    executor_spawn(executor, buf_writer_flusher(&writer));
+    BufWriteFuture write = buf_write_future_create(&writer, sizeof(data));
+    write.base.arg = data;
+    executor_spawn(executor, (Future*)&write);
+    PipeReadFuture read = pipe_read_future_create(fds[0], received, sizeof(received));
+    executor_spawn(executor, (Future*)&read);
+    uint64_t start = executor_now_ns(executor);
+    while (read.base.errcode == FUTURE_SUCCESS && !read.base.ok)
+        executor_tick(executor, -1);
+    uint64_t elapsed = executor_now_ns(executor) - start;
+    printf("Idle flush after %llu ms\n", (unsigned long long)(elapsed / MS));
+    assert(elapsed >= 20 * MS && elapsed < 1000 * MS);
+    assert(memcmp(data, received, sizeof(data)) == 0);
+    assert(writer.syscalls == 1);
+    buf_writer_close(&writer);
+    executor_run(executor);
+    assert(writer.flusher.errcode == FUTURE_SUCCESS);
+    buf_writer_destroy(&writer);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_explicit_flush(Executor* executor)
+{
+    // Neither the threshold nor an idle tick: only the flush future writes the bytes.
+    int fds[2];
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK));
+    uint8_t data[6] = "flush";
+    BufWriter writer;
+    buf_writer_init(&writer, fds[1], 0, 0, 0);
+    executor_spawn(executor, buf_writer_flusher(&writer));
+    BufWriteFuture write = buf_write_future_create(&writer, sizeof(data));
+    write.base.arg = data;
+    executor_spawn(executor, (Future*)&write);
+    executor_run_until_idle(executor);
+    assert(write.base.ok == data && writer.syscalls == 0);
+
+    BufFlushFuture flush = buf_flush_future_create(&writer);
+    executor_spawn(executor, (Future*)&flush);
+    executor_run_until_idle(executor);
+    assert(flush.base.errcode == FUTURE_SUCCESS && writer.flushed == sizeof(data));
+    uint8_t received[sizeof(data)];
+    ssize_t bytes_read = read(fds[0], received, sizeof(received));
+    assert(bytes_read == sizeof(data));
+    assert(memcmp(data, received, sizeof(data)) == 0);
+
+    buf_writer_close(&writer);
+    executor_run(executor);
+    buf_writer_destroy(&writer);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_write_error(Executor* executor)
+{
+    // Writing to a pipe without readers fails the flusher, and the flush with it.
+    int fds[2];
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK));
+    close(fds[0]);
+    uint8_t data[4] = "err";
+    BufWriter writer;
+    buf_writer_init(&writer, fds[1], 0, 0, 0);
+    executor_spawn(executor, buf_writer_flusher(&writer));
+    BufWriteFuture write = buf_write_future_create(&writer, sizeof(data));
+    write.base.arg = data;
+    executor_spawn(executor, (Future*)&write);
+    BufFlushFuture flush = buf_flush_future_create(&writer);
+    executor_spawn(executor, (Future*)&flush);
+    executor_run(executor);
+    assert(writer.flusher.errcode == EPIPE && flush.base.errcode == EPIPE);
+    buf_writer_destroy(&writer);
+    close(fds[1]);
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+    Executor* executor = executor_create(0);
+    test_coalescing(executor);
+    test_backpressure(executor);
+    test_idle_flush(executor);
+    test_explicit_flush(executor);
+    test_write_error(executor);
+    executor_destroy(executor);
+    return 0;
+}
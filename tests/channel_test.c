@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf
+
+#include "channel.h"
+#include "executor.h"
+#include "future.h"
+
+#define MAX_COUNT 100
+#define N_OBSERVERS 100
+#define N_MESSAGES 10
+#define CAPACITY 4
+
+// ========================= watch =========================
+
+/** Does some work in stages, publishing its progress after each one. */
+static FutureState worker_progress(Future* base, Mio* mio, Waker waker)
+{
+    WatchChannel* progress = base->arg;
+    intptr_t done = (intptr_t)progress->value + 2;
+    watch_send(progress, (void*)done);
+    if (done < MAX_COUNT) {
+        waker_wake(&waker);
+        return FUTURE_PENDING;
+    }
+    watch_close(progress);
+    return FUTURE_COMPLETED;
+}
+
+/** Displays the progress whenever it changes (instead of yielding and checking it continuously). */
+typedef struct ObserverFuture {
+    Future base;
+    WatchReceiver receiver;
+    WatchChangedFuture changed;
+    int calls;
+    int changes;
+    intptr_t last_seen;
+} ObserverFuture;
+
+static FutureState observer_progress(Future* base, Mio* mio, Waker waker)
+{
+    ObserverFuture* self = (ObserverFuture*)base;
+    ++self->calls;
+    for (;;) {
+        FutureState state = self->changed.base.progress((Future*)&self->changed, mio, waker);
+        if (state == FUTURE_PENDING)
+            return FUTURE_PENDING;
+        if (state == FUTURE_FAILURE) {
+            assert(self->changed.base.errcode == CHANNEL_ERR_CLOSED);
+            return FUTURE_COMPLETED;
+        }
+        assert((intptr_t)self->changed.base.ok > self->last_seen);
+        self->last_seen = (intptr_t)self->changed.base.ok;
+        ++self->changes;
+        self->changed = watch_changed(&self->receiver);
+    }
+}
+
+static void test_watch(void)
+{
+    Executor* executor = executor_create(0);
+    WatchChannel progress;
+    watch_channel_init(&progress, (void*)0);
+
+    Future worker = future_create(worker_progress);
+    worker.arg = &progress;
+    static ObserverFuture observers[N_OBSERVERS];
+    for (int i = 0; i < N_OBSERVERS; ++i) {
+        observers[i] = (ObserverFuture) { .base = future_create(observer_progress) };
+        observers[i].receiver = watch_subscribe(&progress);
+        observers[i].changed = watch_changed(&observers[i].receiver);
+        executor_spawn(executor, (Future*)&observers[i]);
+    }
+    executor_spawn(executor, &worker);
+    executor_run(executor);
+
+    for (int i = 0; i < N_OBSERVERS; ++i) {
+        // Every observer saw the final value and was woken up once per change it observed.
+        assert(observers[i].last_seen == MAX_COUNT);
+        assert(observers[i].changes == MAX_COUNT / 2);
+        assert(observers[i].calls <= observers[i].changes + 2);
+    }
+    ExecutorStats stats;
+    executor_stats(executor, &stats);
+    printf("watch: %llu wakes for %d observers and %d changes\n", (unsigned long long)stats.wakes,
+        N_OBSERVERS, MAX_COUNT / 2);
+    assert(stats.wakes <= (uint64_t)(N_OBSERVERS + 1) * (MAX_COUNT / 2 + 1));
+
+    // A receiver that doesn't keep up only sees the latest value.
+    WatchReceiver late = { .channel = &progress, .seen_version = 0 };
+    WatchChangedFuture changed = watch_changed(&late);
+    FutureState state = executor_block_on(executor, (Future*)&changed);
+    assert(state == FUTURE_COMPLETED);
+    assert((intptr_t)changed.base.ok == MAX_COUNT);
+    changed = watch_changed(&late);
+    state = executor_block_on(executor, (Future*)&changed);
+    assert(state == FUTURE_FAILURE);
+    assert(changed.base.errcode == CHANNEL_ERR_CLOSED);
+    executor_destroy(executor);
+}
+
+// ========================= broadcast =========================
+
+/** Sends a message per progress() call, letting the subscribers run in between. */
+static FutureState sender_progress(Future* base, Mio* mio, Waker waker)
+{
+    BroadcastChannel* channel = base->arg;
+    if (channel->sent == N_MESSAGES) {
+        broadcast_close(channel);
+        return FUTURE_COMPLETED;
+    }
+    broadcast_send(channel, (void*)(intptr_t)channel->sent);
+    waker_wake(&waker);
+    return FUTURE_PENDING;
+}
+
+/** Receives every message until the channel is closed. */
+typedef struct SubscriberFuture {
+    Future base;
+    BroadcastReceiver receiver;
+    BroadcastRecvFuture recv;
+    int received;
+} SubscriberFuture;
+
+static FutureState subscriber_progress(Future* base, Mio* mio, Waker waker)
+{
+    SubscriberFuture* self = (SubscriberFuture*)base;
+    for (;;) {
+        FutureState state = self->recv.base.progress((Future*)&self->recv, mio, waker);
+        if (state == FUTURE_PENDING)
+            return FUTURE_PENDING;
+        if (state == FUTURE_FAILURE)
+            return self->recv.base.errcode == CHANNEL_ERR_CLOSED ? FUTURE_COMPLETED : FUTURE_FAILURE;
+        assert((intptr_t)self->recv.base.ok == self->received);
+        ++self->received;
+        self->recv = broadcast_recv(&self->receiver);
+    }
+}
+
+static void test_broadcast(void)
+{
+    Executor* executor = executor_create(0);
+    BroadcastChannel channel;
+    broadcast_channel_init(&channel, CAPACITY);
+
+    SubscriberFuture subscriber = { .base = future_create(subscriber_progress) };
+    subscriber.receiver = broadcast_subscribe(&channel);
+    subscriber.recv = broadcast_recv(&subscriber.receiver);
+    BroadcastReceiver slow = broadcast_subscribe(&channel);
+    Future sender = future_create(sender_progress);
+    sender.arg = &channel;
+    executor_spawn(executor, (Future*)&subscriber);
+    executor_spawn(executor, &sender);
+    executor_run(executor);
+
+    // The subscriber that kept up got every message.
+    assert(subscriber.base.errcode == FUTURE_SUCCESS);
+    assert(subscriber.received == N_MESSAGES);
+
+    // The slow one is told how many messages it missed, then gets the buffered ones.
+    BroadcastRecvFuture recv = broadcast_recv(&slow);
+    FutureState state = executor_block_on(executor, (Future*)&recv);
+    assert(state == FUTURE_FAILURE);
+    assert(recv.base.errcode == CHANNEL_ERR_LAGGED);
+    printf("broadcast: the slow subscriber lagged by %llu messages\n", (unsigned long long)recv.gap);
+    assert(recv.gap == N_MESSAGES - CAPACITY && slow.lagged == recv.gap);
+    for (intptr_t i = N_MESSAGES - CAPACITY; i < N_MESSAGES; ++i) {
+        recv = broadcast_recv(&slow);
+        state = executor_block_on(executor, (Future*)&recv);
+        assert(state == FUTURE_COMPLETED);
+        assert((intptr_t)recv.base.ok == i);
+    }
+    recv = broadcast_recv(&slow);
+    state = executor_block_on(executor, (Future*)&recv);
+    assert(state == FUTURE_FAILURE);
+    assert(recv.base.errcode == CHANNEL_ERR_CLOSED);
+
+    broadcast_channel_destroy(&channel);
+    executor_destroy(executor);
+}
+
+int main()
+{
+    test_watch();
+    test_broadcast();
+    return 0;
+}
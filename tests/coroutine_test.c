@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <errno.h> // For ECANCELED
+#include <fenv.h> // For fegetround, fesetround
+#include <pthread.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf, snprintf
+#include <string.h> // For memcmp
+#include <sys/mman.h> // For msync
+#include <unistd.h> // For close
+
+#include "coroutine.h"
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "utils.h"
+
+#define MESSAGE "aaabbbcccd\n"
+#define N_COUNTERS 100
+#define YIELDS 100
+#define RECURSION_DEPTH 1000
+
+/** Reads the message in chunks, blocking-style, and returns the number of chunks read. */
+static void* read_in_chunks(CoroutineFuture* self, void* arg)
+{
+    int fd = (int)(intptr_t)arg;
+    static char message[sizeof(MESSAGE)];
+    size_t chunks = 0;
+    for (size_t read_so_far = 0; read_so_far < sizeof(message); read_so_far += 3) {
+        size_t n = sizeof(message) - read_so_far < 3 ? sizeof(message) - read_so_far : 3;
+        PipeReadFuture read = pipe_read_future_create(fd, (uint8_t*)message + read_so_far, n);
+        if (coroutine_await(self, (Future*)&read) != FUTURE_COMPLETED) {
+            self->base.errcode = read.base.errcode;
+            return NULL;
+        }
+        ++chunks;
+    }
+    assert(memcmp(message, MESSAGE, sizeof(message)) == 0);
+    return (void*)chunks;
+}
+
+/** Uses some of its stack across suspensions. */
+static int recurse(CoroutineFuture* self, int depth)
+{
+    volatile char frame[64];
+    frame[0] = (char)depth;
+    if (depth == 0) {
+        coroutine_yield(self);
+        return frame[0];
+    }
+    return recurse(self, depth - 1) + (frame[0] == (char)depth);
+}
+
+static int interleaving[2 * YIELDS];
+static int n_steps = 0;
+
+static void* count(CoroutineFuture* self, void* arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < YIELDS; ++i) {
+        if (id < 2 && n_steps < 2 * YIELDS)
+            interleaving[n_steps++] = id;
+        coroutine_yield(self);
+    }
+    return (void*)(intptr_t)(recurse(self, RECURSION_DEPTH) + id);
+}
+
+static void* fail(CoroutineFuture* self, void* arg)
+{
+    coroutine_yield(self);
+    self->base.errcode = 42;
+    return NULL;
+}
+
+/** Rounds upwards across a suspension. */
+static void* round_upwards(CoroutineFuture* self, void* arg)
+{
+    int ret = fesetround(FE_UPWARD);
+    assert(ret == 0);
+    coroutine_yield(self);
+    // The other coroutine has rounded to nearest in the meantime
+    int rounding = fegetround();
+    fesetround(FE_TONEAREST);
+    return (void*)(intptr_t)(rounding == FE_UPWARD);
+}
+
+static void* round_to_nearest(CoroutineFuture* self, void* arg)
+{
+    // The first coroutine has set its rounding mode before yielding
+    return (void*)(intptr_t)(fegetround() == FE_TONEAREST);
+}
+
+static void test_fpu_control(Executor* executor)
+{
+    // The rounding mode is part of a coroutine's context, like the callee-saved registers.
+    CoroutineFuture upwards = coroutine_future_create(round_upwards, 0);
+    CoroutineFuture nearest = coroutine_future_create(round_to_nearest, 0);
+    executor_spawn(executor, (Future*)&upwards);
+    executor_spawn(executor, (Future*)&nearest);
+    executor_run(executor);
+    assert(upwards.base.ok == (void*)1);
+    assert(nearest.base.ok == (void*)1);
+    assert(fegetround() == FE_TONEAREST);
+}
+
+/** Waits for a wake-up that never comes. */
+static FutureState pending_forever_progress(Future* fut, Mio* mio, Waker waker)
+{
+    return FUTURE_PENDING;
+}
+
+static void* wait_forever(CoroutineFuture* self, void* arg)
+{
+    Future never = future_create(pending_forever_progress);
+    coroutine_await(self, &never);
+    assert(!"unreachable");
+    return NULL;
+}
+
+static void release_cancelled(Future* fut, void* arg)
+{
+    coroutine_future_release((CoroutineFuture*)fut);
+}
+
+static void test_release_cancelled(void)
+{
+    // The stack of a coroutine cancelled by a shutdown goes back to the pool.
+    coroutine_stack_pool_clear();
+    Executor* executor = executor_create(0);
+    CoroutineFuture stuck = coroutine_future_create(wait_forever, 0);
+    executor_spawn(executor, (Future*)&stuck);
+    executor_run_until_idle(executor); // suspended in coroutine_await()
+    assert(stuck.stack != NULL);
+    size_t cancelled = executor_shutdown(executor, 0, release_cancelled, NULL);
+    assert(cancelled == 1 && stuck.base.errcode == ECANCELED);
+    assert(stuck.stack == NULL);
+    assert(coroutine_stack_pool_cached() == 1);
+    coroutine_future_release(&stuck); // no-op once released
+    assert(coroutine_stack_pool_cached() == 1);
+    executor_destroy(executor);
+    coroutine_stack_pool_clear();
+}
+
+static void* record_stack(CoroutineFuture* self, void* arg)
+{
+    *(void**)arg = self->stack;
+    return NULL;
+}
+
+static void* run_coroutine_thread(void* arg)
+{
+    Executor* executor = executor_create(0);
+    CoroutineFuture coroutine = coroutine_future_create(record_stack, 0);
+    coroutine.base.arg = arg;
+    executor_spawn(executor, (Future*)&coroutine);
+    executor_run(executor);
+    assert(coroutine_stack_pool_cached() == 1);
+    executor_destroy(executor);
+    return NULL;
+}
+
+static void test_pool_freed_at_thread_exit(void)
+{
+    // The stacks cached by a thread are unmapped when it exits.
+    void* stack = NULL;
+    pthread_t thread;
+    ASSERT_ZERO(pthread_create(&thread, NULL, run_coroutine_thread, &stack));
+    ASSERT_ZERO(pthread_join(thread, NULL));
+    assert(stack != NULL);
+    int ret = msync(stack, sysconf(_SC_PAGESIZE), MS_ASYNC);
+    assert(ret == -1 && errno == ENOMEM);
+}
+
+int main()
+{
+    Executor* executor = executor_create(0);
+
+    int fd = create_example_read_pipe_end(MESSAGE, 3, 0, 1);
+    CoroutineFuture reader = coroutine_future_create(read_in_chunks, 0);
+    reader.base.arg = (void*)(intptr_t)fd;
+    executor_spawn(executor, (Future*)&reader);
+
+    static CoroutineFuture counters[N_COUNTERS];
+    for (int i = 0; i < N_COUNTERS; ++i) {
+        counters[i] = coroutine_future_create(count, 256 * 1024);
+        counters[i].base.arg = (void*)(intptr_t)i;
+        executor_spawn(executor, (Future*)&counters[i]);
+    }
+    CoroutineFuture failing = coroutine_future_create(fail, 0);
+    executor_spawn(executor, (Future*)&failing);
+
+    executor_run(executor);
+
+    assert(reader.base.errcode == FUTURE_SUCCESS);
+    assert((size_t)reader.base.ok == (sizeof(MESSAGE) + 2) / 3);
+    for (int i = 0; i < N_COUNTERS; ++i) {
+        assert(counters[i].base.errcode == FUTURE_SUCCESS);
+        assert((intptr_t)counters[i].base.ok == RECURSION_DEPTH + i);
+    }
+    // The coroutines were suspended on every yield, so they took turns.
+    for (int i = 0; i < 2 * YIELDS; ++i)
+        assert(interleaving[i] == i % 2);
+    assert(failing.base.errcode == 42);
+
+    // The stacks of completed coroutines have been cached and are reused.
+    size_t cached = coroutine_stack_pool_cached();
+    printf("Stacks cached: %zu\n", cached);
+    assert(cached == COROUTINE_STACK_POOL_CAPACITY);
+    counters[0] = coroutine_future_create(count, 256 * 1024);
+    executor_spawn(executor, (Future*)&counters[0]);
+    executor_run(executor);
+    assert(coroutine_stack_pool_cached() == cached);
+
+    test_fpu_control(executor);
+
+    coroutine_stack_pool_clear();
+    assert(coroutine_stack_pool_cached() == 0);
+    executor_destroy(executor);
+    close(fd);
+
+    test_release_cancelled();
+    test_pool_freed_at_thread_exit();
+    return 0;
+}
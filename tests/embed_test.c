@@ -0,0 +1,147 @@
+#include <assert.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf
+#include <string.h> // For memcmp
+#include <sys/epoll.h>
+#include <unistd.h> // For close
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "utils.h"
+
+#define MESSAGE "abcdefghij"
+#define YIELDS 10
+
+static FutureState yielding_progress(Future* fut, Mio* mio, Waker waker)
+{
+    intptr_t* calls = fut->arg;
+    if (++*calls == YIELDS)
+        return FUTURE_COMPLETED;
+    waker_wake(&waker);
+    return FUTURE_PENDING;
+}
+
+/** Stays pending, counting its progress calls; its waker is kept for another task to wake it. */
+static Waker parked_waker;
+
+static FutureState parked_progress(Future* fut, Mio* mio, Waker waker)
+{
+    ++*(intptr_t*)fut->arg;
+    parked_waker = waker;
+    return FUTURE_PENDING;
+}
+
+static FutureState wake_parked_progress(Future* fut, Mio* mio, Waker waker)
+{
+    waker_wake(&parked_waker);
+    return FUTURE_COMPLETED;
+}
+
+static FutureState counting_progress(Future* fut, Mio* mio, Waker waker)
+{
+    ++*(intptr_t*)fut->arg;
+    return FUTURE_COMPLETED;
+}
+
+static void test_tick_with_lifo_slot(void)
+{
+    // A task woken during a tick doesn't take the place of one that was ready when it started,
+    // even if it is woken into the LIFO slot.
+    Executor* executor = executor_create(0);
+    executor_set_lifo_slot(executor, true);
+    intptr_t parked_calls = 0;
+    Future parked = future_create(parked_progress);
+    parked.arg = &parked_calls;
+    executor_spawn(executor, &parked);
+    int ticked = executor_tick(executor, 0);
+    assert(ticked == 1 && parked_calls == 1);
+
+    Future waking = future_create(wake_parked_progress);
+    intptr_t counted_calls = 0;
+    Future counting = future_create(counting_progress);
+    counting.arg = &counted_calls;
+    executor_spawn(executor, &waking);
+    executor_spawn(executor, &counting);
+    ticked = executor_tick(executor, 0);
+    assert(ticked == 2);
+    assert(counted_calls == 1 && parked_calls == 1);
+    ticked = executor_tick(executor, 0);
+    assert(ticked == 1 && parked_calls == 2);
+    assert(executor_is_idle(executor));
+
+    executor_shutdown(executor, 0, NULL, NULL);
+    executor_destroy(executor);
+}
+
+static void* increment(void* arg)
+{
+    return (void*)((intptr_t)arg + 1);
+}
+
+int main()
+{
+    Executor* executor = executor_create(0);
+
+    // Nothing to do.
+    size_t calls_made = executor_run_until_idle(executor);
+    assert(calls_made == 0);
+    int ticked = executor_tick(executor, 0);
+    assert(ticked == 0);
+    assert(executor_is_idle(executor));
+
+    // A tick progresses each ready task once; running until idle takes the rest.
+    intptr_t calls = 0;
+    Future yielding = future_create(yielding_progress);
+    yielding.arg = &calls;
+    executor_spawn(executor, &yielding);
+    ticked = executor_tick(executor, -1);
+    assert(ticked == 1);
+    assert(calls == 1 && !executor_is_idle(executor));
+    calls_made = executor_run_until_idle(executor);
+    assert(calls_made == YIELDS - 1);
+    assert(calls == YIELDS && !yielding.is_active);
+
+    // The host loop waits for the executor's I/O on its own epoll instance.
+    int host_epfd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_SYS_OK(host_epfd);
+    struct epoll_event event = { .events = EPOLLIN };
+    ASSERT_SYS_OK(epoll_ctl(host_epfd, EPOLL_CTL_ADD, executor_poll_fd(executor), &event));
+
+    int fd = create_example_read_pipe_end(MESSAGE, 2, 1, 0);
+    char buffer[sizeof(MESSAGE) - 1];
+    PipeReadFuture read = pipe_read_future_create(fd, (uint8_t*)buffer, sizeof(buffer));
+    executor_spawn(executor, (Future*)&read);
+    size_t host_wakeups = 0;
+    while (executor_live_tasks(executor) > 0) {
+        executor_run_until_idle(executor);
+        if (executor_live_tasks(executor) == 0)
+            break;
+        ASSERT_SYS_OK(epoll_wait(host_epfd, &event, 1, -1));
+        ++host_wakeups;
+    }
+    printf("Host loop woken up %zu times\n", host_wakeups);
+    assert(host_wakeups > 0);
+    assert(read.base.errcode == FUTURE_SUCCESS);
+    assert(memcmp(buffer, MESSAGE, sizeof(buffer)) == 0);
+    close(host_epfd);
+    close(fd);
+
+    // Blocking on a future leaves the other tasks pending.
+    calls = 0;
+    executor_spawn(executor, &yielding);
+    ApplyFuture apply = apply_future_create(increment);
+    apply.base.arg = (void*)41;
+    FutureState state = executor_block_on(executor, (Future*)&apply);
+    assert(state == FUTURE_COMPLETED);
+    assert((intptr_t)apply.base.ok == 42);
+    assert(yielding.is_active && executor_live_tasks(executor) == 1);
+    executor_run(executor);
+    assert(calls == YIELDS);
+
+    executor_destroy(executor);
+
+    test_tick_with_lifo_slot();
+    return 0;
+}
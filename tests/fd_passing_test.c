@@ -0,0 +1,140 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h> // For O_NONBLOCK, FD_CLOEXEC
+#include <stdio.h> // For printf
+#include <string.h> // For memcmp
+#include <sys/socket.h> // For socketpair
+#include <sys/wait.h> // For waitpid
+#include <unistd.h> // For pipe2, fork, close
+
+#include "err.h"
+#include "executor.h"
+#include "fd_passing.h"
+#include "future.h"
+#include "future_examples.h"
+
+#define N_PIPES 3
+
+static void assert_nonblocking_cloexec(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    ASSERT_SYS_OK(flags);
+    assert(flags & O_NONBLOCK);
+    int fd_flags = fcntl(fd, F_GETFD);
+    ASSERT_SYS_OK(fd_flags);
+    assert(fd_flags & FD_CLOEXEC);
+}
+
+static void test_batch(Executor* executor, int sockets[2])
+{
+    // The read ends of several (blocking) pipes, in one message; the receiver waits first
+    int pipes[N_PIPES][2], read_ends[N_PIPES];
+    for (int i = 0; i < N_PIPES; ++i) {
+        ASSERT_SYS_OK(pipe(pipes[i]));
+        read_ends[i] = pipes[i][0];
+    }
+    int received[N_PIPES + 1];
+    RecvFdsFuture recv = recv_fds_future_create(sockets[1], received, N_PIPES + 1);
+    SendFdsFuture send = send_fds_future_create(sockets[0], read_ends, N_PIPES);
+    executor_spawn(executor, (Future*)&recv);
+    executor_spawn(executor, (Future*)&send);
+    executor_run(executor);
+    assert(send.base.errcode == FUTURE_SUCCESS && recv.base.errcode == FUTURE_SUCCESS);
+    assert(recv.n_fds == N_PIPES);
+
+    for (int i = 0; i < N_PIPES; ++i) {
+        ASSERT_SYS_OK(close(pipes[i][0]));
+        assert_nonblocking_cloexec(received[i]);
+        char byte = 'a' + i, got = 0;
+        ASSERT_SYS_OK(write(pipes[i][1], &byte, 1));
+        ssize_t bytes_read = read(received[i], &got, 1);
+        assert(bytes_read == 1 && got == byte);
+        ASSERT_SYS_OK(close(pipes[i][1]));
+        ASSERT_SYS_OK(close(received[i]));
+    }
+}
+
+static void test_truncated(Executor* executor, int sockets[2])
+{
+    int fds[2];
+    ASSERT_SYS_OK(pipe(fds));
+    int received[1];
+    SendFdsFuture send = send_fds_future_create(sockets[0], fds, 2);
+    RecvFdsFuture recv = recv_fds_future_create(sockets[1], received, 1);
+    executor_spawn(executor, (Future*)&send);
+    executor_spawn(executor, (Future*)&recv);
+    executor_run(executor);
+    assert(send.base.errcode == FUTURE_SUCCESS);
+    assert(recv.base.errcode == FD_PASSING_ERR_TRUNCATED && recv.n_fds == 1);
+    ASSERT_SYS_OK(close(received[0]));
+    ASSERT_SYS_OK(close(fds[0]));
+    ASSERT_SYS_OK(close(fds[1]));
+}
+
+static void test_other_process(Executor* executor)
+{
+    // A child process receives the write end of a pipe and answers through it
+    int sockets[2], fds[2];
+    ASSERT_SYS_OK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sockets));
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK | O_CLOEXEC));
+    pid_t pid = fork();
+    ASSERT_SYS_OK(pid);
+    if (pid == 0) {
+        ASSERT_SYS_OK(close(sockets[0]));
+        ASSERT_SYS_OK(close(fds[0]));
+        ASSERT_SYS_OK(close(fds[1]));
+        Executor* child = executor_create(0);
+        int received[1];
+        RecvFdsFuture recv = recv_fds_future_create(sockets[1], received, 1);
+        executor_spawn(child, (Future*)&recv);
+        executor_run(child);
+        assert(recv.base.errcode == FUTURE_SUCCESS && recv.n_fds == 1);
+        PipeWriteFuture write = pipe_write_future_create(received[0], 6, true);
+        write.base.arg = "hello";
+        executor_spawn(child, (Future*)&write);
+        executor_run(child);
+        executor_destroy(child);
+        _exit(write.base.errcode == FUTURE_SUCCESS ? 0 : 1);
+    }
+    ASSERT_SYS_OK(close(sockets[1]));
+    SendFdsFuture send = send_fds_future_create(sockets[0], &fds[1], 1);
+    executor_spawn(executor, (Future*)&send);
+    executor_run(executor);
+    assert(send.base.errcode == FUTURE_SUCCESS);
+    ASSERT_SYS_OK(close(fds[1])); // the child's copy is the only write end left
+
+    uint8_t answer[6];
+    PipeReadFuture read = pipe_read_future_create(fds[0], answer, sizeof(answer));
+    executor_spawn(executor, (Future*)&read);
+    executor_run(executor);
+    assert(read.base.errcode == FUTURE_SUCCESS && memcmp(answer, "hello", 6) == 0);
+    int status;
+    ASSERT_SYS_OK(waitpid(pid, &status, 0));
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // The peer is gone
+    int received[1];
+    RecvFdsFuture eof = recv_fds_future_create(sockets[0], received, 1);
+    executor_spawn(executor, (Future*)&eof);
+    executor_run(executor);
+    assert(eof.base.errcode == PIPE_FUTURE_ERR_EOF);
+    ASSERT_SYS_OK(close(fds[0]));
+    ASSERT_SYS_OK(close(sockets[0]));
+}
+
+int main()
+{
+    Executor* executor = executor_create(0);
+    int sockets[2];
+    ASSERT_SYS_OK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sockets));
+    test_batch(executor, sockets);
+    test_truncated(executor, sockets);
+    ASSERT_SYS_OK(close(sockets[0]));
+    ASSERT_SYS_OK(close(sockets[1]));
+    test_other_process(executor);
+    executor_destroy(executor);
+    printf("Descriptors passed\n");
+    return 0;
+}
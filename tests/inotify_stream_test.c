@@ -0,0 +1,102 @@
+#include <assert.h>
+#include <fcntl.h> // For open
+#include <stdio.h> // For printf, snprintf
+#include <stdlib.h> // For mkdtemp
+#include <string.h> // For strcmp
+#include <unistd.h> // For write, close, unlink, rmdir
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "inotify_stream.h"
+
+static char dir[] = "/tmp/inotify_stream_test_XXXXXX";
+
+static void file_path(char* path, size_t size, const char* name)
+{
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+static int create_file(const char* name)
+{
+    char path[64];
+    file_path(path, sizeof(path), name);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    ASSERT_SYS_OK(fd);
+    return fd;
+}
+
+/** Changes the files when it is progressed (after the reader has started waiting). */
+typedef struct WriterFuture {
+    Future base;
+    int a, b;
+} WriterFuture;
+
+static FutureState writer_progress(Future* base, Mio* mio, Waker waker)
+{
+    WriterFuture* self = (WriterFuture*)base;
+    self->a = create_file("a");
+    self->b = create_file("b");
+    // Modifications of a and b interleaved: the kernel only merges identical consecutive events.
+    const char* order = "abaa";
+    for (const char* file = order; *file; ++file)
+        ASSERT_SYS_OK(write(*file == 'a' ? self->a : self->b, "x", 1));
+    return FUTURE_COMPLETED;
+}
+
+static void assert_event(InotifyEvent const* event, int wd, uint32_t mask, const char* name)
+{
+    printf("Event wd=%d mask=%#x name=%s\n", event->wd, event->mask, event->name);
+    assert(event->wd == wd && event->mask == mask && strcmp(event->name, name) == 0);
+}
+
+int main()
+{
+    char* created = mkdtemp(dir);
+    assert(created != NULL);
+    static InotifyStream stream;
+    ASSERT_SYS_OK(inotify_stream_open(&stream));
+    int wd = inotify_stream_watch(&stream, dir, IN_CREATE | IN_MODIFY | IN_DELETE);
+    ASSERT_SYS_OK(wd);
+
+    Executor* executor = executor_create(0);
+
+    // The reader waits for the events, which come in a single batch, with modifications coalesced.
+    InotifyNextFuture next = inotify_stream_next(&stream);
+    WriterFuture writer = { .base = future_create(writer_progress) };
+    executor_spawn(executor, (Future*)&next);
+    executor_spawn(executor, (Future*)&writer);
+    executor_run(executor);
+    assert(next.base.errcode == FUTURE_SUCCESS);
+    InotifyBatch* batch = next.base.ok;
+    assert(batch->n_events == 4);
+    assert_event(&batch->events[0], wd, IN_CREATE, "a");
+    assert_event(&batch->events[1], wd, IN_CREATE, "b");
+    assert_event(&batch->events[2], wd, IN_MODIFY, "a");
+    assert_event(&batch->events[3], wd, IN_MODIFY, "b");
+    assert(stream.coalesced == 1);
+
+    // Events of other files in between don't prevent coalescing.
+    char path[64];
+    ASSERT_SYS_OK(write(writer.b, "x", 1));
+    file_path(path, sizeof(path), "a");
+    ASSERT_SYS_OK(unlink(path));
+    ASSERT_SYS_OK(write(writer.b, "x", 1));
+    next = inotify_stream_next(&stream);
+    FutureState state = executor_block_on(executor, (Future*)&next);
+    assert(state == FUTURE_COMPLETED);
+    assert(batch->n_events == 2);
+    assert_event(&batch->events[0], wd, IN_MODIFY, "b");
+    assert_event(&batch->events[1], wd, IN_DELETE, "a");
+    assert(stream.coalesced == 2);
+
+    ASSERT_SYS_OK(inotify_stream_unwatch(&stream, wd));
+    inotify_stream_close(&stream);
+    executor_destroy(executor);
+    close(writer.a);
+    close(writer.b);
+    file_path(path, sizeof(path), "b");
+    ASSERT_SYS_OK(unlink(path));
+    ASSERT_SYS_OK(rmdir(dir));
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf
+
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "join_handle.h"
+
+#define N_REQUESTS 1000
+#define N_ROUNDS 5
+#define LARGE_PAYLOAD 10000
+
+static void* square(void* arg)
+{
+    return (void*)((intptr_t)arg * (intptr_t)arg);
+}
+
+/** Completes after waking itself up `arg` times, or fails if `arg` is negative. */
+typedef struct CountdownFuture {
+    Future base;
+    intptr_t remaining;
+    char payload[LARGE_PAYLOAD]; // too large for the slabs
+} CountdownFuture;
+
+static FutureState countdown_progress(Future* base, Mio* mio, Waker waker)
+{
+    CountdownFuture* self = (CountdownFuture*)base;
+    if (self->remaining < 0) {
+        base->errcode = 42;
+        return FUTURE_FAILURE;
+    }
+    if (self->remaining-- > 0) {
+        waker_wake(&waker);
+        return FUTURE_PENDING;
+    }
+    base->ok = (void*)(intptr_t)self->payload[LARGE_PAYLOAD - 1];
+    return FUTURE_COMPLETED;
+}
+
+static intptr_t detached_completed = 0;
+
+static void* count_detached(void* arg)
+{
+    ++detached_completed;
+    return arg;
+}
+
+/**
+ * Spawns a task per "request" from a local variable, detaching every other one,
+ * and awaits the results of the rest.
+ */
+typedef struct ServerFuture {
+    Future base;
+    bool spawned;
+    JoinHandle handles[N_REQUESTS];
+    size_t awaited; // number of handles whose results have been checked
+    intptr_t sum;
+} ServerFuture;
+
+static FutureState server_progress(Future* base, Mio* mio, Waker waker)
+{
+    ServerFuture* self = (ServerFuture*)base;
+    Executor* executor = waker.executor;
+    if (!self->spawned) {
+        self->spawned = true;
+        for (intptr_t i = 0; i < N_REQUESTS; ++i) {
+            ApplyFuture request = apply_future_create(i % 2 == 0 ? square : count_detached);
+            request.base.arg = (void*)i;
+            EXECUTOR_SPAWN_OWNED(executor, request, &self->handles[i]);
+            if (i % 2 == 1)
+                join_handle_detach(&self->handles[i]);
+        }
+    }
+    for (; self->awaited < N_REQUESTS; self->awaited += 2) {
+        JoinHandle* handle = &self->handles[self->awaited];
+        FutureState state = handle->base.progress((Future*)handle, mio, waker);
+        if (state == FUTURE_PENDING)
+            return FUTURE_PENDING;
+        assert(state == FUTURE_COMPLETED);
+        assert((intptr_t)handle->base.ok == (intptr_t)self->awaited * (intptr_t)self->awaited);
+        self->sum += (intptr_t)handle->base.ok;
+    }
+    return FUTURE_COMPLETED;
+}
+
+int main()
+{
+    Executor* executor = executor_create(0);
+
+    // The storage of completed tasks is reused: the slabs don't grow after the first round.
+    size_t slab_bytes = 0;
+    for (int round = 0; round < N_ROUNDS; ++round) {
+        static ServerFuture server;
+        server = (ServerFuture) { .base = future_create(server_progress) };
+        detached_completed = 0;
+        executor_spawn(executor, (Future*)&server);
+        executor_run(executor);
+        assert(server.awaited == N_REQUESTS);
+        assert(detached_completed == N_REQUESTS / 2);
+        if (round == 0)
+            slab_bytes = executor_owned_slab_bytes(executor);
+        assert(executor_owned_slab_bytes(executor) == slab_bytes);
+    }
+    printf("Owned tasks' slabs: %zu bytes\n", slab_bytes);
+    assert(slab_bytes > 0);
+
+    // Large futures, results of failed tasks and handles awaited by a task spawned later.
+    static CountdownFuture countdown;
+    countdown = (CountdownFuture) { .base = future_create(countdown_progress), .remaining = 3 };
+    countdown.payload[LARGE_PAYLOAD - 1] = 7;
+    JoinHandle completing, failing;
+    EXECUTOR_SPAWN_OWNED(executor, countdown, &completing);
+    countdown.remaining = -1;
+    EXECUTOR_SPAWN_OWNED(executor, countdown, &failing);
+    executor_spawn(executor, (Future*)&completing);
+    executor_spawn(executor, (Future*)&failing);
+    executor_run(executor);
+    assert(completing.base.errcode == FUTURE_SUCCESS);
+    assert((intptr_t)completing.base.ok == 7);
+    assert(failing.base.errcode == 42);
+    assert(completing.task == NULL && failing.task == NULL);
+    assert(executor_owned_slab_bytes(executor) == slab_bytes);
+
+    executor_destroy(executor);
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <assert.h>
+#include <stdio.h> // For printf
+
+#include "executor.h"
+#include "future.h"
+
+#define N_FILLERS 8
+#define FILLER_ROUNDS 50
+#define PING_PONG_ROUNDS 50
+
+static Executor* executor;
+static Future ping;
+static Future pong;
+
+static int seq = 0; // number of progress() calls so far
+static int last_ping_seq = -1;
+static int pongs_right_after_ping = 0;
+static int ping_rounds = 0;
+static int pong_rounds = 0;
+static bool pinged = false;
+
+/** A future that keeps yielding, to fill the queue. */
+static FutureState filler_progress(Future* fut, Mio* mio, Waker waker)
+{
+    ++seq;
+    int* rounds = fut->arg;
+    if (++*rounds == FILLER_ROUNDS)
+        return FUTURE_COMPLETED;
+    waker_wake(&waker);
+    return FUTURE_PENDING;
+}
+
+/** Sends a "request" to pong and waits for the response. */
+static FutureState ping_progress(Future* fut, Mio* mio, Waker waker)
+{
+    last_ping_seq = seq++;
+    if (ping_rounds++ == PING_PONG_ROUNDS)
+        return FUTURE_COMPLETED;
+    pinged = true;
+    Waker pong_waker = { .executor = executor, .future = &pong };
+    waker_wake(&pong_waker);
+    return FUTURE_PENDING;
+}
+
+/** Responds to ping's "requests". */
+static FutureState pong_progress(Future* fut, Mio* mio, Waker waker)
+{
+    if (!pinged)
+        return FUTURE_PENDING;
+    pinged = false;
+    if (seq == last_ping_seq + 1)
+        ++pongs_right_after_ping;
+    ++seq;
+    Waker ping_waker = { .executor = executor, .future = &ping };
+    waker_wake(&ping_waker);
+    return ++pong_rounds == PING_PONG_ROUNDS ? FUTURE_COMPLETED : FUTURE_PENDING;
+}
+
+int main()
+{
+    // A test that checks that a task woken by another task runs right after it
+    // when the LIFO slot is enabled, while the other tasks still progress.
+
+    executor = executor_create(0);
+    executor_set_lifo_slot(executor, true);
+
+    Future fillers[N_FILLERS];
+    int filler_rounds[N_FILLERS] = { 0 };
+    for (int i = 0; i < N_FILLERS; ++i) {
+        fillers[i] = future_create(filler_progress);
+        fillers[i].arg = &filler_rounds[i];
+        executor_spawn(executor, &fillers[i]);
+    }
+    ping = future_create(ping_progress);
+    pong = future_create(pong_progress);
+    executor_spawn(executor, &ping);
+    executor_spawn(executor, &pong);
+
+    executor_run(executor);
+
+    printf("%d of %d responses right after the request\n", pongs_right_after_ping, pong_rounds);
+    assert(pong_rounds == PING_PONG_ROUNDS);
+    // Every other response is delayed by EXECUTOR_MAX_LIFO_STREAK (3), which keeps the fillers going.
+    assert(pongs_right_after_ping >= PING_PONG_ROUNDS / 2);
+    for (int i = 0; i < N_FILLERS; ++i)
+        assert(filler_rounds[i] == FILLER_ROUNDS);
+
+    executor_destroy(executor);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <stdio.h> // For tmpfile, fread
+#include <string.h>
+#include <sys/mman.h> // For mmap, mprotect
+#include <unistd.h> // For sysconf
+
+#include "err.h"
+#include "log.h"
+
+static int evaluations = 0;
+
+static int counted(int value)
+{
+    ++evaluations;
+    return value;
+}
+
+// Flushes the log and returns what has been written to `out` since the last call
+static const char* take_output(FILE* out, char* buffer, size_t size)
+{
+    log_flush();
+    long end = ftell(out);
+    static long start = 0;
+    ASSERT_SYS_OK(fseek(out, start, SEEK_SET));
+    size_t len = fread(buffer, 1, size - 1, out);
+    buffer[len] = '\0';
+    start = end;
+    return buffer;
+}
+
+int main()
+{
+    FILE* out = tmpfile();
+    assert(out);
+    log_set_output(out);
+    char buffer[4096];
+
+    // Arguments are formatted only when flushing, so the copied string must be printed
+    // even though the original has been changed in the meantime.
+    char name[] = "mio";
+    LOG_INFO("%s: %d fds, %5.2f%% busy, %-4s|%llx %c\n", name, 42, 12.5, "ab", 0xdeadULL, 'x');
+    name[0] = 'X';
+    take_output(out, buffer, sizeof(buffer));
+    printf("%s", buffer);
+    assert(strstr(buffer, " INFO] mio: 42 fds, 12.50% busy, ab  |dead x\n"));
+
+    LOG_WARN("width %*d|%.*s|\n", 4, 7, 2, "abcdef");
+    take_output(out, buffer, sizeof(buffer));
+    assert(strstr(buffer, " WARN] width    7|ab|\n"));
+
+    // With a precision, a string needn't be terminated: nothing past it is read, as by printf.
+    // The characters are placed right before an inaccessible page, so reading further crashes.
+    long page = sysconf(_SC_PAGESIZE);
+    char* pages = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(pages != MAP_FAILED);
+    ASSERT_SYS_OK(mprotect(pages + page, page, PROT_NONE));
+    char* unterminated = pages + page - 3;
+    memcpy(unterminated, "xyz", 3);
+    LOG_WARN("%.3s|%.*s|%-4.1s|\n", unterminated, 2, unterminated, unterminated + 2);
+    take_output(out, buffer, sizeof(buffer));
+    assert(strstr(buffer, " WARN] xyz|xy|z   |\n"));
+    ASSERT_SYS_OK(munmap(pages, 2 * page));
+
+    // Messages below the runtime level are skipped without evaluating the arguments.
+    log_set_level(LOG_LEVEL_WARN);
+    LOG_INFO("skipped %d\n", counted(1));
+    assert(evaluations == 0);
+    LOG_ERROR("logged %d\n", counted(2));
+    assert(evaluations == 1);
+    // Error messages are written out immediately.
+    assert(ftell(out) > 0);
+    take_output(out, buffer, sizeof(buffer));
+    assert(strstr(buffer, " ERROR] logged 2\n"));
+
+    // Messages below the compile-time level are not even compiled.
+    log_set_level(LOG_LEVEL_TRACE);
+    LOG_TRACE("compiled out %d\n", counted(3));
+    assert(evaluations == 1);
+    take_output(out, buffer, sizeof(buffer));
+    assert(buffer[0] == '\0');
+
+    log_set_output(NULL);
+    fclose(out);
+    return 0;
+}
@@ -3,10 +3,12 @@
 
 #include <assert.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h> // For uint64_t
 #include <stdio.h> // For printf
 #include <stdlib.h> // For exit
 #include <string.h> // For memcmp
+#include <sys/eventfd.h> // For eventfd
 #include <sys/timerfd.h> // For timerfd
 #include <unistd.h> // For pipe, read, write
 
@@ -17,6 +19,73 @@
 #include "mio.h"
 #include "utils.h"
 
+#define N_READY_FDS 256
+#define INITIAL_BATCH 64 // events taken by a single poll of a new Mio
+#define WRITE_DELAY_US 10000
+
+static void test_batch_growth(void)
+{
+    // More descriptors become ready at once than a poll takes, so the batch has to grow.
+    Executor* executor = executor_create(0);
+    executor_set_poll_interval(executor, 0, 0); // poll only once they are all registered
+    static int fds[N_READY_FDS];
+    static uint64_t values[N_READY_FDS];
+    static PipeReadFuture readers[N_READY_FDS];
+    for (int i = 0; i < N_READY_FDS; ++i) {
+        fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ASSERT_SYS_OK(fds[i]);
+        readers[i] = pipe_read_future_create(fds[i], (uint8_t*)&values[i], sizeof(values[i]));
+        executor_spawn(executor, (Future*)&readers[i]);
+    }
+    executor_run_until_idle(executor);
+    assert(mio_registered_count(executor_mio(executor)) == N_READY_FDS);
+    for (int i = 0; i < N_READY_FDS; ++i)
+        ASSERT_SYS_OK(eventfd_write(fds[i], i + 1));
+    executor_run(executor);
+
+    MioStats stats;
+    mio_stats(executor_mio(executor), &stats);
+    printf("Largest batch: %llu events\n", (unsigned long long)stats.max_events_per_poll);
+    assert(stats.max_events_per_poll > INITIAL_BATCH);
+    for (int i = 0; i < N_READY_FDS; ++i) {
+        assert(readers[i].base.errcode == FUTURE_SUCCESS && values[i] == (uint64_t)i + 1);
+        ASSERT_SYS_OK(close(fds[i]));
+    }
+    executor_destroy(executor);
+}
+
+static void* write_later(void* arg)
+{
+    usleep(WRITE_DELAY_US);
+    ASSERT_SYS_OK(eventfd_write(*(int*)arg, 1));
+    return NULL;
+}
+
+static void test_busy_poll(void)
+{
+    // An event that arrives while the executor spins is taken without blocking in epoll_wait().
+    Executor* executor = executor_create(0);
+    executor_set_busy_poll(executor, 10 * 1000 * 1000); // much longer than the write takes
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ASSERT_SYS_OK(fd);
+    uint64_t value = 0;
+    PipeReadFuture reader = pipe_read_future_create(fd, (uint8_t*)&value, sizeof(value));
+    executor_spawn(executor, (Future*)&reader);
+    pthread_t writer;
+    ASSERT_ZERO(pthread_create(&writer, NULL, write_later, &fd));
+    executor_run(executor);
+    ASSERT_ZERO(pthread_join(writer, NULL));
+
+    MioStats stats;
+    mio_stats(executor_mio(executor), &stats);
+    printf("Busy polling took %llu polls\n", (unsigned long long)stats.polls);
+    assert(reader.base.errcode == FUTURE_SUCCESS && value == 1);
+    assert(stats.blocked_ns == 0);
+    assert(stats.polls > 1);
+    ASSERT_SYS_OK(close(fd));
+    executor_destroy(executor);
+}
+
 int main()
 {
     // In this test, we create two futures that read from two slow pipes, independently.
@@ -59,5 +128,7 @@ int main()
     // Destroy the executor
     executor_destroy(executor);
 
+    test_batch_growth();
+    test_busy_poll();
     return 0;
 }
@@ -0,0 +1,137 @@
+#include <assert.h>
+#include <stdint.h> // For uint8_t
+#include <stdio.h> // For printf
+#include <string.h> // For memcmp, strlen
+#include <unistd.h> // For STDOUT_FILENO
+
+#include "executor.h"
+#include "future.h"
+#include "future_combinators.h"
+#include "future_examples.h"
+#include "utils.h"
+
+#define CHAIN_LENGTH 100
+#define YIELDS 10
+
+FUTURE_PIPELINE_DEFINE3(ReadCapitalizeWrite, read_capitalize_write,
+    PipeReadFuture, pipe_read_future_progress,
+    ApplyFuture, apply_future_progress,
+    PipeWriteFuture, pipe_write_future_progress)
+
+/** A function that capitalizes a c-string in place and returns it. */
+static void* capitalize(void* arg)
+{
+    char* buffer = arg;
+    for (size_t i = 0; buffer[i]; ++i)
+        if ('a' <= buffer[i] && buffer[i] <= 'z')
+            buffer[i] = buffer[i] - 'a' + 'A';
+    return buffer;
+}
+
+static void* increment(void* arg)
+{
+    return (void*)((intptr_t)arg + 1);
+}
+
+static int yielding_calls = 0;
+
+/** A stage that yields a few times before passing its argument on. */
+static FutureState yielding_future_progress(Future* fut, Mio* mio, Waker waker)
+{
+    if (++yielding_calls <= YIELDS) {
+        waker_wake(&waker);
+        return FUTURE_PENDING;
+    }
+    fut->ok = fut->arg;
+    return FUTURE_COMPLETED;
+}
+
+static FutureState failing_future_progress(Future* fut, Mio* mio, Waker waker)
+{
+    fut->errcode = 42;
+    return FUTURE_FAILURE;
+}
+
+static int increments = 0;
+
+static void* counted_increment(void* arg)
+{
+    ++increments;
+    return increment(arg);
+}
+
+int main()
+{
+    // Tests of PipelineFuture: the same chain as in then_test, a long chain that yields
+    // in the middle, failures, and a specialized pipeline.
+
+    Executor* executor = executor_create(42);
+
+    const char* message = "aaabbbcccd\n";
+    int read_fd = create_example_read_pipe_end(message, 3, 0, 2);
+    uint8_t buffer[strlen(message) + 1];
+    PipeReadFuture f1 = pipe_read_future_create(read_fd, buffer, sizeof(buffer));
+    ApplyFuture f2 = apply_future_create(capitalize);
+    PipeWriteFuture f3 = pipe_write_future_create(STDOUT_FILENO, sizeof(buffer), true);
+    Future* stages[] = { (Future*)&f1, (Future*)&f2, (Future*)&f3 };
+    PipelineFuture read_capitalize_print = future_pipeline(stages, 3);
+
+    // A chain of increments with a yielding stage in the middle: the stages before it
+    // must not be re-entered when it is woken.
+    ApplyFuture increments_before[CHAIN_LENGTH / 2], increments_after[CHAIN_LENGTH / 2];
+    Future yielding = future_create(yielding_future_progress);
+    Future* chain[CHAIN_LENGTH + 1];
+    for (int i = 0; i < CHAIN_LENGTH / 2; ++i) {
+        increments_before[i] = apply_future_create(counted_increment);
+        increments_after[i] = apply_future_create(counted_increment);
+        chain[i] = (Future*)&increments_before[i];
+        chain[CHAIN_LENGTH / 2 + 1 + i] = (Future*)&increments_after[i];
+    }
+    chain[CHAIN_LENGTH / 2] = &yielding;
+    PipelineFuture long_chain = future_pipeline(chain, CHAIN_LENGTH + 1);
+    long_chain.base.arg = (void*)(intptr_t)1000; // passed to the first stage
+
+    // A failing stage stops the pipeline.
+    ApplyFuture before_failure = apply_future_create(increment);
+    Future failing = future_create(failing_future_progress);
+    ApplyFuture after_failure = apply_future_create(increment);
+    Future* failing_stages[] = { (Future*)&before_failure, &failing, (Future*)&after_failure };
+    PipelineFuture failing_pipeline = future_pipeline(failing_stages, 3);
+
+    // The specialized pipeline, fed from another pipe.
+    int read_fd2 = create_example_read_pipe_end(message, 3, 0, 2);
+    uint8_t buffer2[strlen(message) + 1];
+    ReadCapitalizeWrite specialized = read_capitalize_write_create(
+        pipe_read_future_create(read_fd2, buffer2, sizeof(buffer2)),
+        apply_future_create(capitalize),
+        pipe_write_future_create(STDOUT_FILENO, sizeof(buffer2), true));
+
+    executor_spawn(executor, (Future*)&read_capitalize_print);
+    executor_spawn(executor, (Future*)&long_chain);
+    executor_spawn(executor, (Future*)&failing_pipeline);
+    executor_spawn(executor, (Future*)&specialized);
+    executor_run(executor);
+
+    assert(read_capitalize_print.base.errcode == FUTURE_SUCCESS);
+    assert(read_capitalize_print.base.ok == buffer);
+    assert(memcmp(buffer, "AAABBBCCCD\n", sizeof(buffer)) == 0);
+
+    assert(long_chain.base.errcode == FUTURE_SUCCESS);
+    assert((intptr_t)long_chain.base.ok == 1000 + CHAIN_LENGTH);
+    assert(yielding_calls == YIELDS + 1);
+    assert(increments == CHAIN_LENGTH); // every stage was progressed exactly once
+
+    assert(failing_pipeline.base.errcode == PIPELINE_FUTURE_ERR_STAGE_FAILED(1));
+    assert(failing_pipeline.current == 1);
+    assert(after_failure.base.ok == NULL); // never progressed
+
+    assert(specialized.base.errcode == FUTURE_SUCCESS);
+    assert(specialized.base.ok == buffer2);
+    assert(memcmp(buffer2, "AAABBBCCCD\n", sizeof(buffer2)) == 0);
+
+    executor_destroy(executor);
+    close(read_fd);
+    close(read_fd2);
+    printf("Pipelines completed\n");
+    return 0;
+}
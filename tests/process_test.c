@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf
+#include <string.h> // For memcmp
+
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "process.h"
+
+#define MESSAGE "ping\n"
+
+int main()
+{
+    Executor* executor = executor_create(0);
+
+    // Output and the exit code of a child, collected concurrently.
+    char* shell_argv[] = { "sh", "-c", "echo out; echo err >&2; exit 3", NULL };
+    ProcessFuture shell;
+    int ret = process_spawn(&shell, shell_argv, PROCESS_PIPE_STDOUT | PROCESS_PIPE_STDERR);
+    assert(ret == 0);
+    assert(shell.stdin_fd == -1 && shell.stdout_fd != -1 && shell.stderr_fd != -1);
+    uint8_t out[4], err[4];
+    PipeReadFuture read_out = pipe_read_future_create(shell.stdout_fd, out, sizeof(out));
+    PipeReadFuture read_err = pipe_read_future_create(shell.stderr_fd, err, sizeof(err));
+    executor_spawn(executor, (Future*)&shell);
+    executor_spawn(executor, (Future*)&read_out);
+    executor_spawn(executor, (Future*)&read_err);
+    executor_run(executor);
+    assert(memcmp(out, "out\n", 4) == 0 && memcmp(err, "err\n", 4) == 0);
+    assert(shell.base.errcode == FUTURE_SUCCESS);
+    assert(shell.exited && shell.exit_code == 3 && (intptr_t)shell.base.ok == 3);
+    assert(shell.pidfd == -1);
+    process_close(&shell);
+
+    // A filter: what is written to its standard input comes back from its standard output.
+    char* cat_argv[] = { "cat", NULL };
+    ProcessFuture cat;
+    ret = process_spawn(&cat, cat_argv, PROCESS_PIPE_STDIN | PROCESS_PIPE_STDOUT);
+    assert(ret == 0);
+    PipeWriteFuture write = pipe_write_future_create(cat.stdin_fd, strlen(MESSAGE), false);
+    write.base.arg = MESSAGE;
+    FutureState state = executor_block_on(executor, (Future*)&write);
+    assert(state == FUTURE_COMPLETED);
+    process_close_stdin(&cat);
+    uint8_t echoed[sizeof(MESSAGE) - 1];
+    PipeReadFuture read_echoed = pipe_read_future_create(cat.stdout_fd, echoed, sizeof(echoed));
+    executor_spawn(executor, (Future*)&read_echoed);
+    state = executor_block_on(executor, (Future*)&cat);
+    assert(state == FUTURE_COMPLETED);
+    executor_run(executor);
+    assert(memcmp(echoed, MESSAGE, sizeof(echoed)) == 0);
+    assert(cat.exited && cat.exit_code == 0);
+    process_close(&cat);
+
+    // A killed child.
+    char* sleep_argv[] = { "sleep", "10", NULL };
+    ProcessFuture sleeping;
+    ret = process_spawn(&sleeping, sleep_argv, 0);
+    assert(ret == 0);
+    ret = process_kill(&sleeping, SIGTERM);
+    assert(ret == 0);
+    state = executor_block_on(executor, (Future*)&sleeping);
+    assert(state == FUTURE_COMPLETED);
+    assert(!sleeping.exited && sleeping.term_signal == SIGTERM);
+    assert((intptr_t)sleeping.base.ok == 128 + SIGTERM);
+    ret = process_kill(&sleeping, SIGTERM);
+    assert(ret == -1 && errno == ESRCH);
+    process_close(&sleeping);
+
+    // A missing program.
+    char* missing_argv[] = { "/nonexistent/program", NULL };
+    ProcessFuture missing;
+    ret = process_spawn(&missing, missing_argv, PROCESS_PIPE_STDOUT);
+    assert(ret == -1);
+    printf("Spawning a missing program: %s\n", strerror(errno));
+    assert(errno == ENOENT);
+    assert(missing.stdout_fd == -1 && missing.pidfd == -1);
+
+    executor_destroy(executor);
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h> // For O_NONBLOCK
+#include <stdint.h> // For uint64_t
+#include <stdio.h> // For printf
+#include <stdlib.h> // For malloc
+#include <string.h> // For memcmp
+#include <unistd.h> // For pipe2, close
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "rate_limiter.h"
+
+#define MS 1000000ULL
+#define N_SLEEPERS 3
+#define N_ACQUIRERS 3
+#define PACED_BYTES 10000
+#define LARGE_WRITE (1 << 20) // more than a pipe holds
+
+static void test_token_bucket(void)
+{
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 1000, 10); // a token per millisecond
+    uint64_t now = 1000 * MS;
+    uint64_t wait = rate_limiter_try_acquire(&limiter, 10, now);
+    assert(wait == 0); // the bucket starts full
+    wait = rate_limiter_try_acquire(&limiter, 1, now);
+    assert(wait == 1 * MS);
+    wait = rate_limiter_try_acquire(&limiter, 1, now + MS);
+    assert(wait == 0);
+    wait = rate_limiter_try_acquire(&limiter, 5, now + 2 * MS);
+    assert(wait == 4 * MS);
+    // More than the burst: allowed with a full bucket, which is then in debt.
+    now += 100 * MS;
+    wait = rate_limiter_try_acquire(&limiter, 25, now);
+    assert(wait == 0);
+    wait = rate_limiter_try_acquire(&limiter, 1, now);
+    assert(wait == 16 * MS);
+}
+
+/** Records the order in which its sleep completes. */
+typedef struct SleeperFuture {
+    Future base;
+    SleepFuture sleep;
+    int id;
+} SleeperFuture;
+
+static int woken_order[N_SLEEPERS];
+static int n_woken = 0;
+
+static FutureState sleeper_progress(Future* base, Mio* mio, Waker waker)
+{
+    SleeperFuture* self = (SleeperFuture*)base;
+    FutureState state = self->sleep.base.progress((Future*)&self->sleep, mio, waker);
+    if (state == FUTURE_COMPLETED)
+        woken_order[n_woken++] = self->id;
+    return state;
+}
+
+static void test_sleep(Executor* executor)
+{
+    const uint64_t durations[N_SLEEPERS] = { 30 * MS, 10 * MS, 20 * MS };
+    SleeperFuture sleepers[N_SLEEPERS];
+    uint64_t start = executor_now_ns(executor);
+    for (int i = 0; i < N_SLEEPERS; ++i) {
+        sleepers[i] = (SleeperFuture) {
+            .base = future_create(sleeper_progress),
+            .sleep = sleep_future_create(durations[i]),
+            .id = i,
+        };
+        executor_spawn(executor, (Future*)&sleepers[i]);
+    }
+    executor_run(executor);
+    uint64_t elapsed = executor_now_ns(executor) - start;
+    printf("Sleeps took %llu ms\n", (unsigned long long)(elapsed / MS));
+    assert(elapsed >= 30 * MS);
+    assert(woken_order[0] == 1 && woken_order[1] == 2 && woken_order[2] == 0);
+}
+
+static void test_acquire(Executor* executor)
+{
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 10000, 100); // 100 tokens per 10 ms
+    RateAcquireFuture acquires[N_ACQUIRERS];
+    uint64_t start = executor_now_ns(executor);
+    for (int i = 0; i < N_ACQUIRERS; ++i) {
+        acquires[i] = rate_acquire_future_create(&limiter, 100);
+        executor_spawn(executor, (Future*)&acquires[i]);
+    }
+    executor_run(executor);
+    uint64_t elapsed = executor_now_ns(executor) - start;
+    printf("Acquiring %d bursts took %llu ms\n", N_ACQUIRERS, (unsigned long long)(elapsed / MS));
+    assert(elapsed >= (N_ACQUIRERS - 1) * 10 * MS);
+}
+
+static void test_paced_write(Executor* executor)
+{
+    int fds[2];
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK));
+    static uint8_t data[PACED_BYTES], received[PACED_BYTES];
+    for (size_t i = 0; i < PACED_BYTES; ++i)
+        data[i] = (uint8_t)i;
+    RateLimiter limiter;
+    rate_limiter_init(&limiter, 100000, 1000); // 1000 bytes per 10 ms
+    PacedWriteFuture write = paced_write_future_create(&limiter, fds[1], PACED_BYTES);
+    write.base.arg = data;
+    PipeReadFuture read = pipe_read_future_create(fds[0], received, PACED_BYTES);
+    uint64_t start = executor_now_ns(executor);
+    executor_spawn(executor, (Future*)&write);
+    executor_spawn(executor, (Future*)&read);
+    executor_run(executor);
+    uint64_t elapsed = executor_now_ns(executor) - start;
+    printf("Paced write of %d bytes took %llu ms\n", PACED_BYTES, (unsigned long long)(elapsed / MS));
+    assert(write.base.errcode == FUTURE_SUCCESS && read.base.errcode == FUTURE_SUCCESS);
+    assert(memcmp(data, received, PACED_BYTES) == 0);
+    assert(elapsed >= 90 * MS && elapsed < 1000 * MS);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_large_pipe_write(Executor* executor)
+{
+    // The writer has to wait for the pipe to become writable (EPOLLOUT) several times.
+    int fds[2];
+    ASSERT_SYS_OK(pipe2(fds, O_NONBLOCK));
+    uint8_t* data = malloc(LARGE_WRITE);
+    uint8_t* received = malloc(LARGE_WRITE);
+    assert(data && received);
+    memset(data, 'x', LARGE_WRITE);
+    PipeWriteFuture write = pipe_write_future_create(fds[1], LARGE_WRITE, false);
+    write.base.arg = data;
+    PipeReadFuture read = pipe_read_future_create(fds[0], received, LARGE_WRITE);
+    executor_spawn(executor, (Future*)&write);
+    executor_run_until_idle(executor);
+    // Nobody reads yet, so the writer has filled the pipe and got EAGAIN.
+    assert(write.base.is_active);
+    assert(write.written_so_far > 0 && write.written_so_far < LARGE_WRITE);
+    executor_spawn(executor, (Future*)&read);
+    // Every tick is woken by an event: a writer waiting for the wrong one would never be.
+    while (executor_live_tasks(executor) > 0) {
+        int ticked = executor_tick(executor, 1000);
+        assert(ticked > 0);
+    }
+    assert(write.base.errcode == FUTURE_SUCCESS && read.base.errcode == FUTURE_SUCCESS);
+    assert(memcmp(data, received, LARGE_WRITE) == 0);
+    free(data);
+    free(received);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main()
+{
+    test_token_bucket();
+    Executor* executor = executor_create(0);
+    test_sleep(executor);
+    test_acquire(executor);
+    test_paced_write(executor);
+    test_large_pipe_write(executor);
+    executor_destroy(executor);
+    return 0;
+}
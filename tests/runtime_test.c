@@ -0,0 +1,115 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdio.h> // For printf
+#include <stdlib.h> // For rand_r
+
+#include "executor.h"
+#include "future.h"
+#include "runtime.h"
+
+#define N_SHARDS 3
+#define N_CHAINS 200
+#define HOPS 4
+
+#define STRESS_SHARDS 16
+#define STRESS_CHAINS 4
+#define STRESS_HOPS 1024
+#define STRESS_ROUNDS 50
+
+static Runtime* runtime;
+static atomic_int completed_hops = 0;
+static atomic_int misplaced_hops = 0;
+
+/** One hop of a chain of futures, each of which runs on the next shard. */
+typedef struct HopFuture {
+    Future base;
+    size_t shard; // shard the hop is expected to run on
+    struct HopFuture* next; // next hop (NULL if this is the last one)
+} HopFuture;
+
+static FutureState hop_progress(Future* fut, Mio* mio, Waker waker)
+{
+    HopFuture* self = (HopFuture*)fut;
+    if (runtime_current_shard() != self->shard)
+        atomic_fetch_add(&misplaced_hops, 1);
+    if (self->next) {
+        int ret = runtime_submit(runtime, self->next->shard, (Future*)self->next);
+        assert(ret == 0);
+    }
+    atomic_fetch_add(&completed_hops, 1);
+    return FUTURE_COMPLETED;
+}
+
+static void submit_chains(size_t n_chains, size_t hops, HopFuture chains[n_chains][hops])
+{
+    for (size_t chain = 0; chain < n_chains; ++chain) {
+        int ret = runtime_submit(runtime, chains[chain][0].shard, (Future*)&chains[chain][0]);
+        assert(ret == 0);
+    }
+}
+
+static void test_chains(void)
+{
+    // A test that submits chains of futures hopping from one shard to the next one.
+
+    runtime = runtime_create(N_SHARDS, 0);
+    assert(runtime != NULL);
+    assert(runtime_shard_count(runtime) == N_SHARDS);
+    assert(runtime_current_shard() == RUNTIME_NO_SHARD);
+    int ret = runtime_submit(runtime, N_SHARDS, NULL);
+    assert(ret == -1);
+
+    static HopFuture hops[N_CHAINS][HOPS];
+    for (int chain = 0; chain < N_CHAINS; ++chain) {
+        for (int hop = 0; hop < HOPS; ++hop) {
+            hops[chain][hop] = (HopFuture) {
+                .base = future_create(hop_progress),
+                .shard = (chain + hop) % N_SHARDS,
+                .next = hop + 1 < HOPS ? &hops[chain][hop + 1] : NULL,
+            };
+        }
+    }
+    submit_chains(N_CHAINS, HOPS, hops);
+
+    // Waits for all the chains, including the hops submitted after this call.
+    runtime_destroy(runtime);
+
+    printf("Completed %d hops\n", atomic_load(&completed_hops));
+    assert(atomic_load(&completed_hops) == N_CHAINS * HOPS);
+    assert(atomic_load(&misplaced_hops) == 0);
+}
+
+static void test_termination_stress(void)
+{
+    // A few long chains hopping between random shards while the runtime is being destroyed:
+    // most shards are idle at any time and keep becoming busy again, and no hop may be lost
+    // to a shard that has wrongly detected termination.
+
+    static HopFuture hops[STRESS_CHAINS][STRESS_HOPS];
+    unsigned seed = 1;
+    for (int round = 0; round < STRESS_ROUNDS; ++round) {
+        atomic_store(&completed_hops, 0);
+        for (int chain = 0; chain < STRESS_CHAINS; ++chain) {
+            for (int hop = 0; hop < STRESS_HOPS; ++hop) {
+                hops[chain][hop] = (HopFuture) {
+                    .base = future_create(hop_progress),
+                    .shard = (size_t)rand_r(&seed) % STRESS_SHARDS,
+                    .next = hop + 1 < STRESS_HOPS ? &hops[chain][hop + 1] : NULL,
+                };
+            }
+        }
+        runtime = runtime_create(STRESS_SHARDS, 0);
+        assert(runtime != NULL);
+        submit_chains(STRESS_CHAINS, STRESS_HOPS, hops);
+        runtime_destroy(runtime);
+        assert(atomic_load(&completed_hops) == STRESS_CHAINS * STRESS_HOPS);
+    }
+    assert(atomic_load(&misplaced_hops) == 0);
+}
+
+int main()
+{
+    test_chains();
+    test_termination_stress();
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h> // For O_NONBLOCK
+#include <limits.h> // For ULONG_MAX
+#include <stdint.h> // For uint8_t
+#include <stdio.h> // For printf
+#include <time.h>
+#include <unistd.h> // For pipe2, write, close
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "join_handle.h"
+
+#define DRAIN_TIMEOUT_MS 200
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static Future* cancelled[4];
+static size_t n_cancelled = 0;
+
+static void on_cancel(Future* fut, void* arg)
+{
+    assert(arg == (void*)cancelled);
+    assert(!fut->is_active && fut->errcode == ECANCELED);
+    cancelled[n_cancelled++] = fut;
+}
+
+/** Waits for a wake-up that never comes. */
+static FutureState pending_forever_progress(Future* fut, Mio* mio, Waker waker)
+{
+    return FUTURE_PENDING;
+}
+
+int main()
+{
+    Executor* executor = executor_create(0);
+
+    // A request in flight, whose data is already there, and two that will never get any.
+    int in_flight[2], stuck[2];
+    ASSERT_SYS_OK(pipe2(in_flight, O_NONBLOCK));
+    ASSERT_SYS_OK(pipe2(stuck, O_NONBLOCK));
+    ASSERT_SYS_OK(write(in_flight[1], "data", 4));
+    uint8_t buffer[4], stuck_buffer[4], owned_buffer[4];
+    PipeReadFuture draining = pipe_read_future_create(in_flight[0], buffer, sizeof(buffer));
+    PipeReadFuture straggler = pipe_read_future_create(stuck[0], stuck_buffer, sizeof(stuck_buffer));
+    PipeReadFuture owned = pipe_read_future_create(stuck[0], owned_buffer, sizeof(owned_buffer));
+    executor_spawn(executor, (Future*)&draining);
+    executor_spawn(executor, (Future*)&straggler);
+    JoinHandle handle;
+    EXECUTOR_SPAWN_OWNED(executor, owned, &handle);
+
+    uint64_t start = monotonic_ms();
+    size_t n = executor_shutdown(executor, DRAIN_TIMEOUT_MS, on_cancel, cancelled);
+    uint64_t elapsed = monotonic_ms() - start;
+    printf("Shutdown took %llu ms and cancelled %zu tasks\n", (unsigned long long)elapsed, n);
+
+    // The in-flight request has been drained, the stragglers cancelled at the deadline.
+    assert(elapsed >= DRAIN_TIMEOUT_MS);
+    assert(draining.base.errcode == FUTURE_SUCCESS && !draining.base.is_active);
+    assert(n == 2 && n_cancelled == 2);
+    assert((cancelled[0] == (Future*)&straggler) != (cancelled[1] == (Future*)&straggler));
+    assert(straggler.base.errcode == ECANCELED);
+    Waker waker = { .executor = executor, .future = NULL };
+    FutureState state = handle.base.progress((Future*)&handle, NULL, waker);
+    assert(state == FUTURE_FAILURE);
+    assert(handle.base.errcode == ECANCELED);
+
+    ExecutorStats stats;
+    executor_stats(executor, &stats);
+    assert(stats.cancelled == 2);
+
+    // No new work is accepted.
+    ApplyFuture late = apply_future_create(NULL);
+    int ret = executor_try_spawn(executor, (Future*)&late);
+    assert(ret == -1 && errno == ESHUTDOWN);
+
+    // Nothing is registered anymore, so the data that arrives now wakes nobody up.
+    ASSERT_SYS_OK(write(stuck[1], "late", 4));
+    executor_run(executor);
+
+    // With nothing that could wake the stragglers up, they are cancelled right away.
+    Future forgotten = future_create(pending_forever_progress);
+    executor_spawn(executor, &forgotten);
+    start = monotonic_ms();
+    n = executor_shutdown(executor, 10 * DRAIN_TIMEOUT_MS, NULL, NULL);
+    assert(n == 1);
+    assert(monotonic_ms() - start < DRAIN_TIMEOUT_MS);
+    assert(forgotten.errcode == ECANCELED);
+
+    executor_destroy(executor);
+
+    // A timeout too large for the clock means no deadline: nothing is cancelled.
+    executor = executor_create(0);
+    SleepFuture sleep = sleep_future_create(DRAIN_TIMEOUT_MS * 1000000ULL);
+    executor_spawn(executor, (Future*)&sleep);
+    start = monotonic_ms();
+    n = executor_shutdown(executor, ULONG_MAX, NULL, NULL);
+    assert(n == 0);
+    assert(monotonic_ms() - start >= DRAIN_TIMEOUT_MS);
+    assert(sleep.base.errcode == FUTURE_SUCCESS);
+    executor_destroy(executor);
+    for (int i = 0; i < 2; ++i) {
+        close(in_flight[i]);
+        close(stuck[i]);
+    }
+    return 0;
+}
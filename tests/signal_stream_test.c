@@ -0,0 +1,81 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf
+#include <unistd.h> // For getpid
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "process.h"
+#include "signal_stream.h"
+
+#define N_QUEUED 3
+
+/** Receives signals until SIGTERM, counting the other ones and summing their sigqueue() values. */
+typedef struct ReceiverFuture {
+    Future base;
+    SignalNextFuture next;
+    int received;
+    int value_sum;
+    bool terminated;
+} ReceiverFuture;
+
+static FutureState receiver_progress(Future* base, Mio* mio, Waker waker)
+{
+    ReceiverFuture* self = (ReceiverFuture*)base;
+    for (;;) {
+        FutureState state = self->next.base.progress((Future*)&self->next, mio, waker);
+        if (state != FUTURE_COMPLETED)
+            return state;
+        struct signalfd_siginfo* info = self->next.base.ok;
+        printf("Received signal %u from %u\n", info->ssi_signo, info->ssi_pid);
+        if (info->ssi_signo == SIGTERM) {
+            self->terminated = true;
+            return FUTURE_COMPLETED;
+        }
+        ++self->received;
+        self->value_sum += info->ssi_int;
+        self->next = signal_stream_next(self->next.stream);
+    }
+}
+
+int main()
+{
+    sigset_t signals;
+    ASSERT_SYS_OK(sigemptyset(&signals));
+    ASSERT_SYS_OK(sigaddset(&signals, SIGRTMIN));
+    ASSERT_SYS_OK(sigaddset(&signals, SIGTERM));
+    SignalStream stream;
+    ASSERT_SYS_OK(signal_stream_open(&stream, &signals));
+
+    Executor* executor = executor_create(0);
+
+    // Signals that arrived before anybody waited for them are kept (real-time ones are queued).
+    for (int i = 1; i <= N_QUEUED; ++i)
+        ASSERT_SYS_OK(sigqueue(getpid(), SIGRTMIN, (union sigval) { .sival_int = i }));
+
+    // SIGTERM, which would kill the process, arrives later from a child.
+    char* killer_argv[] = { "sh", "-c", "sleep 0.2; kill -TERM $PPID", NULL };
+    ProcessFuture killer;
+    ASSERT_SYS_OK(process_spawn(&killer, killer_argv, 0));
+
+    ReceiverFuture receiver = {
+        .base = future_create(receiver_progress),
+        .next = signal_stream_next(&stream),
+    };
+    executor_spawn(executor, (Future*)&receiver);
+    executor_spawn(executor, (Future*)&killer);
+    executor_run(executor);
+
+    assert(receiver.terminated);
+    assert(receiver.received == N_QUEUED);
+    assert(receiver.value_sum == N_QUEUED * (N_QUEUED + 1) / 2);
+    assert(killer.exited && killer.exit_code == 0);
+    process_close(&killer);
+
+    executor_destroy(executor);
+    signal_stream_close(&stream);
+    return 0;
+}
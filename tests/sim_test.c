@@ -0,0 +1,244 @@
+#include <assert.h>
+#include <errno.h> // For EPIPE, EAGAIN
+#include <stdint.h> // For uint64_t
+#include <stdio.h> // For printf
+#include <stdlib.h> // For malloc
+#include <string.h> // For memcmp
+#include <time.h> // For clock_gettime
+
+#include "async.h"
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+#include "mio.h"
+
+#define SEC 1000000000ULL
+#define CHUNK 3
+#define N_SLEEPERS 16
+#define N_TIMERS 10000
+#define LARGE_WRITE (1 << 20) // more than a pipe holds
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** Like `create_example_read_pipe_end()` of the other tests: writes a message in chunks, a second apart. */
+typedef struct SlowWriterFuture {
+    Future base;
+    int state;
+    int fd;
+    const char* message;
+    size_t n; // length of the message, including its zero byte
+    size_t sent;
+    SleepFuture sleep;
+    PipeWriteFuture write;
+} SlowWriterFuture;
+
+static FutureState slow_writer_progress(Future* base, Mio* mio, Waker waker)
+{
+    SlowWriterFuture* self = (SlowWriterFuture*)base;
+    ASYNC_BEGIN(base, self->state);
+    while (self->sent < self->n) {
+        self->sleep = sleep_future_create(SEC);
+        AWAIT(&self->sleep);
+        self->write = pipe_write_future_create(self->fd, self->n - self->sent < CHUNK ? self->n - self->sent : CHUNK, false);
+        self->write.base.arg = (void*)(self->message + self->sent);
+        AWAIT(&self->write);
+        self->sent += self->write.n;
+    }
+    ASSERT_SYS_OK(mio_close(mio, self->fd));
+    ASYNC_END(NULL);
+}
+
+static void test_slow_pipes(void)
+{
+    // The scenario of mio_test, on the virtual clock: two readers of pipes written to
+    // 3 bytes at a time, a second apart, work concurrently.
+    const char* message = "AAABBBCCCD";
+    Executor* executor = executor_create_simulated(0, 42);
+    Mio* mio = executor_mio(executor);
+    int fds[2][2];
+    uint8_t buffers[2][11];
+    SlowWriterFuture writers[2];
+    PipeReadFuture readers[2];
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_SYS_OK(mio_pipe(mio, fds[i]));
+        writers[i] = (SlowWriterFuture) {
+            .base = future_create(slow_writer_progress),
+            .state = 0,
+            .fd = fds[i][1],
+            .message = message,
+            .n = strlen(message) + 1,
+            .sent = 0,
+        };
+        readers[i] = pipe_read_future_create(fds[i][0], buffers[i], sizeof(buffers[i]));
+        executor_spawn(executor, (Future*)&writers[i]);
+        executor_spawn(executor, (Future*)&readers[i]);
+    }
+    uint64_t start = executor_now_ns(executor);
+    uint64_t real_start = monotonic_ns();
+    executor_run(executor);
+    uint64_t elapsed = executor_now_ns(executor) - start;
+    printf("Virtual time: %llu ns, real time: %llu us\n", (unsigned long long)elapsed,
+        (unsigned long long)(monotonic_ns() - real_start) / 1000);
+    assert(elapsed == 4 * SEC);
+    for (int i = 0; i < 2; ++i) {
+        assert(readers[i].base.errcode == FUTURE_SUCCESS);
+        assert(memcmp(buffers[i], message, sizeof(buffers[i])) == 0);
+        ASSERT_SYS_OK(mio_close(mio, fds[i][0]));
+    }
+    executor_destroy(executor);
+}
+
+/** Sleeps, then records its id. */
+typedef struct SleeperFuture {
+    Future base;
+    SleepFuture sleep;
+    int id;
+    int* order;
+    int* n_woken;
+} SleeperFuture;
+
+static FutureState sleeper_progress(Future* base, Mio* mio, Waker waker)
+{
+    SleeperFuture* self = (SleeperFuture*)base;
+    FutureState state = self->sleep.base.progress((Future*)&self->sleep, mio, waker);
+    if (state == FUTURE_COMPLETED)
+        self->order[(*self->n_woken)++] = self->id;
+    return state;
+}
+
+// Runs sleepers that all wake up at the same time, recording the order they are run in
+static void run_sleepers(uint64_t seed, int order[N_SLEEPERS])
+{
+    Executor* executor = executor_create_simulated(0, seed);
+    SleeperFuture sleepers[N_SLEEPERS];
+    int n_woken = 0;
+    uint64_t deadline = executor_now_ns(executor) + SEC;
+    for (int i = 0; i < N_SLEEPERS; ++i) {
+        sleepers[i] = (SleeperFuture) {
+            .base = future_create(sleeper_progress),
+            .sleep = sleep_until_future_create(deadline),
+            .id = i,
+            .order = order,
+            .n_woken = &n_woken,
+        };
+        executor_spawn(executor, (Future*)&sleepers[i]);
+    }
+    executor_run(executor);
+    assert(n_woken == N_SLEEPERS);
+    executor_destroy(executor);
+}
+
+static void test_seeded_order(void)
+{
+    int first[N_SLEEPERS], again[N_SLEEPERS], other[N_SLEEPERS];
+    run_sleepers(1, first);
+    run_sleepers(1, again);
+    run_sleepers(2, other);
+    assert(memcmp(first, again, sizeof(first)) == 0);
+    assert(memcmp(first, other, sizeof(first)) != 0);
+}
+
+static void test_many_timers(void)
+{
+    // Timers of up to an hour fire in the order of their deadlines, without taking real time
+    Executor* executor = executor_create_simulated(0, 7);
+    SleeperFuture* sleepers = malloc(N_TIMERS * sizeof(SleeperFuture));
+    int* order = malloc(N_TIMERS * sizeof(int));
+    assert(sleepers && order);
+    int n_woken = 0;
+    unsigned seed = 1;
+    uint64_t start = executor_now_ns(executor);
+    for (int i = 0; i < N_TIMERS; ++i) {
+        sleepers[i] = (SleeperFuture) {
+            .base = future_create(sleeper_progress),
+            .sleep = sleep_future_create((uint64_t)rand_r(&seed) % (3600 * SEC)),
+            .id = i,
+            .order = order,
+            .n_woken = &n_woken,
+        };
+        executor_spawn(executor, (Future*)&sleepers[i]);
+    }
+    executor_run(executor);
+    assert(n_woken == N_TIMERS);
+    for (int i = 1; i < N_TIMERS; ++i)
+        assert(sleepers[order[i - 1]].sleep.deadline_ns <= sleepers[order[i]].sleep.deadline_ns);
+    assert(executor_now_ns(executor) - start == sleepers[order[N_TIMERS - 1]].sleep.duration_ns);
+    free(order);
+    free(sleepers);
+    executor_destroy(executor);
+}
+
+static void test_pipe_semantics(void)
+{
+    Executor* executor = executor_create_simulated(0, 3);
+    Mio* mio = executor_mio(executor);
+    int fds[2];
+    ASSERT_SYS_OK(mio_pipe(mio, fds));
+
+    // A large transfer, through a full pipe (EAGAIN, then EPOLLOUT)
+    uint8_t* data = malloc(LARGE_WRITE);
+    uint8_t* received = malloc(LARGE_WRITE);
+    assert(data && received);
+    for (size_t i = 0; i < LARGE_WRITE; ++i)
+        data[i] = (uint8_t)(i * 31 + i / 7);
+    PipeWriteFuture write = pipe_write_future_create(fds[1], LARGE_WRITE, false);
+    write.base.arg = data;
+    PipeReadFuture read = pipe_read_future_create(fds[0], received, LARGE_WRITE);
+    executor_spawn(executor, (Future*)&write);
+    executor_spawn(executor, (Future*)&read);
+    executor_run(executor);
+    assert(write.base.errcode == FUTURE_SUCCESS && read.base.errcode == FUTURE_SUCCESS);
+    assert(memcmp(data, received, LARGE_WRITE) == 0);
+    assert(mio_registered_count(mio) == 0);
+
+    uint8_t byte = 1;
+    ssize_t ret;
+    for (size_t i = 0; i < MIO_PIPE_CAPACITY; ++i) {
+        ret = mio_write(mio, fds[1], &byte, 1);
+        assert(ret == 1);
+    }
+    ret = mio_write(mio, fds[1], &byte, 1);
+    assert(ret == -1 && errno == EAGAIN);
+    for (size_t i = 0; i < MIO_PIPE_CAPACITY; ++i) {
+        ret = mio_read(mio, fds[0], &byte, 1);
+        assert(ret == 1);
+    }
+    ret = mio_read(mio, fds[0], &byte, 1);
+    assert(ret == -1 && errno == EAGAIN);
+
+    // EOF once the write end is closed
+    ASSERT_SYS_OK(mio_close(mio, fds[1]));
+    PipeReadFuture eof = pipe_read_future_create(fds[0], received, 1);
+    executor_spawn(executor, (Future*)&eof);
+    executor_run(executor);
+    assert(eof.base.errcode == PIPE_FUTURE_ERR_EOF);
+    ASSERT_SYS_OK(mio_close(mio, fds[0]));
+    ret = mio_close(mio, fds[0]);
+    assert(ret == -1 && errno == EBADF);
+
+    // EPIPE once the read end is closed
+    ASSERT_SYS_OK(mio_pipe(mio, fds));
+    ASSERT_SYS_OK(mio_close(mio, fds[0]));
+    ret = mio_write(mio, fds[1], &byte, 1);
+    assert(ret == -1 && errno == EPIPE);
+    ASSERT_SYS_OK(mio_close(mio, fds[1]));
+
+    free(data);
+    free(received);
+    executor_destroy(executor);
+}
+
+int main()
+{
+    test_slow_pipes();
+    test_seeded_order();
+    test_many_timers();
+    test_pipe_semantics();
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h> // For intptr_t
+#include <stdio.h> // For printf
+
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+
+#define N_TASKS 10000
+#define MAX_LIVE_TASKS 4
+#define N_ROUNDS 5
+
+static void* increment(void* arg)
+{
+    return (void*)((intptr_t)arg + 1);
+}
+
+/** A future that wakes itself up twice per progress() call and counts the calls. */
+static FutureState double_wake_progress(Future* fut, Mio* mio, Waker waker)
+{
+    intptr_t* calls = fut->arg;
+    if (++*calls == N_ROUNDS)
+        return FUTURE_COMPLETED;
+    waker_wake(&waker);
+    waker_wake(&waker);
+    return FUTURE_PENDING;
+}
+
+int main()
+{
+    // A test that checks that the run queue is not limited by `max_queue_size`,
+    // that `executor_try_spawn()` reports backpressure, and that repeated wakes are coalesced.
+
+    Executor* executor = executor_create(MAX_LIVE_TASKS);
+
+    static ApplyFuture futures[N_TASKS];
+    for (int i = 0; i < N_TASKS; ++i) {
+        futures[i] = apply_future_create(increment);
+        futures[i].base.arg = (void*)(intptr_t)i;
+        executor_spawn(executor, (Future*)&futures[i]);
+    }
+
+    intptr_t calls = 0;
+    Future double_wake = future_create(double_wake_progress);
+    double_wake.arg = &calls;
+    int ret = executor_try_spawn(executor, &double_wake);
+    assert(ret == -1 && errno == EAGAIN);
+
+    executor_run(executor);
+
+    for (int i = 0; i < N_TASKS; ++i)
+        assert((intptr_t)futures[i].base.ok == i + 1);
+
+    // All tasks have completed, so there is room for new ones.
+    ret = executor_try_spawn(executor, &double_wake);
+    assert(ret == 0);
+    executor_run(executor);
+    printf("double_wake progressed %ld times\n", (long)calls);
+    assert(calls == N_ROUNDS);
+
+    executor_destroy(executor);
+
+    return 0;
+}
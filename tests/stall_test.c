@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <stdio.h> // For printf, tmpfile
+#include <string.h>
+#include <unistd.h> // For usleep
+
+#include "executor.h"
+#include "future.h"
+#include "log.h"
+
+#define STALL_THRESHOLD_US 20000
+#define QUICK_CALLS 1000
+
+static int quick_calls = 0;
+
+/** A well-behaved future that yields quickly, many times. */
+static FutureState quick_future_progress(Future* fut, Mio* mio, Waker waker)
+{
+    if (++quick_calls < QUICK_CALLS) {
+        waker_wake(&waker);
+        return FUTURE_PENDING;
+    }
+    return FUTURE_COMPLETED;
+}
+
+/**
+ * A future that blocks the executor for a long time, twice.
+ * Not static, so that the stall detector can name it (the test is linked with -rdynamic).
+ */
+FutureState stalling_future_progress(Future* fut, Mio* mio, Waker waker)
+{
+    usleep(5 * STALL_THRESHOLD_US);
+    if (fut->arg == NULL) {
+        fut->arg = fut;
+        waker_wake(&waker);
+        return FUTURE_PENDING;
+    }
+    return FUTURE_COMPLETED;
+}
+
+int main()
+{
+    FILE* out = tmpfile();
+    assert(out);
+    log_set_output(out);
+
+    Executor* executor = executor_create(42);
+    executor_set_stall_threshold(executor, STALL_THRESHOLD_US);
+
+    Future quick = future_create(quick_future_progress);
+    Future stalling = future_create(stalling_future_progress);
+    executor_spawn(executor, &quick);
+    executor_spawn(executor, &stalling);
+    executor_run(executor);
+
+    ExecutorStats stats;
+    executor_stats(executor, &stats);
+    printf("stalls = %llu, max stall = %llu us\n", (unsigned long long)stats.stalls,
+        (unsigned long long)stats.max_stall_ns / 1000);
+    // Both long calls are reported exactly once, and none of the quick ones.
+    assert(stats.stalls == 2);
+    assert(stats.max_stall_ns >= STALL_THRESHOLD_US * 1000ULL);
+
+    // The counts survive stopping the detector.
+    executor_set_stall_threshold(executor, 0);
+    executor_stats(executor, &stats);
+    assert(stats.stalls == 2);
+    executor_destroy(executor);
+
+    char report[4096];
+    rewind(out);
+    size_t len = fread(report, 1, sizeof(report) - 1, out);
+    report[len] = '\0';
+    printf("%s", report);
+    assert(strstr(report, "stalling_future_progress"));
+    assert(!strstr(report, "quick_future_progress"));
+
+    log_set_output(NULL);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Required for `unistd.h` include to contain `pipe2`.
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h> // For printf
+#include <unistd.h> // For pipe, write
+
+#include "err.h"
+#include "executor.h"
+#include "future.h"
+#include "future_examples.h"
+
+static int write_fd;
+
+static FutureState writer_progress(Future* fut, Mio* mio, Waker waker)
+{
+    ASSERT_SYS_OK(write(write_fd, "stats", 5));
+    return FUTURE_COMPLETED;
+}
+
+int main()
+{
+    // A test that checks the counters of the executor and of its Mio:
+    // the reader blocks on an empty pipe (1 progress call, 1 registration),
+    // the writer fills it (1 progress call), and the reader completes after a poll
+    // (1 progress call, 1 unregistration).
+
+    int pipe_fds[2];
+    ASSERT_SYS_OK(pipe2(pipe_fds, O_NONBLOCK));
+    write_fd = pipe_fds[1];
+
+    Executor* executor = executor_create(42);
+
+    uint8_t buffer[5];
+    PipeReadFuture reader = pipe_read_future_create(pipe_fds[0], buffer, sizeof(buffer));
+    TaskStats reader_stats = { 0 };
+    reader.base.stats = &reader_stats;
+    Future writer = future_create(writer_progress);
+
+    executor_spawn(executor, (Future*)&reader);
+    executor_spawn(executor, &writer);
+    executor_run(executor);
+
+    ExecutorStats stats;
+    executor_stats(executor, &stats);
+    printf("progress calls: %llu, wakes: %llu, polls: %llu, events: %llu\n",
+        (unsigned long long)stats.progress_calls, (unsigned long long)stats.wakes,
+        (unsigned long long)stats.mio.polls, (unsigned long long)stats.mio.events);
+
+    assert(stats.spawned == 2);
+    assert(stats.completed == 2);
+    assert(stats.progress_calls == 3);
+    assert(stats.wakes == 1);
+    assert(stats.queue_high_water == 2);
+    uint64_t runs = 0;
+    for (int i = 0; i < EXECUTOR_LATENCY_BUCKETS; ++i)
+        runs += stats.wake_to_run_ns[i];
+    assert(runs == stats.progress_calls);
+    assert(stats.mio.polls >= 1);
+    assert(stats.mio.events == 1);
+    assert(stats.mio.max_events_per_poll == 1);
+    assert(stats.mio.ctl_add == 1);
+    assert(stats.mio.ctl_mod == 0);
+    assert(stats.mio.ctl_del == 1);
+
+    assert(reader_stats.progress_calls == 2);
+    assert(reader_stats.max_progress_ns <= reader_stats.progress_ns);
+
+    executor_destroy(executor);
+    ASSERT_SYS_OK(close(pipe_fds[0]));
+    ASSERT_SYS_OK(close(pipe_fds[1]));
+
+    return 0;
+}
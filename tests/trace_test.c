@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h> // For uintptr_t
+#include <stdio.h> // For open_memstream, printf
+#include <stdlib.h> // For free
+#include <string.h> // For strncmp, strstr, strchr
+
+#include "executor.h"
+#include "future.h"
+
+#define N_TASKS 3
+#define YIELDS 2
+#define LONG_YIELDS (EXECUTOR_TRACE_CAPACITY / 2)
+
+/** Wakes itself up `left` times, then completes. */
+typedef struct YieldingFuture {
+    Future base;
+    int left;
+} YieldingFuture;
+
+static FutureState yielding_progress(Future* fut, Mio* mio, Waker waker)
+{
+    YieldingFuture* self = (YieldingFuture*)fut;
+    if (self->left == 0)
+        return FUTURE_COMPLETED;
+    --self->left;
+    waker_wake(&waker);
+    return FUTURE_PENDING;
+}
+
+/** Counts of the events of a single track of the trace. */
+typedef struct Track {
+    uintptr_t tid;
+    int spawns;
+    int wakes;
+    int begins;
+    int ends;
+    int depth; // number of begins without their ends so far
+    int max_depth;
+    int min_depth; // negative if an end came before its begin
+} Track;
+
+typedef struct Trace {
+    char* json;
+    size_t n_events; // all events but the metadata
+    Track tracks[N_TASKS + 1];
+    int n_tracks;
+} Trace;
+
+static Track* find_track(Trace* trace, uintptr_t tid)
+{
+    for (int i = 0; i < trace->n_tracks; ++i)
+        if (trace->tracks[i].tid == tid)
+            return &trace->tracks[i];
+    assert(trace->n_tracks < N_TASKS + 1);
+    Track* track = &trace->tracks[trace->n_tracks++];
+    *track = (Track) { .tid = tid };
+    return track;
+}
+
+// Dumps the trace of the executor and parses it
+static void dump_trace(Executor* executor, Trace* trace)
+{
+    size_t size;
+    *trace = (Trace) { .json = NULL, .n_events = 0, .n_tracks = 0 };
+    FILE* out = open_memstream(&trace->json, &size);
+    assert(out != NULL);
+    int ret = executor_trace_dump(executor, out);
+    assert(ret == 0);
+    fclose(out);
+
+    assert(strncmp(trace->json, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n", 42) == 0);
+    assert(strcmp(trace->json + size - 4, "\n]}\n") == 0);
+    // Each event is on its own line
+    char* end = strchr(trace->json, '\n');
+    for (char* line = end + 1; *line == '{'; line = end + 1) {
+        end = strchr(line, '\n');
+        *end = '\0'; // so that the searches below stay within the line
+        if (strstr(line, "\"ph\": \"M\""))
+            continue; // metadata: the name of Mio's track
+        ++trace->n_events;
+        char* tid = strstr(line, "\"tid\": ");
+        assert(tid != NULL);
+        Track* track = find_track(trace, (uintptr_t)strtoull(tid + 7, NULL, 10));
+        if (strncmp(line, "{\"name\": \"spawn\"", 16) == 0) {
+            ++track->spawns;
+        } else if (strncmp(line, "{\"name\": \"wake\"", 15) == 0) {
+            ++track->wakes;
+        } else if (strstr(line, "\"ph\": \"B\"")) {
+            ++track->begins;
+            if (++track->depth > track->max_depth)
+                track->max_depth = track->depth;
+        } else if (strstr(line, "\"ph\": \"E\"")) {
+            ++track->ends;
+            if (--track->depth < track->min_depth)
+                track->min_depth = track->depth;
+        }
+    }
+}
+
+static void test_tasks(void)
+{
+    Executor* executor = executor_create(0);
+    YieldingFuture tasks[N_TASKS];
+    for (int i = 0; i < N_TASKS; ++i) {
+        tasks[i] = (YieldingFuture) { .base = future_create(yielding_progress), .left = YIELDS };
+        executor_spawn(executor, (Future*)&tasks[i]);
+    }
+    executor_run(executor);
+
+    Trace trace;
+    dump_trace(executor, &trace);
+    printf("%zu events on %d tracks\n", trace.n_events, trace.n_tracks);
+    // One track per task, and Mio's one (if it has polled)
+    int n_task_tracks = 0;
+    size_t n_task_events = 0;
+    for (int i = 0; i < trace.n_tracks; ++i) {
+        Track* track = &trace.tracks[i];
+        // Progress calls and polls are balanced, and never nested
+        assert(track->begins == track->ends && track->depth == 0);
+        assert(track->max_depth <= 1 && track->min_depth == 0);
+        if (track->tid == 0)
+            continue;
+        bool found = false;
+        for (int j = 0; j < N_TASKS; ++j)
+            found |= track->tid == (uintptr_t)&tasks[j];
+        assert(found);
+        assert(track->spawns == 1);
+        assert(track->wakes == YIELDS);
+        assert(track->begins == YIELDS + 1);
+        ++n_task_tracks;
+        n_task_events += track->spawns + track->wakes + track->begins + track->ends;
+    }
+    assert(n_task_tracks == N_TASKS);
+    assert(n_task_events == N_TASKS * (1 + YIELDS + 2 * (YIELDS + 1)));
+    free(trace.json);
+    executor_destroy(executor);
+}
+
+static void test_ring_buffer(void)
+{
+    // More events than the tracer keeps: only the last EXECUTOR_TRACE_CAPACITY are dumped
+    Executor* executor = executor_create(0);
+    YieldingFuture task = { .base = future_create(yielding_progress), .left = LONG_YIELDS };
+    executor_spawn(executor, (Future*)&task);
+    executor_run(executor);
+
+    Trace trace;
+    dump_trace(executor, &trace);
+    assert(trace.n_events == EXECUTOR_TRACE_CAPACITY);
+    Track* track = find_track(&trace, (uintptr_t)&task);
+    assert(track->spawns == 0); // overwritten
+    assert(track->max_depth <= 1 && track->min_depth >= -1);
+    free(trace.json);
+    executor_destroy(executor);
+}
+
+int main()
+{
+    test_tasks();
+    test_ring_buffer();
+    return 0;
+}